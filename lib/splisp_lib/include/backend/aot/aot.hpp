@@ -0,0 +1,23 @@
+#pragma once
+
+#include <backend/isa/isa.hpp>
+#include <ostream>
+#include <vector>
+
+// translates bytecode into a C++ translation unit which runs it natively on
+// the stack VM. The encoded program is laid out as one function with a label
+// at each instruction: every opcode becomes a call of Stack::step with its
+// operand and offsets as constants, jumps become gotos to their labels and
+// only calls and returns, whose target is known when they run, go through a
+// switch over the offsets. The machine keeps its own stack, frames and heap,
+// so the compiled program behaves as the interpreted one, error for error.
+//
+// The unit includes backend/vm/stack.hpp and links against splisp_lib. Built
+// on its own it is an executable printing what the program halts with;
+// built with -DSPLISP_NO_MAIN it defines only
+//   std::vector<ISA::Instruction> splisp_program();
+//   MachineState splisp_run(Stack &vm);
+// where vm must be a Stack of splisp_program()
+namespace AOT {
+void emit(std::ostream &out, const std::vector<ISA::Instruction> &code);
+} // namespace AOT
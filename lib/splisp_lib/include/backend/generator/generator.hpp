@@ -6,31 +6,51 @@
 #include <map>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 class Generator {
 public:
-  Generator(const core::Program &program) : program(program) {};
+  // threads is how many fragments are generated at once, 0 for one per core
+  Generator(const core::Program &program, unsigned threads = 0)
+      : program(program), threads(threads) {};
   std::vector<ISA::Instruction> generate();
+  // the symbol id held in each global slot, the operand of MKGLOBAL,
+  // LOADGLOBAL and MUTGLOBAL
+  const std::vector<core::SymbolId> &global_ids() const {
+    return this->slot_ids;
+  }
+  // the cells the top level leaves on the data stack at its HALT, one for
+  // each expression
+  size_t halt_depth() const { return this->halt_depth_; }
 
 private:
   friend struct GeneratorTestAccess;
+  class Fragment;
   const core::Program &program;
-  std::vector<core::SymbolId> global_symbols;
-  // symbol name -> index in the formals list/code env
-  std::map<core::SymbolId, size_t> local_symbols;
+  unsigned threads;
+  size_t halt_depth_ = 0;
+  // indexed by symbol id, scoper ids are dense and unique so the table is
+  // never searched. Every define is in it before any code is emitted
+  std::vector<bool> global_symbols;
+  // globals are numbered densely in the order the linked code first mentions
+  // them, so the machine keeps them in a flat array
+  std::vector<size_t> global_slots;
+  std::vector<core::SymbolId> slot_ids;
   std::vector<ISA::Instruction> bytecode;
-  size_t depth = 0;
-  void add_instruction(ISA::Operation op,
-                       std::optional<uint64_t> operand = std::nullopt);
-  void emit_top(const core::Top &top);
-  void emit_expr(const core::Expr &expr);
-  void emit_top_define(const core::Define &def);
-  void emit_cond(const core::Cond &cond);
-  void emit_lambda(const core::Lambda &lambda);
-  void emit_apply(const core::Apply &application);
-  void emit_var(const core::Var &variable);
-  void emit_const(const core::Const &const_var);
-  void emit_set(const core::Set &set_op);
+  // closed lambdas nested in another lambda, created once by the prologue and
+  // loaded from the hidden global id they are stored under
+  std::vector<std::pair<const core::Lambda *, core::SymbolId>> lifted;
+  std::map<const core::Lambda *, core::SymbolId> lifted_ids;
+  // globals which always hold the same lifted lambda
+  std::map<core::SymbolId, const core::Lambda *> direct;
+  void collect_lifted();
+  // joins the fragments in order, the in line code of each and then the code
+  // moved out of line, and numbers the globals. The last fragments hold the
+  // closures, one each
+  void link(std::vector<Fragment> &fragments,
+            const std::vector<const core::Lambda *> &closures);
+  uint64_t global_slot(core::SymbolId id);
 
   // function builtins: used by emit_apply — emits args then the opcode
   const std::map<core::SymbolId, ISA::Operation> builtins = {
@@ -45,10 +65,115 @@ private:
       {13, ISA::Operation::GE},
       {14, ISA::Operation::GT},
   };
+  // variants without the runtime tag test, for applications the typer marked
+  // unchecked
+  const std::map<ISA::Operation, ISA::Operation> unchecked_builtins = {
+      {ISA::Operation::ADD, ISA::Operation::UADD},
+      {ISA::Operation::SUB, ISA::Operation::USUB},
+      {ISA::Operation::MUL, ISA::Operation::UMUL},
+      {ISA::Operation::DIV, ISA::Operation::UDIV},
+      {ISA::Operation::MOD, ISA::Operation::UMOD},
+      {ISA::Operation::CAR, ISA::Operation::UCAR},
+      {ISA::Operation::CDR, ISA::Operation::UCDR},
+  };
   // constant builtins: used by emit_var — emits a single no-operand push
   const std::map<core::SymbolId, ISA::Operation> const_builtins = {
       {8, ISA::Operation::PUSHNIL},
   };
 };
 
+// a part of the program generated on its own, so the parts can be generated
+// at once: the prologue, a top-level form or the code of a lifted closure.
+// It reads only what collect_lifted found. Its addresses count from its own
+// start, its global operands are symbol ids and the calls of a lifted lambda
+// wait on its entry, all settled by Generator::link
+class Generator::Fragment {
+public:
+  // depth is the number of cells the code before it leaves on the stack
+  Fragment(const Generator &gen, size_t depth) : gen(gen), depth(depth) {}
+  std::vector<ISA::Instruction> bytecode;
+  // the end of the in line code, the cold branches of a top-level form
+  // follow and go past the HALT
+  size_t out_of_line = 0;
+  // instructions whose operand is the entry of a lifted lambda
+  std::vector<std::pair<size_t, const core::Lambda *>> entry_refs;
+  // the function bodies following the out of line code, each up to the
+  // next, which link moves to the function section
+  struct Body {
+    size_t start;
+    uint64_t count;
+  };
+  std::vector<Body> bodies;
+
+  void add_instruction(ISA::Operation op,
+                       std::optional<uint64_t> operand = std::nullopt,
+                       uint32_t site = 0);
+  // marks the end of the in line code, anything emitted after is out of line
+  void end_in_line();
+  void emit_cold();
+  void emit_top(const core::Top &top);
+  // emits the lambda as a function body, returning the index of its ENTER
+  uint64_t emit_body(const core::Lambda &lambda);
+  // emits the bodies of the closures made so far
+  void emit_bodies();
+
+private:
+  const Generator &gen;
+  // a local is addressed by its slot in the frame that bound it and the
+  // shift there, the formals of every closure enclosing that frame. A
+  // closure puts its formals below the cells it captures, so deeper in the
+  // slot is slot + shift - bound.shift
+  struct Local {
+    size_t slot = 0;
+    size_t shift = 0;
+    bool bound = false;
+  };
+  std::vector<Local> local_symbols;
+  size_t shift = 0;
+  // number of cells above frame_base at the current point of emission, let
+  // bound variables live at the slot they were pushed into
+  size_t depth = 0;
+  // a branch the profile saw taken less often than the other, emitted after
+  // the code around it from the state at its jump and jumping back to join
+  struct ColdBranch {
+    const core::Expr *expr;
+    bool tail;
+    size_t depth;
+    size_t shift;
+    size_t jump;
+    size_t join;
+  };
+  std::vector<ColdBranch> cold;
+  // a closure made by MKCLOSURE at make, whose body is emitted later from
+  // the state there
+  struct Pending {
+    const core::Lambda *lambda;
+    size_t depth;
+    size_t shift;
+    size_t make;
+  };
+  std::vector<Pending> pending;
+  void bind_local(core::SymbolId id, size_t slot);
+  // the frame index of a bound local
+  std::optional<size_t> find_local(core::SymbolId id) const;
+  bool is_global(core::SymbolId id) const;
+  // tail marks an expression whose value the enclosing lambda returns
+  void emit_expr(const core::Expr &expr, bool tail = false);
+  void emit_top_define(const core::Define &def);
+  void emit_cond(const core::Cond &cond, bool tail = false);
+  void emit_lambda(const core::Lambda &lambda);
+  // emits ENTER through RET for the lambda, returning the ENTER index
+  uint64_t emit_closure_code(const core::Lambda &lambda);
+  // true when the code from `from` on ends in a tail call and nothing jumps
+  // past it, so there is no way to reach a return emitted after it
+  bool ends_in_tail_call(size_t from) const;
+  void emit_apply(const core::Apply &application, bool tail = false);
+  void emit_let(const core::Lambda &lambda,
+                const std::vector<std::unique_ptr<core::Expr>> &args,
+                bool tail = false);
+  void emit_var(const core::Var &variable);
+  void emit_const(const core::Const &const_var);
+  void emit_set(const core::Set &set_op);
+};
+
 void print_bytecode(const std::vector<ISA::Instruction> &bytecode);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <backend/isa/register_isa.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+// generates code for the register engine from the same core::Program the
+// stack Generator takes. Every function gets a frame of registers: its
+// formals, then the locals its closure captured, then let bound variables and
+// temporaries, which are allocated in scope order and reused once the
+// expression holding them is done. A variable is read from its own register,
+// so operands cost no instructions, and a result is computed straight into
+// the register that wants it. Locals captured by a closure and set! are kept
+// in boxes so both frames see the store
+class RegisterGenerator {
+public:
+  RegisterGenerator(const core::Program &program) : program(program) {};
+  std::vector<RegISA::Instruction> generate();
+
+private:
+  friend struct RegisterGeneratorTestAccess;
+  struct Slot {
+    uint32_t reg;
+    bool boxed;
+  };
+
+  const core::Program &program;
+  std::vector<RegISA::Instruction> code;
+
+  std::set<core::SymbolId> globals;
+  // the slot of each global in the machine's flat global table
+  std::map<core::SymbolId, uint64_t> global_slots;
+  std::set<core::SymbolId> assigned;
+  std::set<core::SymbolId> boxed;
+  // closure lambda -> the locals it captures, in id order
+  std::map<const core::Lambda *, std::vector<core::SymbolId>> free;
+  // globals which always hold the same lambda, called by entry
+  std::map<core::SymbolId, const core::Lambda *> direct;
+  // function bodies emitted after HALT, and the instructions whose k waits
+  // on their entry
+  std::vector<const core::Lambda *> functions;
+  std::map<const core::Lambda *, std::vector<size_t>> entry_uses;
+
+  // the function being emitted
+  std::map<core::SymbolId, Slot> slots;
+  uint32_t next = 0;
+  uint32_t frame = 0;
+
+  void analyse();
+  void emit(RegISA::Instruction instr);
+  uint32_t alloc();
+  uint32_t target(std::optional<uint32_t> dest);
+  void use_entry(const core::Lambda &lambda);
+  void emit_function(const core::Lambda &lambda);
+  void emit_body(const std::vector<std::unique_ptr<core::Expr>> &body,
+                 std::optional<uint32_t> dest, bool tail);
+  // emits the expression and returns the register holding its value, which
+  // is dest when one is given. In tail position the value is returned from
+  // the function instead
+  uint32_t emit_expr(const core::Expr &expr,
+                     std::optional<uint32_t> dest = std::nullopt,
+                     bool tail = false);
+  // emits a statement whose value is dropped
+  void emit_effect(const core::Expr &expr);
+  uint32_t emit_var(const core::Var &var, std::optional<uint32_t> dest);
+  void emit_set(const core::Set &set);
+  uint32_t emit_closure(const core::Lambda &lambda,
+                        std::optional<uint32_t> dest);
+  uint32_t emit_cond(const core::Cond &cond, std::optional<uint32_t> dest,
+                     bool tail);
+  // a branch taken when the condition is false, returning its index
+  size_t emit_branch(const core::Expr &condition);
+  uint32_t emit_apply(const core::Apply &apply, std::optional<uint32_t> dest,
+                      bool tail);
+  uint32_t emit_let(const core::Lambda &lambda,
+                    const std::vector<std::unique_ptr<core::Expr>> &args,
+                    std::optional<uint32_t> dest, bool tail);
+  uint32_t emit_call(const core::Apply &apply, std::optional<uint32_t> dest,
+                     bool tail);
+  uint32_t result(uint32_t reg, bool tail);
+
+  const std::map<core::SymbolId, RegISA::Operation> binary_builtins = {
+      {0, RegISA::Operation::ADD},  {1, RegISA::Operation::SUB},
+      {2, RegISA::Operation::MUL},  {3, RegISA::Operation::DIV},
+      {4, RegISA::Operation::MOD},  {5, RegISA::Operation::CONS},
+      {10, RegISA::Operation::EQ},  {11, RegISA::Operation::LT},
+      {12, RegISA::Operation::LE},  {13, RegISA::Operation::GE},
+      {14, RegISA::Operation::GT},
+  };
+  const std::map<core::SymbolId, RegISA::Operation> unary_builtins = {
+      {6, RegISA::Operation::CAR},
+      {7, RegISA::Operation::CDR},
+      {9, RegISA::Operation::ISNULL},
+  };
+  // the branch taken when a comparison fails
+  const std::map<core::SymbolId, RegISA::Operation> negated_branches = {
+      {10, RegISA::Operation::JNE}, {11, RegISA::Operation::JGE},
+      {12, RegISA::Operation::JGT}, {13, RegISA::Operation::JLT},
+      {14, RegISA::Operation::JLE},
+  };
+  const core::SymbolId add_id = 0;
+  const core::SymbolId sub_id = 1;
+  const core::SymbolId nil_id = 8;
+};
+
+void print_register_code(const std::vector<RegISA::Instruction> &code);
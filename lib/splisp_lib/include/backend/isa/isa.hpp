@@ -4,7 +4,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <optional>
+#include <set>
+#include <span>
 #include <string>
+#include <vector>
 
 namespace ISA {
 enum class Operation : uint8_t {
@@ -15,8 +18,16 @@ enum class Operation : uint8_t {
   MOD,
   INC,
   DEC,
+  ADDI,
+  ADDLL,
+  ADDLI,
   MAX,
   MIN,
+  UADD,
+  USUB,
+  UMUL,
+  UDIV,
+  UMOD,
   LT,
   LE,
   EQ,
@@ -28,21 +39,43 @@ enum class Operation : uint8_t {
   NROT,
   PUSH,
   CALL,
+  TAILCALL,
+  CALLGLOBAL,
+  TAILCALLGLOBAL,
+  CALLDIRECT,
+  TAILCALLDIRECT,
   RET,
+  RETN,
   JMP,
   CJMP,
+  CJMPZ,
+  JLT,
+  JLE,
+  JEQ,
+  JNE,
+  JGE,
+  JGT,
+  JNULL,
+  JNNULL,
   WAIT,
   HALT,
   MKCLOSURE,
+  MKLOCALCLOSURE,
   MKGLOBAL,
   LOADGLOBAL,
   MUTGLOBAL,
   ENTER,
   GETLOCAL,
+  GETLOCAL2,
   SETLOCAL,
   CONS,
+  LOCALCONS,
   CAR,
   CDR,
+  UCAR,
+  UCDR,
+  LOCALCAR,
+  LOCALCDR,
   PUSHNIL,
   ISNULL,
 };
@@ -76,8 +109,16 @@ inline constexpr std::array<Spec, op_count> spec_list{{
     {"mod", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
     {"inc", OperandKind::NONE, OperationKind::ARITHMETIC, 1, 1},
     {"dec", OperandKind::NONE, OperationKind::ARITHMETIC, 1, 1},
+    {"addi", OperandKind::U64, OperationKind::ARITHMETIC, 1, 1},
+    {"addll", OperandKind::U64, OperationKind::ARITHMETIC, 0, 1},
+    {"addli", OperandKind::U64, OperationKind::ARITHMETIC, 0, 1},
     {"max", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
     {"min", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
+    {"uadd", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
+    {"usub", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
+    {"umul", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
+    {"udiv", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
+    {"umod", OperandKind::NONE, OperationKind::ARITHMETIC, 2, 1},
     {"lt", OperandKind::NONE, OperationKind::LOGIC, 2, 1},
     {"le", OperandKind::NONE, OperationKind::LOGIC, 2, 1},
     {"eq", OperandKind::NONE, OperationKind::LOGIC, 2, 1},
@@ -89,28 +130,127 @@ inline constexpr std::array<Spec, op_count> spec_list{{
     {"nrot", OperandKind::U64, OperationKind::TRANSFER, 0, 0},
     {"push", OperandKind::U64, OperationKind::TRANSFER, 0, 1},
     {"call", OperandKind::U64, OperationKind::CONTROL, 0, 0},
+    {"tailcall", OperandKind::U64, OperationKind::CONTROL, 0, 0},
+    {"callglobal", OperandKind::U64, OperationKind::CONTROL, 0, 0},
+    {"tailcallglobal", OperandKind::U64, OperationKind::CONTROL, 0, 0},
+    {"calldirect", OperandKind::ADD, OperationKind::CONTROL, 0, 1},
+    {"tailcalldirect", OperandKind::ADD, OperationKind::CONTROL, 0, 1},
     {"ret", OperandKind::NONE, OperationKind::CONTROL, 0, 0},
+    {"retn", OperandKind::U64, OperationKind::CONTROL, 0, 0},
     {"jmp", OperandKind::ADD, OperationKind::CONTROL, 0, 0},
     {"cjmp", OperandKind::ADD, OperationKind::CONTROL, 1, 0},
+    {"cjmpz", OperandKind::ADD, OperationKind::CONTROL, 1, 0},
+    {"jlt", OperandKind::ADD, OperationKind::CONTROL, 2, 0},
+    {"jle", OperandKind::ADD, OperationKind::CONTROL, 2, 0},
+    {"jeq", OperandKind::ADD, OperationKind::CONTROL, 2, 0},
+    {"jne", OperandKind::ADD, OperationKind::CONTROL, 2, 0},
+    {"jge", OperandKind::ADD, OperationKind::CONTROL, 2, 0},
+    {"jgt", OperandKind::ADD, OperationKind::CONTROL, 2, 0},
+    {"jnull", OperandKind::ADD, OperationKind::CONTROL, 1, 0},
+    {"jnnull", OperandKind::ADD, OperationKind::CONTROL, 1, 0},
     {"wait", OperandKind::NONE, OperationKind::CONTROL, 0, 0},
     {"halt", OperandKind::NONE, OperationKind::CONTROL, 0, 0},
-    {"mkclosure", OperandKind::U64, OperationKind::CONTROL, 0, 0},
+    {"mkclosure", OperandKind::ADD, OperationKind::CONTROL, 0, 1},
+    {"mklocalclosure", OperandKind::ADD, OperationKind::CONTROL, 0, 1},
     {"mkglobal", OperandKind::U64, OperationKind::CONTROL, 1, 0},
-    {"loadglobal", OperandKind::U64, OperationKind::CONTROL, 0, 0},
-    {"mutglobal", OperandKind::U64, OperationKind::CONTROL, 0, 0},
+    {"loadglobal", OperandKind::U64, OperationKind::CONTROL, 0, 1},
+    {"mutglobal", OperandKind::U64, OperationKind::CONTROL, 1, 0},
     {"enter", OperandKind::U64, OperationKind::CONTROL, 0, 0},
     {"get_local", OperandKind::U64, OperationKind::CONTROL, 0, 1},
+    {"get_local2", OperandKind::U64, OperationKind::CONTROL, 0, 2},
     {"set_local", OperandKind::U64, OperationKind::CONTROL, 1, 0},
     {"cons", OperandKind::NONE, OperationKind::LIST, 2, 1},
+    {"localcons", OperandKind::NONE, OperationKind::LIST, 2, 1},
     {"car", OperandKind::NONE, OperationKind::LIST, 1, 1},
     {"cdr", OperandKind::NONE, OperationKind::LIST, 1, 1},
+    {"ucar", OperandKind::NONE, OperationKind::LIST, 1, 1},
+    {"ucdr", OperandKind::NONE, OperationKind::LIST, 1, 1},
+    {"localcar", OperandKind::U64, OperationKind::LIST, 0, 1},
+    {"localcdr", OperandKind::U64, OperationKind::LIST, 0, 1},
     {"pushnil", OperandKind::NONE, OperationKind::LIST, 0, 1},
     {"isnull", OperandKind::NONE, OperationKind::LIST, 1, 1},
 }};
 
+// the form code takes between the generator and the VM. Address operands
+// are instruction indexes, encode turns them into byte offsets
 struct Instruction {
   Operation op;
   std::optional<uint64_t> operand;
-  std::array<uint8_t, 9> to_bytes() const;
+  // the core::number_sites site a profiling VM counts this instruction
+  // under, 0 for none. It is not part of the encoding
+  uint32_t site = 0;
 };
+
+// the superinstructions taking two operands pack them into the low and high
+// halves of the one operand
+constexpr uint64_t pack(uint32_t low, uint32_t high) {
+  return static_cast<uint64_t>(low) | (static_cast<uint64_t>(high) << 32);
+}
+constexpr uint32_t low(uint64_t operand) {
+  return static_cast<uint32_t>(operand);
+}
+constexpr uint32_t high(uint64_t operand) {
+  return static_cast<uint32_t>(operand >> 32);
+}
+
+inline bool is_address(Operation op) {
+  return spec_list[static_cast<uint8_t>(op)].operand == OperandKind::ADD;
+}
+
+// the packed code the stack VM runs. Each instruction is its opcode byte,
+// followed by a LEB128 varint for a U64 operand or the four byte little
+// endian offset of its target for an address, and nothing when its operand
+// kind is NONE
+struct Encoded {
+  std::vector<uint8_t> bytes;
+  // the offset of each instruction, then the end
+  std::vector<uint32_t> offsets;
+};
+
+// throws std::out_of_range for an address past the end of the code
+Encoded encode(const std::vector<Instruction> &code);
+
+struct Decoded {
+  Operation op;
+  uint64_t operand;
+  // the offset of the following instruction
+  std::size_t next;
+};
+
+inline Decoded decode(const uint8_t *bytes, std::size_t offset) {
+  const auto op = static_cast<Operation>(bytes[offset++]);
+  uint64_t operand = 0;
+  switch (spec_list[static_cast<uint8_t>(op)].operand) {
+  case (OperandKind::NONE):
+    break;
+  case (OperandKind::U64):
+    for (unsigned shift = 0;; shift += 7) {
+      const uint8_t byte = bytes[offset++];
+      operand |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+    break;
+  case (OperandKind::ADD):
+    operand = static_cast<uint64_t>(bytes[offset]) |
+              static_cast<uint64_t>(bytes[offset + 1]) << 8 |
+              static_cast<uint64_t>(bytes[offset + 2]) << 16 |
+              static_cast<uint64_t>(bytes[offset + 3]) << 24;
+    offset += 4;
+    break;
+  }
+  return Decoded{op, operand, offset};
+}
+
+// the inverse of encode, turning address operands back into instruction
+// indexes. Throws std::out_of_range for an address between instructions
+std::vector<Instruction> decode_code(std::span<const uint8_t> bytes);
+
+// instruction indexes some address operand points at
+std::set<std::size_t> jump_targets(const std::vector<Instruction> &code);
+
+// rewrites every address operand through moved, which maps each old
+// instruction index (and the end) to the index of what replaced it
+void relocate(std::vector<Instruction> &code,
+              const std::vector<std::size_t> &moved);
 } // namespace ISA
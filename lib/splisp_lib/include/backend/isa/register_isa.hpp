@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// the three-address ISA of the register engine: a, b and c name registers of
+// the current frame and k holds a constant, a global slot, an instruction
+// index or a count. Arithmetic, comparisons and list ops read their operands
+// straight from the registers of the variables they use, so an expression
+// costs about one instruction per operation instead of one per operand
+namespace RegISA {
+enum class Operation : uint8_t {
+  MOV,     // a <- b
+  LOADK,   // a <- k
+  LOADNIL, // a <- nil
+  LOADG,   // a <- global k
+  STOREG,  // global k <- a
+  ADD,     // a <- b + c
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  ADDI, // a <- b + k, k a two's complement immediate
+  // comparisons keep the operand order of the stack machine: a <- c op b
+  LT,
+  LE,
+  EQ,
+  GE,
+  GT,
+  JMP, // to k
+  JT,  // to k when a is not 0
+  JF,  // to k when a is 0
+  // to k when b op a holds, the order of the comparisons above
+  JLT,
+  JLE,
+  JEQ,
+  JNE,
+  JGE,
+  JGT,
+  CONS, // a <- (b . c)
+  CAR,  // a <- car b
+  CDR,
+  ISNULL,
+  BOX,    // a <- a new box holding a
+  UNBOX,  // a <- the value in box b
+  SETBOX, // the box in a <- b
+  // a <- closure entering at k, capturing the c registers from b
+  CLOSURE,
+  // a <- call of the closure in b with the k arguments from c
+  CALL,
+  // a <- call of the function entering at k with the b arguments from c
+  CALLDIRECT,
+  // the same calls reusing the current frame, the result is returned
+  TAILCALL,
+  TAILCALLDIRECT,
+  // a frame of k registers, a call reads the one heading its callee and
+  // starts past it
+  ENTER,
+  RET,   // return a
+  HALT,  // stop with a as the result when b is 1
+};
+
+struct Spec {
+  const char *mnemonic;
+};
+
+constexpr std::size_t op_count = static_cast<std::size_t>(Operation::HALT) + 1;
+inline constexpr std::array<Spec, op_count> spec_list{{
+    {"mov"},
+    {"loadk"},
+    {"loadnil"},
+    {"loadg"},
+    {"storeg"},
+    {"add"},
+    {"sub"},
+    {"mul"},
+    {"div"},
+    {"mod"},
+    {"addi"},
+    {"lt"},
+    {"le"},
+    {"eq"},
+    {"ge"},
+    {"gt"},
+    {"jmp"},
+    {"jt"},
+    {"jf"},
+    {"jlt"},
+    {"jle"},
+    {"jeq"},
+    {"jne"},
+    {"jge"},
+    {"jgt"},
+    {"cons"},
+    {"car"},
+    {"cdr"},
+    {"isnull"},
+    {"box"},
+    {"unbox"},
+    {"setbox"},
+    {"closure"},
+    {"call"},
+    {"calldirect"},
+    {"tailcall"},
+    {"tailcalldirect"},
+    {"enter"},
+    {"ret"},
+    {"halt"},
+}};
+
+struct Instruction {
+  Operation op;
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint32_t c = 0;
+  uint64_t k = 0;
+};
+} // namespace RegISA
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <backend/isa/isa.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <frontend/scoper.hpp>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the .splc module: compiled code the stack VM runs straight from the
+// mapped file. It is little endian, a Header followed by the sections it
+// points at, each aligned to 8 bytes:
+//   code     the bytes of ISA::encode
+//   globals  a Global for each global slot the code uses
+//   names    the names of the globals, each ending in a NUL
+//   sites    the profile site of each instruction carrying one, as Site
+// The checksum covers everything after the header. A program is linked and
+// runs as it is. An object is one source file compiled on its own, its slots
+// are its own and the names of its globals are what the linker joins
+namespace SPLC {
+constexpr uint32_t magic = 0x434c5053; // "SPLC"
+// bumped whenever the layout or the encoding of the code changes
+constexpr uint16_t version = 3;
+
+enum class Kind : uint16_t { PROGRAM, OBJECT };
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  Kind kind;
+  uint32_t checksum;
+  uint32_t code_offset;
+  uint32_t code_size;
+  uint32_t globals_offset;
+  uint32_t global_count;
+  uint32_t names_offset;
+  uint32_t names_size;
+  uint32_t sites_offset;
+  uint32_t site_count;
+  // the cells the top level leaves on the data stack at its HALT, which the
+  // linker drops before the next module's top level runs
+  uint32_t halt_depth;
+};
+
+constexpr uint32_t no_name = 0xFFFFFFFF;
+
+struct Global {
+  // offset into the names, no_name for a global private to the module such
+  // as a lifted lambda
+  uint32_t name;
+  // set when the module defines it rather than expecting another module to
+  uint32_t defined;
+};
+
+struct Site {
+  uint32_t offset;
+  uint32_t site;
+};
+
+// a global slot of code that is not written yet, an empty name is private
+struct Symbol {
+  std::string name;
+  bool defined = true;
+};
+
+// what a module holds, before it is written
+struct Image {
+  Kind kind = Kind::PROGRAM;
+  std::vector<uint8_t> code;
+  std::vector<Symbol> globals;
+  std::vector<Site> sites;
+  uint32_t halt_depth = 0;
+};
+
+// names the global slots of generated code, slot_ids as the Generator gives
+// them. A global the scoper took for an extern is not defined
+std::vector<Symbol> symbols(const std::vector<core::SymbolId> &slot_ids,
+                            const Scoper &scoper);
+// encodes the bytecode, globals naming each of its slots and halt_depth
+// being what PassManager::halt_depth gives
+Image make_image(const std::vector<ISA::Instruction> &code,
+                 std::vector<Symbol> globals, Kind kind = Kind::PROGRAM,
+                 uint32_t halt_depth = 0);
+void write(std::ostream &out, const Image &image);
+// FNV-1a
+uint32_t checksum(std::span<const uint8_t> bytes);
+
+// a module file mapped read only. The sections point into the mapping and
+// live as long as the Module. Loading checks the header and the checksum and
+// throws std::runtime_error for anything that is not a module of this version
+class Module {
+public:
+  static Module load(const std::string &path);
+  Module(Module &&other) noexcept;
+  Module &operator=(Module &&other) noexcept;
+  Module(const Module &) = delete;
+  Module &operator=(const Module &) = delete;
+  ~Module();
+
+  Kind kind() const { return this->kind_; }
+  uint32_t halt_depth() const { return this->halt_depth_; }
+  std::span<const uint8_t> code() const { return this->code_; }
+  std::span<const Global> globals() const { return this->globals_; }
+  std::span<const Site> sites() const { return this->sites_; }
+  // the name of a global, empty for a private one
+  std::string_view name(const Global &global) const;
+
+private:
+  Module() = default;
+  void *mapping = nullptr;
+  std::size_t length = 0;
+  Kind kind_ = Kind::PROGRAM;
+  uint32_t halt_depth_ = 0;
+  std::span<const uint8_t> code_;
+  std::span<const Global> globals_;
+  std::span<const char> names_;
+  std::span<const Site> sites_;
+};
+
+// code and global table of the modules joined into one program
+struct Linked {
+  std::vector<ISA::Instruction> code;
+  std::vector<Symbol> globals;
+  // that of the last module
+  uint32_t halt_depth = 0;
+};
+
+// links modules in the order given: the top level of each runs after the one
+// before, in place of its HALT, on a data stack emptied of what the one
+// before left, and a name gets one slot program wide.
+// Throws std::runtime_error for a program among several modules, a global
+// no module defines, one defined by two modules, and one set! outside the
+// module defining it, whose code may call or read it as the constant it is
+// there
+Linked link(const std::vector<Module> &modules);
+} // namespace SPLC
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <backend/isa/isa.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <utility>
+#include <vector>
+
+class Stack;
+
+// a baseline JIT for the stack VM on x86-64 Linux. A function entered often
+// enough is translated instruction by instruction into a template: a call to
+// the handler of its opcode with the operand and offsets patched in, so the
+// machine runs it without fetching, decoding or dispatching. Jumps within the
+// function become native jumps. Calls and returns, whose target is only known
+// when they run, leave the native code with pc set, and the interpreter loop
+// enters it again at the callee or at the instruction after the call.
+// Everything keeps the data stack of the interpreter, so native and
+// interpreted code mix freely. Each function is listed in /tmp/perf-<pid>.map
+// for perf to symbolize
+class Jit {
+public:
+  // what a handler tells the native code: go on with the next instruction,
+  // the instruction moved pc, or stop and leave the machine state to the
+  // interpreter
+  static constexpr int next = 0;
+  static constexpr int jumped = 1;
+  static constexpr int stop = 2;
+  // runs one instruction of the machine: operand, its offset and the offset
+  // after it
+  using Op = int (*)(Stack *vm, uint64_t operand, uint64_t at, uint64_t after);
+  // runs native code from an entry until it leaves, returning jumped or stop
+  using Native = int (*)(Stack *vm);
+
+  // whether this machine can run the code the JIT emits
+  static bool supported();
+  // compiles a function once it is called threshold times
+  Jit(std::span<const uint8_t> code, std::array<Op, ISA::op_count> ops,
+      uint32_t threshold);
+  Jit(Jit &&other) noexcept;
+  Jit &operator=(Jit &&other) noexcept;
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+  ~Jit();
+
+  // counts a call of the function entered at entry
+  void called(size_t entry);
+  // translates the function entered at entry, the code reachable from it up
+  // to its returns and tail calls
+  void compile(size_t entry);
+  // the native code entered at offset, null where the interpreter runs
+  Native native(size_t offset) const {
+    return offset < this->natives.size() ? this->natives[offset] : nullptr;
+  }
+  // functions compiled so far
+  size_t compiled() const { return this->blocks.size(); }
+
+private:
+  std::span<const uint8_t> code;
+  std::array<Op, ISA::op_count> ops;
+  uint32_t threshold;
+  std::vector<uint32_t> calls;
+  std::vector<Native> natives;
+  // the executable mappings, each a compiled function
+  std::vector<std::pair<void *, size_t>> blocks;
+  std::ofstream perf_map;
+};
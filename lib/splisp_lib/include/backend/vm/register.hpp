@@ -0,0 +1,78 @@
+#pragma once
+
+#include <backend/isa/register_isa.hpp>
+#include <backend/vm/stack.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <map>
+#include <optional>
+#include <variant>
+#include <vector>
+
+// runs the code of the RegisterGenerator. Registers are plain values in one
+// vector, a frame is the window of it starting at its base, and a call copies
+// its arguments and the captured values of the closure to the first registers
+// of the new frame just past the caller's. Values other than integers index
+// the heap, boxes hold the locals which closures share
+class RegisterMachine {
+public:
+  enum class Tag : uint8_t { INT, FUNCTION, PAIR, NIL, BOX };
+  struct Value {
+    int64_t value = 0;
+    Tag tag = Tag::INT;
+  };
+
+  RegisterMachine(std::vector<RegISA::Instruction> program, bool dbg = false);
+  MachineState run_program();
+  // the value HALT stopped with, if the program ended in an expression
+  const std::optional<Value> &result() const { return this->halted_with; }
+  // instructions run so far
+  uint64_t executed() const { return this->steps; }
+
+private:
+  friend struct RegisterMachineTestAccess;
+  struct Pair {
+    Value head;
+    Value tail;
+  };
+  struct Closure {
+    uint64_t entry;
+    std::vector<Value> env;
+  };
+  struct Box {
+    Value value;
+  };
+  using Object = std::variant<Pair, Closure, Box>;
+  struct Frame {
+    size_t ret;
+    size_t base;
+    size_t top;
+    uint32_t dest;
+  };
+
+  MachineState step();
+  Value &reg(uint32_t r) { return this->regs[this->base + r]; }
+  Value alloc(Object object, Tag tag);
+  // starts the function at entry with the count registers from args, then
+  // env, in its first registers, reusing the current frame for a tail call
+  void enter(uint64_t entry, size_t args, size_t count,
+             const std::vector<Value> &env, bool tail, uint32_t dest);
+
+  bool dbg;
+  std::vector<RegISA::Instruction> program_mem;
+  size_t pc = 0;
+  uint64_t steps = 0;
+
+  std::vector<Value> regs;
+  size_t base = 0;
+  size_t top = 0;
+  std::vector<Frame> frames;
+  // arguments of a tail call on their way to the bottom of the frame
+  std::vector<Value> scratch;
+
+  // indexed by global slot, empty until defined
+  std::vector<std::optional<Value>> globals;
+  std::vector<Object> heap;
+  std::optional<Value> halted_with;
+};
@@ -3,10 +3,18 @@
 #include "frontend/core.hpp"
 #include <algorithm>
 #include <backend/isa/isa.hpp>
+#include <backend/module/module.hpp>
+#include <backend/vm/jit.hpp>
+#include <backend/vm/verifier.hpp>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <map>
+#include <memory>
+#include <span>
 #include <stack>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 enum MachineState {
@@ -24,6 +32,8 @@ struct Cell {
   bool function = false;
   bool pair = false;
   bool null = false;
+  // handle into the frame heap rather than the heap
+  bool local = false;
 };
 
 struct CodeEnv {
@@ -41,16 +51,76 @@ using HeapObject = std::variant<Pair, CodeEnv>;
 class Stack {
 public:
   Stack(std::vector<ISA::Instruction> program, bool dbg = false);
+  // runs the code of a program module in place, which must outlive the Stack
+  Stack(const SPLC::Module &module, bool dbg = false);
+  // program_mem may point into encoded, which a move keeps where it was
+  Stack(Stack &&) = default;
+  Stack &operator=(Stack &&) = default;
+  Stack(const Stack &) = delete;
+  Stack &operator=(const Stack &) = delete;
+  // proves the program safe to run with the bounds checks left out, see
+  // backend/vm/verifier.hpp, and runs it so from then on: locals and the
+  // cells under a call are indexed directly, pc is not compared against the
+  // end and each frame reserves the stack its function needs on ENTER.
+  // Throws std::runtime_error for code the verifier rejects
+  void verify();
+  bool is_verified() const { return this->verified; }
   // run instruction and handle state
   void advanceProgram();
   MachineState run_program();
   MachineState run_program_dbg(const std::vector<ISA::Instruction> &source);
 
+  // counts every straight-line run of two and three opcodes executed from
+  // here on, the runs never span a taken jump, call or return. Instructions
+  // carrying a profile site are counted under it as well
+  void enable_profile();
+  const std::map<std::vector<ISA::Operation>, uint64_t> &op_profile() const {
+    return this->sequences;
+  }
+  const core::Profile &site_profile() const { return this->sites; }
+  // instructions run so far
+  uint64_t executed() const { return this->steps; }
+  // the top of the data stack, what a program halts with, null if it is empty
+  std::shared_ptr<Cell> result() const {
+    return this->data_stack.empty() ? nullptr : this->data_stack.back();
+  }
+
+  // compiles each function called threshold times to native code, see
+  // backend/vm/jit.hpp. Native code skips the dbg trace and the profile, so
+  // this returns false and leaves the interpreter alone when profiling or
+  // when the machine cannot run it. Profiling later turns it off
+  static constexpr uint32_t jit_threshold = 50;
+  bool enable_jit(uint32_t threshold = jit_threshold);
+  const Jit *jit_state() const { return this->jit.get(); }
+
+  // runs code compiled ahead of time from the program of this machine, see
+  // backend/aot/aot.hpp, catching what it throws as run_program does
+  using Compiled = MachineState (*)(Stack &vm);
+  MachineState run_compiled(Compiled code);
+  // runs the instruction op at offset at as dispatch would, with operand and
+  // the offset after it decoded beforehand. False once the machine stopped,
+  // position() tells where it went on
+  bool step(uint8_t op, uint64_t operand, size_t at, size_t after);
+  size_t position() const { return this->pc; }
+  MachineState state() const { return this->machine_state; }
+
 private:
   friend struct StackTestAccess;
-  // dispatches to the handlers
+  // runs the instruction at pc, counting its site when profiling
   MachineState runInstruction();
+  // dispatches to the handlers
+  MachineState dispatch();
+  // runs the handler of op, with operand and next_pc already set
+  MachineState execute(uint8_t op);
+  // runs the native code entered at pc until it leaves
+  MachineState run_native(Jit::Native native);
+  // the template of each op: steps and tells the native code where to go on
+  template <uint8_t op>
+  static int jit_op(Stack *vm, uint64_t operand, uint64_t at, uint64_t after);
+  static std::array<Jit::Op, ISA::op_count> jit_ops();
   MachineState setState(MachineState next);
+  // the loop of run_program, checked unless the program is verified
+  template <bool checked> MachineState run_loop();
   bool dbg;
 
   // I am almost certain there is a better way to propagate
@@ -61,16 +131,63 @@ private:
   MachineState handleControl(uint8_t op);
   MachineState handleList(uint8_t op);
 
+  // a byte offset into program_mem
   size_t pc = 0;
+  // the operand of the instruction at pc and the offset after it
+  uint64_t operand = 0;
+  size_t next_pc = 0;
+  uint64_t steps = 0;
   MachineState machine_state = MachineState::OKAY;
 
   std::vector<std::shared_ptr<Cell>> data_stack;
   std::stack<std::shared_ptr<Cell>> return_stack;
 
-  std::map<core::SymbolId, std::shared_ptr<Cell>> global_tbl;
+  // indexed by the slot the generator gave each global, null until bound
+  std::vector<std::shared_ptr<Cell>> global_tbl;
+  // the global cell in a slot, stored to by MKGLOBAL and MUTGLOBAL
+  std::shared_ptr<Cell> &global(uint64_t slot);
+  // the global cell in a slot for a read, throwing when it is still unbound
+  const std::shared_ptr<Cell> &read_global(uint64_t slot);
+  // the cell at index of the data stack, and the local at index of the frame
+  std::shared_ptr<Cell> &cell(std::size_t index);
+  std::shared_ptr<Cell> &local(uint64_t index) {
+    return cell(this->frame_base + index);
+  }
+  // a call reaches a closure only known at run time, so a verified machine
+  // checks the frame its ENTER opens is the one the caller built
+  void check_arity(const CodeEnv &env, uint64_t args) const;
   std::vector<HeapObject> heap;
-  std::vector<ISA::Instruction> program_mem;
+  // objects proven not to outlive their frame, released on RET
+  std::vector<HeapObject> frame_heap;
+  std::stack<std::size_t, std::vector<std::size_t>> frame_heap_marks;
+  // the program as ISA::encode packs it, in encoded or a module
+  std::span<const uint8_t> program_mem;
+  std::vector<uint8_t> encoded;
+  std::vector<uint32_t> offsets;
 
   std::size_t frame_base = 0;
   std::stack<std::size_t, std::vector<std::size_t>> frame_base_stack;
+
+  bool profiling = false;
+  std::map<std::vector<ISA::Operation>, uint64_t> sequences;
+  core::Profile sites;
+  // the profile site of each instruction carrying one, by offset
+  std::unordered_map<size_t, uint32_t> site_at;
+  // the opcodes executed just before this one without a jump in between
+  std::vector<ISA::Operation> window;
+  size_t window_next = 0;
+  void record(ISA::Operation op);
+
+  bool verified = false;
+  // the most cells the function entered at each offset holds, see Verified
+  std::vector<uint32_t> frame_depth;
+
+  std::unique_ptr<Jit> jit;
+  // what a handler threw in native code, rethrown once it has left
+  std::exception_ptr jit_error;
 };
+
+// the n most executed opcode runs of a profile, most frequent first
+std::vector<std::pair<std::vector<ISA::Operation>, uint64_t>>
+hot_sequences(const std::map<std::vector<ISA::Operation>, uint64_t> &profile,
+              size_t n);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+
+// what the verifier proved of a program
+struct Verified {
+  // the most cells each function holds above its frame base at once, by the
+  // offset of its ENTER, the top level under 0
+  std::map<std::size_t, std::size_t> max_depth;
+  // one more than the highest global slot the code names
+  std::size_t globals = 0;
+};
+
+// checks the encoded code of the stack VM before it runs. Every instruction
+// is decoded in bounds, and every jump and entry lands on an instruction,
+// the entry of a function being its ENTER. Walking the control flow of each
+// function from its entry, the number of cells above the frame base is the
+// same on every path into an instruction and never fewer than it pops, the
+// local indexes stay below it, a function returns with its result alone on
+// its frame, and no path runs off the end of the code. What is left to run
+// time is what depends on values: the closure a CALL finds under its
+// arguments, whether a global was defined before it is read, and whether
+// the cell UCAR or UCDR finds is a pair, which they still check. Throws
+// std::runtime_error naming the offending offset
+Verified verify_bytecode(std::span<const uint8_t> code);
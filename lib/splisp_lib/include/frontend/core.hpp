@@ -1,8 +1,12 @@
 #pragma once
 
 #include "frontend/ast.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <istream>
+#include <map>
 #include <memory>
+#include <ostream>
 #include <variant>
 #include <vector>
 namespace core {
@@ -22,17 +26,34 @@ struct Var {
 struct Apply {
   std::unique_ptr<Expr> callee;
   std::vector<std::unique_ptr<Expr>> args;
+  // set by escape analysis on a cons whose pair never outlives the frame
+  bool frame_local = false;
+  // set by the typer on a builtin whose operands are proven to carry the
+  // tags it expects
+  bool unchecked = false;
+  // profile site of the call and the times it ran, see number_sites
+  uint32_t site = 0;
+  uint64_t count = 0;
 };
 
 struct Lambda {
   std::vector<std::unique_ptr<SymbolId>> formals;
   std::vector<std::unique_ptr<Expr>> body;
+  // set by escape analysis on a closure which never outlives the frame
+  bool frame_local = false;
+  // profile site of the entry and the times it was entered
+  uint32_t site = 0;
+  uint64_t count = 0;
 };
 
 struct Cond {
   std::unique_ptr<Expr> condition;
   std::unique_ptr<Expr> then;
   std::unique_ptr<Expr> otherwise;
+  // profile site of the branch to then, site + 1 is the branch to otherwise
+  uint32_t site = 0;
+  uint64_t then_count = 0;
+  uint64_t otherwise_count = 0;
 };
 
 struct Define {
@@ -66,6 +87,27 @@ void print_expr(const Expr &expr, int level);
 void print_top(const Top &top, int level);
 void print_program(const Program &program);
 
+// number of expression nodes, the measure of IR size
+std::size_t expr_size(const Expr &expr);
+std::size_t program_size(const Program &program);
+
+// what the VM counted at one profile site: how often the instruction carrying
+// it ran and, for a conditional branch, how often it jumped
+struct SiteCount {
+  uint64_t count = 0;
+  uint64_t taken = 0;
+};
+using Profile = std::map<uint32_t, SiteCount>;
+
+// numbers the calls, lambdas and conds of a freshly lowered program in
+// pre-order, so the profile of one compile matches the nodes of the next
+void number_sites(Program &program);
+// copies the counts of a profile onto the nodes carrying its sites
+void apply_profile(Program &program, const Profile &profile);
+// one "site count taken" line per site, # starts a comment
+void write_profile(std::ostream &out, const Profile &profile);
+Profile read_profile(std::istream &in);
+
 class Lowerer {
 public:
   Program &lower(const ast::AST &ast);
@@ -1,7 +1,9 @@
 #include "frontend/ast.hpp"
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <ostream>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -29,9 +31,20 @@ struct SymbolTable {
 
 class Scoper {
 public:
-  Scoper();
+  // with externs a name bound nowhere is taken to be a global some other
+  // module defines, rather than an error
+  explicit Scoper(bool externs = false);
   void run(ast::AST &ast);
   void resolve(ast::AST &ast);
+  // the id of every name bound at the top level, builtins aside
+  std::map<uint64_t, std::string> global_names() const;
+  const std::set<std::string> &extern_names() const {
+    return this->externs_;
+  }
+  // the globals an object defines, which the modules it is linked with may
+  // use and the optimizer must keep whole. None without externs, a program
+  // is all there is
+  std::set<uint64_t> exported() const;
 
 private:
   // find the current scoped symbol table
@@ -40,6 +53,8 @@ private:
   Binding search(std::string ident, size_t lowest_scope);
   SymbolTable root;
   size_t next_binding_id = 0;
+  bool externs;
+  std::set<std::string> externs_;
 };
 
 void print_symbol_table(std::ostream &os, const SymbolTable &table,
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <map>
+#include <memory>
+#include <middle/ssa.hpp>
+#include <set>
+#include <vector>
+
+// builds SSA for every function, runs SCCP, GVN and dead value elimination
+// and writes what they found back into the core tree: constant expressions,
+// branches on constants, recomputations of a value a local already holds and
+// statements nothing depends on
+class MiddleEnd {
+public:
+  void run(core::Program &program);
+
+private:
+  void collect(const ssa::Function &function);
+  // key is the expression the facts were recorded for, which differs from
+  // expr once a folded branch has been moved into its parent
+  void rewrite(core::Expr &expr, const core::Expr *key);
+  void prune(std::vector<std::unique_ptr<core::Expr>> &body);
+
+  std::map<const core::Expr *, int64_t> constants;
+  std::map<const core::Expr *, core::SymbolId> copies;
+  // true when the then branch is the one always taken
+  std::map<const core::Expr *, bool> branches;
+  std::set<const core::Expr *> dead;
+};
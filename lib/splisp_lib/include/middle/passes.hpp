@@ -0,0 +1,38 @@
+#pragma once
+
+#include <middle/ssa.hpp>
+#include <set>
+
+namespace ssa {
+
+// sparse conditional constant propagation, fills lattice and reachable; a
+// branch on a constant only makes one successor reachable
+class SCCP {
+public:
+  void run(Function &function);
+
+private:
+  Lattice evaluate(const Function &function, ValueId id) const;
+  Lattice fold(core::SymbolId builtin, int64_t lhs, int64_t rhs) const;
+};
+
+// global value numbering over the dominator tree, fills idom and leader with
+// the earliest dominating value computing the same thing
+class GVN {
+public:
+  void run(Function &function);
+
+private:
+  // every cons is a fresh pair
+  const core::SymbolId cons_id = 5;
+  // + * and eq do not care about argument order
+  const std::set<core::SymbolId> commutative = {0, 2, 10};
+};
+
+// marks values which an effect, a fault, a branch or the result depends on
+class DeadValues {
+public:
+  void run(Function &function);
+};
+
+} // namespace ssa
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+// control flow graph in SSA form, built per function (each top level form and
+// each lambda) from core IR so data flow passes can run over it; the results
+// are written back into the core tree for the generator
+namespace ssa {
+
+using ValueId = std::size_t;
+using BlockId = std::size_t;
+
+enum class Op {
+  CONST,   // an integer literal
+  PARAM,   // a formal, or a capture which is never set!
+  COPY,    // a read of a local, the one arg is the value it holds
+  READ,    // any other value the function cannot see through (globals,
+           // mutable captures, closures, nil)
+  BUILTIN, // a primitive applied to its args
+  PHI,     // one arg per predecessor of its block
+  CALL,    // a call of a closure, may do anything
+  EFFECT,  // a store the function cannot drop (set! of a global or capture)
+};
+
+struct Value {
+  Op op = Op::CONST;
+  BlockId block = 0;
+  int64_t constant = 0;
+  core::SymbolId builtin = 0;
+  std::vector<ValueId> args{};
+};
+
+struct Block {
+  std::vector<ValueId> values;
+  std::vector<BlockId> preds;
+  // none for the exit, one for a jump, then and else for a branch
+  std::vector<BlockId> succs;
+  std::optional<ValueId> condition;
+};
+
+// result of constant propagation for one value
+struct Lattice {
+  enum Kind { TOP, CONST, BOTTOM } kind = TOP;
+  int64_t value = 0;
+};
+
+struct Function {
+  std::vector<Value> values;
+  std::vector<Block> blocks;
+  ValueId result = 0;
+
+  // the value each core expression evaluates to, the values its lowering
+  // created and, for builtins, the locals in scope with the value they hold
+  std::map<const core::Expr *, ValueId> value_of;
+  std::map<const core::Expr *, std::pair<ValueId, ValueId>> range_of;
+  std::map<const core::Expr *, std::vector<std::pair<core::SymbolId, ValueId>>>
+      names_at;
+
+  // filled in by the passes
+  std::vector<Lattice> lattice;
+  std::vector<bool> reachable;
+  std::vector<BlockId> idom;
+  std::vector<ValueId> leader;
+  std::vector<bool> live;
+};
+
+// / and % fault on a zero divisor and + - * on a closure, so they are never
+// dropped unless their operands are known to be numbers
+bool may_fault(const Function &function, const Value &value);
+bool has_effect(const Value &value);
+
+class Builder {
+public:
+  std::vector<Function> build(core::Program &program);
+
+private:
+  // per function under construction, lambdas nest
+  struct State {
+    Function function;
+    BlockId current = 0;
+    std::size_t index = 0;
+    std::map<core::SymbolId, ValueId> env;
+    std::map<core::SymbolId, ValueId> params;
+  };
+
+  void scan(const core::Expr &expr, std::size_t function);
+  void begin(std::size_t index);
+  void finish(ValueId result);
+  ValueId emit(Value value);
+  BlockId new_block();
+  void link(BlockId from, BlockId to);
+  bool tracked(core::SymbolId id) const;
+
+  ValueId lower(core::Expr &expr);
+  ValueId lower_body(std::vector<std::unique_ptr<core::Expr>> &body);
+  ValueId lower_var(const core::Var &var);
+  ValueId lower_set(core::Set &set);
+  ValueId lower_apply(core::Apply &apply);
+  ValueId lower_cond(core::Cond &cond);
+  ValueId lower_lambda(core::Lambda &lambda);
+
+  std::vector<State> states;
+  std::vector<Function> functions;
+
+  // the non-let lambda (0 is the top level) each local belongs to, locals
+  // used from another one, and those set! at all or from another one
+  std::map<core::SymbolId, std::size_t> owner;
+  std::map<const core::Lambda *, std::size_t> lambda_index;
+  std::size_t lambdas = 0;
+  std::set<core::SymbolId> captured;
+  std::set<core::SymbolId> assigned;
+  std::set<core::SymbolId> remote_assigned;
+
+  const core::SymbolId builtin_count = 15;
+  const core::SymbolId nil_id = 8;
+  // car, cdr and null? take one argument, every other builtin two
+  const std::set<core::SymbolId> unary = {6, 7, 9};
+};
+
+} // namespace ssa
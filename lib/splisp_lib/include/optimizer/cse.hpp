@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <frontend/core.hpp>
+#include <memory>
+#include <set>
+#include <vector>
+
+// common subexpression elimination for builtin applications over locals and
+// constants: when the same application is evaluated again before any of its
+// operands can change, the first evaluation is bound to a let temporary in
+// the current frame and the later ones read that instead
+class CSE {
+public:
+  void run(core::Program &program);
+
+private:
+  // the state threaded through a walk in evaluation order looking for (or
+  // replacing) occurrences of target
+  struct Walk {
+    const core::Expr *target = nullptr;
+    std::set<core::SymbolId> operands;
+    // false once an operand may have changed, nothing after is an occurrence
+    bool valid = true;
+    // false within a branch which may not be taken
+    bool must = true;
+    // false once anything with an effect was evaluated
+    bool pure = true;
+    size_t count = 0;
+    // the first occurrence is always evaluated and only pure code runs
+    // before it, so it may be evaluated ahead of the statement instead
+    bool hoistable = false;
+    // when set, occurrences are replaced by a read of it
+    const core::SymbolId *temp = nullptr;
+  };
+
+  void visit(core::Expr &expr, const std::set<core::SymbolId> &scope);
+  void visit_body(std::vector<std::unique_ptr<core::Expr>> &body,
+                  const std::set<core::SymbolId> &scope);
+  // binds one profitable common subexpression of the body, false if none
+  bool eliminate(std::vector<std::unique_ptr<core::Expr>> &body,
+                 const std::set<core::SymbolId> &scope);
+  void candidates(const core::Expr &expr, const std::set<core::SymbolId> &scope,
+                  std::vector<const core::Expr *> &found) const;
+  void walk(core::Expr &expr, Walk &state) const;
+  bool candidate(const core::Expr &expr,
+                 const std::set<core::SymbolId> &scope) const;
+  bool is_builtin(const core::Expr &callee) const;
+
+  std::set<core::SymbolId> assigned;
+  core::SymbolId next_id = 0;
+
+  // every builtin but cons, whose result is a new pair each time
+  const std::set<core::SymbolId> builtins = {0, 1,  2,  3,  4,  6, 7,
+                                             9, 10, 11, 12, 13, 14};
+  const core::SymbolId cons_id = 5;
+};
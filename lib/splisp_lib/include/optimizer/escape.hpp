@@ -0,0 +1,26 @@
+#pragma once
+
+#include <frontend/core.hpp>
+#include <set>
+
+// marks closures and cons cells whose value never outlives the frame that
+// creates them, the generator allocates those in the frame heap
+class EscapeAnalyzer {
+public:
+  void run(core::Program &program);
+
+private:
+  // how a let bound variable may be used without escaping
+  enum Use { CALLEE, PAIR };
+
+  void visit(core::Expr &expr);
+  // true when every reference to id within expr is of the given use and
+  // happens in the current frame
+  bool contained(const core::Expr &expr, core::SymbolId id, Use use,
+                 bool in_closure) const;
+  bool is_cons(const core::Expr &expr) const;
+
+  const core::SymbolId cons_id = 5;
+  // car, cdr and null? look at a pair without keeping it
+  const std::set<core::SymbolId> pair_readers = {6, 7, 9};
+};
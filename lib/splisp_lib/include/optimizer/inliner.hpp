@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <map>
+#include <set>
+
+// profile guided inlining: a call the profile saw at least a tenth as often
+// as the hottest call, of a small global function bound once and never set!
+// or called from its own body, becomes a let binding the arguments to a
+// renamed copy of the function. Without profile counts no call is hot
+class Inliner {
+public:
+  void run(core::Program &program);
+
+private:
+  void visit(core::Expr &expr);
+  // a copy of the expression with every id it binds renamed to a fresh one
+  core::Expr copy(const core::Expr &expr,
+                  std::map<core::SymbolId, core::SymbolId> &renamed);
+
+  // the functions which may be inlined, copied before any call is replaced
+  std::map<core::SymbolId, core::Expr> functions;
+  uint64_t threshold = 0;
+  core::SymbolId next_id = 0;
+
+  // callees of more core nodes than this stay calls
+  static constexpr std::size_t max_size = 32;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <frontend/core.hpp>
+#include <map>
+#include <set>
+#include <vector>
+
+// the parser turns (letrec ((f_i lambda_i)*) body) into a let of Undef
+// placeholders which are then set!, so every binding costs a placeholder, a
+// store through a shared cell and a closure capturing it. When the names of
+// such a group are only ever called, its lambdas are lifted into hidden
+// global functions instead: the free locals of the group become leading
+// formals and every call passes them along. Groups whose names escape, or
+// whose free locals are set!, keep the set! form
+class LetrecFixer {
+public:
+  void run(core::Program &program);
+
+private:
+  void visit(core::Expr &expr);
+  bool fix(core::Expr &expr);
+  // rewrites calls of the group into calls of the lifted functions and
+  // renames free locals through subst
+  void rewrite(core::Expr &expr,
+               const std::map<core::SymbolId, core::SymbolId> &subst,
+               const std::map<core::SymbolId, core::SymbolId> &group,
+               const std::vector<core::SymbolId> &free) const;
+
+  // every id bound by a lambda or let, and every one of those set!
+  std::set<core::SymbolId> locals;
+  std::set<core::SymbolId> assigned;
+  core::SymbolId next_id = 0;
+  std::vector<core::Define> lifted;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <backend/isa/isa.hpp>
+#include <cstddef>
+#include <frontend/core.hpp>
+#include <functional>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+enum class OptLevel { O0, O1, O2 };
+
+// parses -O0, -O1 and -O2
+std::optional<OptLevel> parse_opt_level(const std::string &flag);
+
+// what one pass cost and did, core passes leave the bytecode sizes at 0 and
+// bytecode passes leave the IR sizes at the final IR size
+struct PassReport {
+  std::string name;
+  double millis = 0;
+  std::size_t ir_before = 0;
+  std::size_t ir_after = 0;
+  std::size_t bytecode_before = 0;
+  std::size_t bytecode_after = 0;
+};
+
+// runs the registered core IR passes in order, generates bytecode, then runs
+// the registered bytecode passes over it
+class PassManager {
+public:
+  using CorePass = std::function<void(core::Program &)>;
+  using BytecodePass = std::function<void(std::vector<ISA::Instruction> &)>;
+
+  // the standard pipeline for a level, -O0 only generates code. A profile
+  // from an earlier run is copied onto the IR first and drives inlining and
+  // the layout of branches and functions. The exported globals of a module
+  // compiled on its own are used by code the passes cannot see
+  static PassManager pipeline(OptLevel level,
+                              const core::Profile *profile = nullptr,
+                              const std::set<core::SymbolId> &exported = {});
+
+  void add_core(std::string name, CorePass pass);
+  void add_bytecode(std::string name, BytecodePass pass);
+  // numbers the profile sites of the program before the first pass
+  std::vector<ISA::Instruction> run(core::Program &program);
+  // only the core passes, for a backend other than the stack Generator
+  void run_core(core::Program &program);
+
+  const std::vector<PassReport> &reports() const { return this->reports_; }
+  void print_reports() const;
+  // the symbol id of each global slot in the bytecode of the last run
+  const std::vector<core::SymbolId> &global_ids() const {
+    return this->global_ids_;
+  }
+  // Generator::halt_depth of the last run, which the bytecode passes keep
+  size_t halt_depth() const { return this->halt_depth_; }
+
+private:
+  std::vector<std::pair<std::string, CorePass>> core_passes;
+  std::vector<std::pair<std::string, BytecodePass>> bytecode_passes;
+  std::vector<PassReport> reports_;
+  std::vector<core::SymbolId> global_ids_;
+  size_t halt_depth_ = 0;
+};
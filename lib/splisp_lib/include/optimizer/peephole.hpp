@@ -0,0 +1,43 @@
+#pragma once
+
+#include <backend/isa/isa.hpp>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// rewrites short instruction sequences the generator emits into compound
+// opcodes: an immediate add, a comparison feeding CJMP or CJMPZ into a fused
+// branch and the NROT, DROP, RET epilogue into RETN. Jumps to a JMP are
+// threaded to its destination and a JMP to a return becomes the return
+// itself, and the dead code after a tail call is dropped. Every address
+// operand is relocated as instructions are removed
+class Peephole {
+public:
+  void run(std::vector<ISA::Instruction> &code);
+
+private:
+  // one rewrite sweep each, true when anything changed
+  bool fuse(std::vector<ISA::Instruction> &code) const;
+  bool thread(std::vector<ISA::Instruction> &code) const;
+  bool prune(std::vector<ISA::Instruction> &code) const;
+  static bool is_branch(ISA::Operation op);
+  static bool is_tail_call(ISA::Operation op);
+
+  const std::map<ISA::Operation, ISA::Operation> fused_branches = {
+      {ISA::Operation::LT, ISA::Operation::JLT},
+      {ISA::Operation::LE, ISA::Operation::JLE},
+      {ISA::Operation::EQ, ISA::Operation::JEQ},
+      {ISA::Operation::GE, ISA::Operation::JGE},
+      {ISA::Operation::GT, ISA::Operation::JGT},
+      {ISA::Operation::ISNULL, ISA::Operation::JNULL},
+  };
+  // the same comparisons feeding CJMPZ, which jumps when they fail
+  const std::map<ISA::Operation, ISA::Operation> negated_branches = {
+      {ISA::Operation::LT, ISA::Operation::JGE},
+      {ISA::Operation::LE, ISA::Operation::JGT},
+      {ISA::Operation::EQ, ISA::Operation::JNE},
+      {ISA::Operation::GE, ISA::Operation::JLT},
+      {ISA::Operation::GT, ISA::Operation::JLE},
+      {ISA::Operation::ISNULL, ISA::Operation::JNNULL},
+  };
+};
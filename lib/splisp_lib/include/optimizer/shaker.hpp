@@ -0,0 +1,29 @@
+#pragma once
+
+#include <frontend/core.hpp>
+#include <set>
+#include <utility>
+
+// removes top level defines which no root can reach and side effect free
+// statements whose value is dropped in a body. Exported defines are roots
+class Shaker {
+public:
+  explicit Shaker(std::set<core::SymbolId> exported = {})
+      : exported(std::move(exported)) {}
+  void run(core::Program &program);
+
+private:
+  std::set<core::SymbolId> exported;
+  // collect every symbol referenced (read or set!) within the expression
+  void collect(const core::Expr &expr, std::set<core::SymbolId> &refs) const;
+  bool is_pure(const core::Expr &expr) const;
+  void prune(core::Expr &expr);
+
+  // builtins which cannot fault whatever their operands
+  const std::set<core::SymbolId> pure_builtins = {5,  6,  7,  8,  9,
+                                                  10, 11, 12, 13, 14};
+  // + - * fault on a closure, so they are pure only on constants or on
+  // operands the typer proved are integers. / and % are left out for
+  // division by zero
+  const std::set<core::SymbolId> arithmetic = {0, 1, 2};
+};
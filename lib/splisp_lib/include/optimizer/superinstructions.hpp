@@ -0,0 +1,50 @@
+#pragma once
+
+#include <backend/isa/isa.hpp>
+#include <cstddef>
+#include <optional>
+#include <set>
+#include <vector>
+
+// fuses the opcode runs that dominate the profile of our workloads (see
+// --profile-ops) into superinstructions:
+//   GETLOCAL a; GETLOCAL b; ADD  -> ADDLL a b
+//   GETLOCAL a; ADDI k           -> ADDLI a k
+//   GETLOCAL a; CAR|CDR          -> LOCALCAR a, LOCALCDR a
+//   GETLOCAL a; GETLOCAL b       -> GETLOCAL2 a b
+//   LOADGLOBAL g; <args>; CALL n -> <args>; CALLGLOBAL g n
+// b is read as the second GETLOCAL reads it, so it may be the slot the copy
+// of a has just taken, as in the body of a let binding a parameter
+// runs after the peephole pass, whose ADDI it builds on
+class Superinstructions {
+public:
+  void run(std::vector<ISA::Instruction> &code) const;
+
+private:
+  // the CALL fed by the LOADGLOBAL at i, when the arguments between them
+  // are straight-line code which neither calls nor touches the frame layout
+  std::optional<size_t> global_call(const std::vector<ISA::Instruction> &code,
+                                    size_t i,
+                                    const std::set<size_t> &targets) const;
+
+  // what may run between the LOADGLOBAL and the CALL: no calls or stores
+  // which could change the global, and nothing that pushes a let binding or
+  // captures the frame, as those address cells by their depth
+  const std::set<ISA::Operation> argument_ops = {
+      ISA::Operation::ADD,       ISA::Operation::SUB,
+      ISA::Operation::MUL,       ISA::Operation::DIV,
+      ISA::Operation::MOD,       ISA::Operation::INC,
+      ISA::Operation::DEC,       ISA::Operation::ADDI,
+      ISA::Operation::UADD,      ISA::Operation::USUB,
+      ISA::Operation::UMUL,      ISA::Operation::UDIV,
+      ISA::Operation::UMOD,      ISA::Operation::LT,
+      ISA::Operation::LE,        ISA::Operation::EQ,
+      ISA::Operation::GE,        ISA::Operation::GT,
+      ISA::Operation::PUSH,      ISA::Operation::LOADGLOBAL,
+      ISA::Operation::GETLOCAL,  ISA::Operation::CONS,
+      ISA::Operation::LOCALCONS, ISA::Operation::CAR,
+      ISA::Operation::CDR,       ISA::Operation::UCAR,
+      ISA::Operation::UCDR,      ISA::Operation::PUSHNIL,
+      ISA::Operation::ISNULL,
+  };
+};
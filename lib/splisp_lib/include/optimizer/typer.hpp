@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <frontend/core.hpp>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+// infers the tag of the values flowing into arithmetic and list builtins,
+// applications whose operands are proven are marked unchecked so the
+// generator can drop the runtime tag tests. Exported globals may be called
+// from other modules, so nothing is assumed about their arguments
+class Typer {
+public:
+  explicit Typer(std::set<core::SymbolId> exported = {})
+      : escaping(std::move(exported)) {}
+  void run(core::Program &program);
+
+private:
+  // NONE is no value seen yet (unreachable code), UNKNOWN is any value
+  enum Type { NONE, INT, PAIR, CLOSURE, NIL, UNKNOWN };
+  using Env = std::map<core::SymbolId, Type>;
+
+  static Type join(Type a, Type b);
+  void scan(const core::Expr &expr, size_t function);
+  void pass(core::Program &program);
+  Type infer(core::Expr &expr, Env &env);
+  Type infer_body(std::vector<std::unique_ptr<core::Expr>> &body, Env &env);
+  Type infer_builtin(core::Apply &apply, const std::vector<Type> &args);
+
+  // the non-let lambda (0 is the top level) each local belongs to
+  std::map<core::SymbolId, size_t> owner;
+  size_t functions = 0;
+  // locals set! anywhere, and those set! from a closure other than their own
+  std::set<core::SymbolId> assigned;
+  std::set<core::SymbolId> remote_assigned;
+
+  // globals defined once and never set! keep the type of their definition
+  std::map<core::SymbolId, size_t> definitions;
+  std::map<core::SymbolId, Type> globals;
+  // such globals bound to a lambda and only ever called, the types of their
+  // formals and result are joined over every call site until a fixed point
+  std::map<core::SymbolId, core::Lambda *> known;
+  std::set<core::SymbolId> escaping;
+  std::map<const core::Lambda *, core::SymbolId> known_lambdas;
+  std::map<core::SymbolId, std::vector<Type>> params;
+  std::map<core::SymbolId, Type> results;
+  // marks are only written once that fixed point is reached
+  bool mark = false;
+  bool changed = false;
+
+  const core::SymbolId nil_id = 8;
+  const std::set<core::SymbolId> arithmetic = {0, 1, 2, 3, 4};
+  // eq, null? and the comparisons always produce an integer
+  const std::set<core::SymbolId> predicates = {9, 10, 11, 12, 13, 14};
+  const core::SymbolId cons_id = 5;
+  const std::set<core::SymbolId> accessors = {6, 7};
+  const core::SymbolId builtin_count = 15;
+};
@@ -0,0 +1,86 @@
+#include <backend/aot/aot.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace {
+
+bool is_branch(ISA::Operation op) {
+  return ISA::is_address(op) && op != ISA::Operation::MKCLOSURE &&
+         op != ISA::Operation::MKLOCALCLOSURE &&
+         op != ISA::Operation::CALLDIRECT &&
+         op != ISA::Operation::TAILCALLDIRECT;
+}
+
+} // namespace
+
+void AOT::emit(std::ostream &out, const std::vector<ISA::Instruction> &code) {
+  const auto encoded = ISA::encode(code);
+  const auto &bytes = encoded.bytes;
+  // offsets ends with the end of the code, which a jump may target too
+  const auto starts = std::span(encoded.offsets).first(code.size());
+  const auto end = encoded.offsets.back();
+
+  out << "// compiled ahead of time by splisp_lang, see backend/aot/aot.hpp\n"
+      << "#include <backend/vm/stack.hpp>\n"
+      << "#include <iostream>\n"
+      << "#include <optional>\n"
+      << "#include <vector>\n\n"
+      << "namespace {\n\n"
+      << "const std::vector<ISA::Instruction> code = {\n";
+  for (const auto &instr : code) {
+    const auto op = static_cast<unsigned>(instr.op);
+    out << "    {static_cast<ISA::Operation>(" << op << "), ";
+    if (instr.operand)
+      out << *instr.operand << "U";
+    else
+      out << "std::nullopt";
+    out << "}, // " << ISA::spec_list[op].mnemonic << "\n";
+  }
+  out << "};\n\n";
+
+  out << "MachineState run(Stack &vm) {\n"
+      << "dispatch:\n"
+      << "  switch (vm.position()) {\n";
+  for (auto at : starts)
+    out << "  case " << at << ": goto L" << at << ";\n";
+  out << "  case " << end << ": goto L" << end << ";\n";
+  // a position which is not an instruction is an error, not a halt
+  out << "  default:\n"
+      << "    return MachineState::INVALID_OP;\n"
+      << "  }\n";
+  for (auto at : starts) {
+    const auto instr = ISA::decode(bytes.data(), at);
+    const auto op = static_cast<unsigned>(instr.op);
+    out << "L" << at << ": // " << ISA::spec_list[op].mnemonic << "\n"
+        << "  if (!vm.step(" << op << ", " << instr.operand << "U, " << at
+        << ", " << instr.next << "))\n"
+        << "    return vm.state();\n";
+    if (instr.op == ISA::Operation::JMP) {
+      out << "  goto L" << instr.operand << ";\n";
+    } else if (is_branch(instr.op)) {
+      out << "  if (vm.position() != " << at << ")\n"
+          << "    goto L" << instr.operand << ";\n";
+    } else {
+      // a call or a return, or the rare op that moves pc otherwise
+      out << "  if (vm.position() != " << at << ")\n"
+          << "    goto dispatch;\n";
+    }
+  }
+  out << "L" << end << ":\n"
+      << "  return MachineState::HALT;\n"
+      << "}\n\n"
+      << "} // namespace\n\n"
+      << "std::vector<ISA::Instruction> splisp_program() { return code; }\n"
+      << "MachineState splisp_run(Stack &vm) { return vm.run_compiled(run); "
+         "}\n\n"
+      << "#ifndef SPLISP_NO_MAIN\n"
+      << "int main() {\n"
+      << "  Stack vm(code);\n"
+      << "  const auto state = vm.run_compiled(run);\n"
+      << "  if (state == MachineState::HALT && vm.result())\n"
+      << "    std::cout << vm.result()->value << std::endl;\n"
+      << "  return state == MachineState::HALT ? 0 : 1;\n"
+      << "}\n"
+      << "#endif\n";
+}
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <backend/generator/generator.hpp>
 #include <backend/isa/isa.hpp>
 #include <cstdint>
@@ -6,8 +7,12 @@
 #include <frontend/ast.hpp>
 #include <frontend/core.hpp>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <optional>
+#include <set>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <variant>
 
@@ -16,7 +21,7 @@ using ISA::Instruction;
 void print_bytecode(const std::vector<ISA::Instruction> &bytecode) {
   for (size_t i = 0; i < bytecode.size(); i++) {
     const auto &spec = ISA::spec_list[static_cast<uint8_t>(bytecode[i].op)];
-    std::cerr << "[" << i * 9 << "] " << spec.mnemonic;
+    std::cerr << "[" << i << "] " << spec.mnemonic;
     if (bytecode[i].operand.has_value()) {
       std::cerr << " " << bytecode[i].operand.value();
     }
@@ -25,19 +30,418 @@ void print_bytecode(const std::vector<ISA::Instruction> &bytecode) {
 }
 
 std::vector<ISA::Instruction> Generator::generate() {
+  // MKCLOSURE  #prologue, one closure per lifted lambda
+  // MKGLOBAL
+  // emit<top>*
+  // HALT
+  // <cold branch>* #of the top level
+  // <closure code>* #every lambda body, the most entered first
+  collect_lifted();
+  std::vector<Fragment> fragments;
+  fragments.reserve(this->program.size() + this->lifted.size() + 2);
+  auto &prologue = fragments.emplace_back(*this, 0);
+  for (auto &[lambda, id] : this->lifted) {
+    prologue.entry_refs.emplace_back(prologue.bytecode.size(), lambda);
+    prologue.add_instruction(ISA::Operation::MKCLOSURE, std::nullopt);
+    prologue.add_instruction(ISA::Operation::MKGLOBAL, id);
+  }
+  prologue.end_in_line();
+  // a define leaves nothing on the stack and an expression its value, so
+  // where each form starts is known before any is emitted
+  size_t depth = 0;
   for (auto &top : this->program) {
-    emit_top(top);
+    fragments.emplace_back(*this, depth);
+    depth += std::holds_alternative<core::Expr>(top) ? 1 : 0;
+  }
+  this->halt_depth_ = depth;
+  auto &halt = fragments.emplace_back(*this, depth);
+  halt.add_instruction(ISA::Operation::HALT, std::nullopt);
+  halt.end_in_line();
+  // the most entered functions first, so the hot ones sit together
+  std::vector<size_t> order(this->lifted.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return this->lifted[a].first->count > this->lifted[b].first->count;
+  });
+  std::vector<const core::Lambda *> closures;
+  for (auto i : order) {
+    closures.push_back(this->lifted[i].first);
+    fragments.emplace_back(*this, 0);
+  }
+
+  // each job fills one fragment, the forms and the closures share nothing
+  // but what collect_lifted found
+  const auto tops = this->program.size();
+  auto job = [&](size_t i) {
+    if (i < tops) {
+      auto &fragment = fragments[i + 1];
+      fragment.emit_top(this->program[i]);
+      fragment.end_in_line();
+      fragment.emit_cold();
+      fragment.emit_bodies();
+    } else {
+      // closed lambdas capture nothing, their frame is just the formals
+      auto &fragment = fragments[i + 2];
+      fragment.end_in_line();
+      fragment.emit_body(*closures[i - tops]);
+      fragment.emit_bodies();
+    }
+  };
+  const auto jobs = tops + closures.size();
+  // a thread is only worth starting for a good number of forms
+  constexpr size_t jobs_per_thread = 32;
+  size_t workers = this->threads;
+  if (workers == 0)
+    workers = std::max(1U, std::thread::hardware_concurrency());
+  workers = std::min(workers, (jobs + jobs_per_thread - 1) / jobs_per_thread);
+  std::atomic<size_t> next = 0;
+  std::vector<std::exception_ptr> errors(jobs);
+  auto work = [&] {
+    for (size_t i; (i = next.fetch_add(1)) < jobs;) {
+      try {
+        job(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+  {
+    std::vector<std::jthread> pool;
+    for (size_t i = 1; i < workers; i++)
+      pool.emplace_back(work);
+    work();
   }
-  add_instruction(ISA::Operation::HALT, std::nullopt);
+  for (auto &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  link(fragments, closures);
   return this->bytecode;
 }
 
-void Generator::add_instruction(ISA::Operation op,
-                                std::optional<uint64_t> operand) {
-  this->bytecode.push_back(ISA::Instruction{op, operand});
+void Generator::link(std::vector<Fragment> &fragments,
+                     const std::vector<const core::Lambda *> &closures) {
+  // in line go the prologue, each form and the HALT, then the cold branches
+  // of the forms, then the function section: every body, the most entered
+  // first
+  std::vector<size_t> hot_base(fragments.size());
+  std::vector<size_t> cold_base(fragments.size());
+  std::vector<std::vector<size_t>> body_base(fragments.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < fragments.size(); i++) {
+    hot_base[i] = offset;
+    offset += fragments[i].out_of_line;
+  }
+  std::vector<std::pair<size_t, size_t>> bodies;
+  for (size_t i = 0; i < fragments.size(); i++) {
+    const auto &fragment = fragments[i];
+    const auto cold_end = fragment.bodies.empty()
+                              ? fragment.bytecode.size()
+                              : fragment.bodies.front().start;
+    cold_base[i] = offset;
+    offset += cold_end - fragment.out_of_line - 1;
+    body_base[i].resize(fragment.bodies.size());
+    for (size_t k = 0; k < fragment.bodies.size(); k++)
+      bodies.emplace_back(i, k);
+  }
+  std::stable_sort(bodies.begin(), bodies.end(), [&](auto a, auto b) {
+    return fragments[a.first].bodies[a.second].count >
+           fragments[b.first].bodies[b.second].count;
+  });
+  for (auto [i, k] : bodies) {
+    const auto &fragment = fragments[i];
+    const auto end = k + 1 < fragment.bodies.size()
+                         ? fragment.bodies[k + 1].start
+                         : fragment.bytecode.size();
+    body_base[i][k] = offset;
+    offset += end - fragment.bodies[k].start;
+  }
+  // the end of the in line code is where the next fragment starts
+  auto place = [&](size_t i, uint64_t index) -> uint64_t {
+    const auto &fragment = fragments[i];
+    if (index <= fragment.out_of_line)
+      return hot_base[i] + index;
+    auto it = std::upper_bound(
+        fragment.bodies.begin(), fragment.bodies.end(), index,
+        [](uint64_t index, const auto &body) { return index < body.start; });
+    if (it == fragment.bodies.begin())
+      return cold_base[i] + index - fragment.out_of_line - 1;
+    const auto k = it - fragment.bodies.begin() - 1;
+    return body_base[i][k] + index - fragment.bodies[k].start;
+  };
+  // a lifted closure fragment holds nothing in line, its ENTER follows the
+  // placeholder
+  std::map<const core::Lambda *, uint64_t> entries;
+  const auto first_closure = fragments.size() - closures.size();
+  for (size_t i = 0; i < closures.size(); i++)
+    entries[closures[i]] = place(first_closure + i, 1);
+
+  this->bytecode.assign(offset, ISA::Instruction{});
+  for (size_t i = 0; i < fragments.size(); i++) {
+    auto &fragment = fragments[i];
+    for (size_t j = 0; j < fragment.bytecode.size(); j++) {
+      if (j == fragment.out_of_line)
+        continue;
+      auto &instr = this->bytecode[place(i, j)];
+      instr = fragment.bytecode[j];
+      if (ISA::is_address(instr.op) && instr.operand)
+        instr.operand = place(i, *instr.operand);
+    }
+    for (auto &[index, lambda] : fragment.entry_refs)
+      this->bytecode[place(i, index)].operand = entries.at(lambda);
+  }
+  for (auto &instr : this->bytecode) {
+    if (instr.op == ISA::Operation::MKGLOBAL ||
+        instr.op == ISA::Operation::LOADGLOBAL ||
+        instr.op == ISA::Operation::MUTGLOBAL)
+      instr.operand = global_slot(*instr.operand);
+  }
+}
+
+namespace {
+
+// formals bound and symbols set! anywhere within the expression, and the
+// largest symbol id it mentions
+void scan_symbols(const core::Expr &expr, std::set<core::SymbolId> &formals,
+                  std::set<core::SymbolId> &assigned, core::SymbolId &max_id) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          max_id = std::max(max_id, node.id);
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          if constexpr (std::is_same_v<T, core::Set>) {
+            assigned.insert(node.name);
+          }
+          max_id = std::max(max_id, node.name);
+          scan_symbols(*node.rhs, formals, assigned, max_id);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &formal : node.formals) {
+            formals.insert(*formal);
+            max_id = std::max(max_id, *formal);
+          }
+          for (auto &stmt : node.body)
+            scan_symbols(*stmt, formals, assigned, max_id);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          scan_symbols(*node.callee, formals, assigned, max_id);
+          for (auto &arg : node.args)
+            scan_symbols(*arg, formals, assigned, max_id);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          scan_symbols(*node.condition, formals, assigned, max_id);
+          scan_symbols(*node.then, formals, assigned, max_id);
+          scan_symbols(*node.otherwise, formals, assigned, max_id);
+        }
+      },
+      expr.node);
+}
+
+} // namespace
+
+void Generator::collect_lifted() {
+  // a lambda is closed when every local it references is bound within it,
+  // scoper ids are unique so the formals of the whole program are the locals
+  std::set<core::SymbolId> locals;
+  std::set<core::SymbolId> assigned;
+  std::map<core::SymbolId, size_t> define_count;
+  core::SymbolId max_id = 0;
+  for (auto &top : this->program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      max_id = std::max(max_id, def->name);
+      define_count[def->name]++;
+      if (def->name >= this->global_symbols.size())
+        this->global_symbols.resize(def->name + 1);
+      this->global_symbols[def->name] = true;
+      scan_symbols(*def->rhs, locals, assigned, max_id);
+    } else {
+      scan_symbols(std::get<core::Expr>(top), locals, assigned, max_id);
+    }
+  }
+  auto next_id = max_id + 1;
+
+  // a global bound once to a lambda and never set! always holds the same
+  // closure, it is lifted under its own id and called directly by entry
+  for (auto &top : this->program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      auto *lam = std::get_if<core::Lambda>(&def->rhs->node);
+      if (lam && define_count[def->name] == 1 &&
+          !assigned.contains(def->name)) {
+        this->lifted.emplace_back(lam, def->name);
+        this->lifted_ids[lam] = def->name;
+        this->direct[def->name] = lam;
+      }
+    }
+  }
+
+  // closures created at the top level run once, only the ones nested in
+  // another lambda are worth lifting. Lambdas are numbered in pre-order and
+  // each local takes the number of the one binding it, so a lambda is closed
+  // when no local it references has a number below its own. The walk returns
+  // the least such number in the expression, keeping it linear however deep
+  // the nesting
+  constexpr auto unbound = std::numeric_limits<size_t>::max();
+  std::vector<size_t> binder(next_id, unbound);
+  size_t counter = 0;
+  auto bind = [&](const core::Lambda &lambda) {
+    const auto number = counter++;
+    for (auto &formal : lambda.formals)
+      binder[*formal] = number;
+    return number;
+  };
+  auto visit = [&](auto &&self, const core::Expr &expr,
+                   bool in_lambda) -> size_t {
+    return std::visit(
+        [&](const auto &node) -> size_t {
+          using T = std::decay_t<decltype(node)>;
+          if constexpr (std::is_same_v<T, core::Var>) {
+            return binder[node.id];
+          } else if constexpr (std::is_same_v<T, core::Lambda>) {
+            const auto number = bind(node);
+            auto least = unbound;
+            for (auto &stmt : node.body)
+              least = std::min(least, self(self, *stmt, true));
+            if (in_lambda && !this->lifted_ids.contains(&node) &&
+                least >= number) {
+              this->lifted.emplace_back(&node, next_id);
+              this->lifted_ids[&node] = next_id++;
+            }
+            return least;
+          } else if constexpr (std::is_same_v<T, core::Apply>) {
+            auto least = unbound;
+            // the body of a let is emitted inline, not as a closure
+            auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+            if (lam && lam->formals.size() == node.args.size()) {
+              bind(*lam);
+              for (auto &stmt : lam->body)
+                least = std::min(least, self(self, *stmt, in_lambda));
+            } else {
+              least = self(self, *node.callee, in_lambda);
+            }
+            for (auto &arg : node.args)
+              least = std::min(least, self(self, *arg, in_lambda));
+            return least;
+          } else if constexpr (std::is_same_v<T, core::Cond>) {
+            return std::min({self(self, *node.condition, in_lambda),
+                             self(self, *node.then, in_lambda),
+                             self(self, *node.otherwise, in_lambda)});
+          } else if constexpr (std::is_same_v<T, core::Set>) {
+            return std::min(binder[node.name],
+                            self(self, *node.rhs, in_lambda));
+          } else if constexpr (std::is_same_v<T, core::Define>) {
+            return self(self, *node.rhs, in_lambda);
+          } else {
+            return unbound;
+          }
+        },
+        expr.node);
+  };
+  for (auto &top : this->program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      visit(visit, *def->rhs, false);
+    } else {
+      visit(visit, std::get<core::Expr>(top), false);
+    }
+  }
+}
+
+void Generator::Fragment::bind_local(core::SymbolId id, size_t slot) {
+  if (id >= this->local_symbols.size())
+    this->local_symbols.resize(id + 1);
+  this->local_symbols[id] = Local{slot, this->shift, true};
+}
+
+std::optional<size_t> Generator::Fragment::find_local(core::SymbolId id) const {
+  if (id >= this->local_symbols.size() || !this->local_symbols[id].bound)
+    return std::nullopt;
+  const auto &local = this->local_symbols[id];
+  return local.slot + this->shift - local.shift;
+}
+
+bool Generator::Fragment::is_global(core::SymbolId id) const {
+  return id < this->gen.global_symbols.size() && this->gen.global_symbols[id];
+}
+
+uint64_t Generator::global_slot(core::SymbolId id) {
+  constexpr auto unassigned = std::numeric_limits<size_t>::max();
+  if (id >= this->global_slots.size())
+    this->global_slots.resize(id + 1, unassigned);
+  if (this->global_slots[id] == unassigned) {
+    this->global_slots[id] = this->slot_ids.size();
+    this->slot_ids.push_back(id);
+  }
+  return this->global_slots[id];
+}
+
+void Generator::Fragment::add_instruction(ISA::Operation op,
+                                          std::optional<uint64_t> operand,
+                                          uint32_t site) {
+  // keep depth in step with the data stack, the operand carrying ops are
+  // special cased and everything else comes from the spec table
+  switch (op) {
+  case (ISA::Operation::DROP):
+  case (ISA::Operation::CALL):
+  case (ISA::Operation::TAILCALL): {
+    this->depth -= operand.value_or(0);
+    break;
+  }
+  default: {
+    const auto &spec = ISA::spec_list[static_cast<uint8_t>(op)];
+    this->depth = this->depth + spec.pushes - spec.pops;
+    break;
+  }
+  }
+  this->bytecode.push_back(ISA::Instruction{op, operand, site});
+}
+
+void Generator::Fragment::end_in_line() {
+  // a jump to the end of the in line code goes to whatever follows the
+  // fragment, the placeholder keeps it apart from a jump to the out of line
+  // code after it. Link leaves the placeholder out
+  this->out_of_line = this->bytecode.size();
+  this->bytecode.push_back(
+      ISA::Instruction{ISA::Operation::HALT, std::nullopt});
+}
+
+bool Generator::Fragment::ends_in_tail_call(size_t from) const {
+  if (this->bytecode.size() <= from)
+    return false;
+  switch (this->bytecode.back().op) {
+  case (ISA::Operation::TAILCALL):
+  case (ISA::Operation::TAILCALLDIRECT):
+    break;
+  default:
+    return false;
+  }
+  // a branch that returns a value may still jump to what follows
+  const auto end = this->bytecode.size();
+  for (size_t i = from; i < end; i++) {
+    if (ISA::is_address(this->bytecode[i].op) &&
+        this->bytecode[i].operand == end)
+      return false;
+  }
+  for (const auto &branch : this->cold) {
+    if (branch.join == end)
+      return false;
+  }
+  return true;
+}
+
+void Generator::Fragment::emit_cold() {
+  // a cold branch may hold conds with cold branches of their own
+  for (size_t i = 0; i < this->cold.size(); i++) {
+    const auto branch = this->cold[i];
+    this->bytecode[branch.jump].operand = this->bytecode.size();
+    this->depth = branch.depth;
+    this->shift = branch.shift;
+    const auto start = this->bytecode.size();
+    emit_expr(*branch.expr, branch.tail);
+    if (!branch.tail || !ends_in_tail_call(start))
+      add_instruction(ISA::Operation::JMP, branch.join);
+  }
+  this->cold.clear();
 }
 
-void Generator::emit_top(const core::Top &top) {
+void Generator::Fragment::emit_top(const core::Top &top) {
   std::visit(
       [this](const auto &p) {
         using T = std::decay_t<decltype(p)>;
@@ -50,39 +454,68 @@ void Generator::emit_top(const core::Top &top) {
       top);
 }
 
-void Generator::emit_cond(const core::Cond &cond) {
+void Generator::Fragment::emit_cond(const core::Cond &cond, bool tail) {
   emit_expr(*cond.condition);
+  if (cond.then_count != cond.otherwise_count) {
+    // profiled: the hot branch falls through to the join and the cold one
+    // is moved out of line, see emit_cold
+    const bool then_hot = cond.then_count > cond.otherwise_count;
+    const auto jump = this->bytecode.size();
+    if (then_hot) {
+      add_instruction(ISA::Operation::CJMPZ, std::nullopt,
+                      cond.site == 0 ? 0 : cond.site + 1);
+    } else {
+      add_instruction(ISA::Operation::CJMP, std::nullopt, cond.site);
+    }
+    this->cold.push_back(ColdBranch{
+        .expr = then_hot ? cond.otherwise.get() : cond.then.get(),
+        .tail = tail,
+        .depth = this->depth,
+        .shift = this->shift,
+        .jump = jump,
+        .join = 0});
+    const auto index = this->cold.size() - 1;
+    emit_expr(then_hot ? *cond.then : *cond.otherwise, tail);
+    this->cold[index].join = this->bytecode.size();
+    return;
+  }
   size_t cjmp_idx = this->bytecode.size();
-  add_instruction(ISA::Operation::CJMP, std::nullopt);
-  emit_expr(*cond.otherwise);
+  add_instruction(ISA::Operation::CJMP, std::nullopt, cond.site);
+  emit_expr(*cond.otherwise, tail);
+  // a branch ending in a tail call has nothing to join
+  const bool joins = !tail || !ends_in_tail_call(cjmp_idx + 1);
   size_t jmp_idx = this->bytecode.size();
-  add_instruction(ISA::Operation::JMP, std::nullopt);
-  this->bytecode[cjmp_idx].operand = this->bytecode.size() * 9;
-  emit_expr(*cond.then);
-  this->bytecode[jmp_idx].operand = this->bytecode.size() * 9;
+  if (joins)
+    add_instruction(ISA::Operation::JMP, std::nullopt);
+  this->bytecode[cjmp_idx].operand = this->bytecode.size();
+  // both branches start from the same stack height
+  this->depth--;
+  emit_expr(*cond.then, tail);
+  if (joins)
+    this->bytecode[jmp_idx].operand = this->bytecode.size();
 }
 
-void Generator::emit_expr(const core::Expr &expr) {
+void Generator::Fragment::emit_expr(const core::Expr &expr, bool tail) {
   std::visit(
-      [this](const auto &p) {
+      [this, tail](const auto &p) {
         using T = std::decay_t<decltype(p)>;
         if constexpr (std::is_same_v<T, core::Apply>) {
-          Generator::emit_apply(p);
+          Fragment::emit_apply(p, tail);
         }
         if constexpr (std::is_same_v<T, core::Lambda>) {
-          Generator::emit_lambda(p);
+          Fragment::emit_lambda(p);
         }
         if constexpr (std::is_same_v<T, core::Const>) {
-          Generator::emit_const(p);
+          Fragment::emit_const(p);
         }
         if constexpr (std::is_same_v<T, core::Cond>) {
-          Generator::emit_cond(p);
+          Fragment::emit_cond(p, tail);
         }
         if constexpr (std::is_same_v<T, core::Var>) {
-          Generator::emit_var(p);
+          Fragment::emit_var(p);
         }
         if constexpr (std::is_same_v<T, core::Set>) {
-          Generator::emit_set(p);
+          Fragment::emit_set(p);
         }
         if constexpr (std::is_same_v<T, core::Undef>) {
           add_instruction(ISA::Operation::PUSH, 0);
@@ -91,75 +524,169 @@ void Generator::emit_expr(const core::Expr &expr) {
       expr.node);
 }
 
-void Generator::emit_const(const core::Const &const_var) {
+void Generator::Fragment::emit_const(const core::Const &const_var) {
   add_instruction(ISA::Operation::PUSH, const_var.value);
 };
 
-void Generator::emit_top_define(const core::Define &def) {
-  // function which defines top level (global) defintion
-  // critically, the global symbol has to be registered before the rhs side is
-  // emitted for recrusion
-  this->global_symbols.push_back(def.name);
-  Generator::emit_expr(*def.rhs);
+void Generator::Fragment::emit_top_define(const core::Define &def) {
+  // function which defines top level (global) defintion, every one was
+  // registered by collect_lifted so the rhs may recurse
+  if (this->gen.direct.contains(def.name)) {
+    // already bound by the prologue
+    return;
+  }
+  Fragment::emit_expr(*def.rhs);
   add_instruction(ISA::Operation::MKGLOBAL, def.name);
 };
 
-void Generator::emit_lambda(const core::Lambda &lambda) {
-  // JMP        #jump to MKCLOSURE
+uint64_t Generator::Fragment::emit_closure_code(const core::Lambda &lambda) {
   // ENTER
   // emit<expr> #generate the body
   // NROT
   // DROP
   // RET
-  // MKCLOSURE  #capture frame, pointing to ENTER
-
-  // save a copy of the local symbols to be restored after this level is
-  // finished generating
-  auto saved_locals = this->local_symbols;
-  auto n = lambda.formals.size() + saved_locals.size();
-
-  // add new formals to the local variables list
-  for (size_t i = 0; i < lambda.formals.size(); i++) {
-    const auto symbol_id = *lambda.formals.at(i);
-    this->local_symbols[symbol_id] = i;
-  }
-  // in the local symbols map, change the newly captured formals (now in
-  // local_symbols) indecies to match with the inner layout
-  for (auto &[sym_id, outer_idx] : saved_locals)
-    this->local_symbols[sym_id] = lambda.formals.size() + outer_idx;
-
-  const auto jmp_idx = this->bytecode.size();
-  add_instruction(ISA::Operation::JMP, std::nullopt);
-  const auto enter_offset = this->bytecode.size() * 9;
-  add_instruction(ISA::Operation::ENTER, n);
+
+  // cold branches are emitted after the RET
+  auto saved_cold = std::move(this->cold);
+  this->cold.clear();
+  const auto saved_depth = this->depth;
+  // MKCLOSURE captures every cell of the current frame, scratch included
+  auto n = lambda.formals.size() + saved_depth;
+
+  // the formals go below the captured cells, which moves every local bound
+  // outside up by their count
+  const auto saved_shift = this->shift;
+  this->shift += lambda.formals.size();
+  for (size_t i = 0; i < lambda.formals.size(); i++)
+    bind_local(*lambda.formals.at(i), i);
+
+  const auto enter_idx = this->bytecode.size();
+  this->depth = n;
+  add_instruction(ISA::Operation::ENTER, n, lambda.site);
   for (size_t i = 0; i < lambda.body.size() - 1; i++) {
     auto &&expr = lambda.body.at(i);
-    Generator::emit_expr(*expr);
+    Fragment::emit_expr(*expr);
     add_instruction(ISA::Operation::DROP, 1);
   }
-  Generator::emit_expr(*lambda.body.back());
-  // rotate the result down to the bottom of the frame and drop the scratch
-  // variables that it calculates
-  add_instruction(ISA::Operation::NROT, n + 1);
-  add_instruction(ISA::Operation::DROP, n);
-  add_instruction(ISA::Operation::RET, std::nullopt);
-  const auto mk_offset = this->bytecode.size();
-  add_instruction(ISA::Operation::MKCLOSURE, enter_offset);
-  this->bytecode[jmp_idx].operand = mk_offset * 9;
-  // restore for when called a level up.
-  this->local_symbols = saved_locals;
+  // a call in tail position replaces this frame and never returns here
+  Fragment::emit_expr(*lambda.body.back(), true);
+  if (!ends_in_tail_call(enter_idx)) {
+    // rotate the result down to the bottom of the frame and drop the
+    // scratch variables that it calculates
+    add_instruction(ISA::Operation::NROT, n + 1);
+    add_instruction(ISA::Operation::DROP, n);
+    add_instruction(ISA::Operation::RET, std::nullopt);
+  }
+  emit_cold();
+  this->cold = std::move(saved_cold);
+  this->depth = saved_depth;
+  this->shift = saved_shift;
+  return enter_idx;
+}
+
+void Generator::Fragment::emit_lambda(const core::Lambda &lambda) {
+  // MKCLOSURE  #capture frame, pointing to the ENTER of the body, which is
+  //            #emitted out of line by emit_bodies
+  if (auto it = this->gen.lifted_ids.find(&lambda);
+      it != this->gen.lifted_ids.end()) {
+    // created once by the prologue
+    add_instruction(ISA::Operation::LOADGLOBAL, it->second);
+    return;
+  }
+  this->pending.push_back(Pending{.lambda = &lambda,
+                                  .depth = this->depth,
+                                  .shift = this->shift,
+                                  .make = this->bytecode.size()});
+  add_instruction(lambda.frame_local ? ISA::Operation::MKLOCALCLOSURE
+                                     : ISA::Operation::MKCLOSURE,
+                  std::nullopt);
 };
-void Generator::emit_apply(const core::Apply &application) {
+
+uint64_t Generator::Fragment::emit_body(const core::Lambda &lambda) {
+  this->bodies.push_back(Body{this->bytecode.size(), lambda.count});
+  return emit_closure_code(lambda);
+}
+
+void Generator::Fragment::emit_bodies() {
+  // a body may make closures of its own, emitted after it
+  for (size_t i = 0; i < this->pending.size(); i++) {
+    const auto made = this->pending[i];
+    this->depth = made.depth;
+    this->shift = made.shift;
+    this->bytecode[made.make].operand = emit_body(*made.lambda);
+  }
+  this->pending.clear();
+}
+
+void Generator::Fragment::emit_let(
+    const core::Lambda &lambda,
+    const std::vector<std::unique_ptr<core::Expr>> &args, bool tail) {
+  // ((lambda (x_i)* body) e_i*) is a let, the values are left in the current
+  // frame and the formals refer to the slots they were pushed into:
+  // emit<e_i>* #in the enclosing scope
+  // emit<body>
+  // NROT       #rotate the result under the bindings
+  // DROP
+  const auto base = this->depth;
+  const auto start = this->bytecode.size();
+  for (auto &&arg : args)
+    emit_expr(*arg);
+
+  for (size_t i = 0; i < lambda.formals.size(); i++)
+    bind_local(*lambda.formals.at(i), base + i);
+  for (size_t i = 0; i < lambda.body.size() - 1; i++) {
+    Fragment::emit_expr(*lambda.body.at(i));
+    add_instruction(ISA::Operation::DROP, 1);
+  }
+  Fragment::emit_expr(*lambda.body.back(), tail);
+  const auto n = lambda.formals.size();
+  if (tail && ends_in_tail_call(start)) {
+    // the call took the bindings with the frame, only the depth is left
+    this->depth -= n;
+  } else if (n > 0) {
+    add_instruction(ISA::Operation::NROT, n + 1);
+    add_instruction(ISA::Operation::DROP, n);
+  }
+}
+
+void Generator::Fragment::emit_apply(const core::Apply &application,
+                                     bool tail) {
   if (auto *var = std::get_if<core::Var>(&application.callee->node)) {
-    auto it = this->builtins.find(var->id);
-    if (it != this->builtins.end()) {
+    auto it = this->gen.builtins.find(var->id);
+    if (it != this->gen.builtins.end()) {
       for (auto &&arg : application.args)
         emit_expr(*arg);
+      if (it->second == ISA::Operation::CONS && application.frame_local) {
+        add_instruction(ISA::Operation::LOCALCONS, std::nullopt);
+        return;
+      }
+      if (auto u = this->gen.unchecked_builtins.find(it->second);
+          application.unchecked && u != this->gen.unchecked_builtins.end()) {
+        add_instruction(u->second, std::nullopt);
+        return;
+      }
       add_instruction(it->second, std::nullopt);
       return;
     }
+    if (auto fn = this->gen.direct.find(var->id);
+        fn != this->gen.direct.end() &&
+        fn->second->formals.size() == application.args.size()) {
+      // known function: no handle, jump straight to its ENTER
+      for (auto &&arg : application.args)
+        emit_expr(*arg);
+      this->entry_refs.emplace_back(this->bytecode.size(), fn->second);
+      add_instruction(tail ? ISA::Operation::TAILCALLDIRECT
+                           : ISA::Operation::CALLDIRECT,
+                      std::nullopt, application.site);
+      this->depth -= application.args.size();
+      return;
+    }
     emit_var(*var); // push handle, fall through to args + CALL
   } else if (auto *lam = std::get_if<core::Lambda>(&application.callee->node)) {
+    if (lam->formals.size() == application.args.size()) {
+      emit_let(*lam, application.args, tail);
+      return;
+    }
     emit_lambda(*lam);
   } else if (auto *app = std::get_if<core::Apply>(&application.callee->node)) {
     emit_apply(*app);
@@ -168,35 +695,39 @@ void Generator::emit_apply(const core::Apply &application) {
   }
   for (auto &&arg : application.args)
     emit_expr(*arg);
-  add_instruction(ISA::Operation::CALL, application.args.size());
+  add_instruction(tail ? ISA::Operation::TAILCALL : ISA::Operation::CALL,
+                  application.args.size(), application.site);
 };
-void Generator::emit_var(const core::Var &variable) {
+void Generator::Fragment::emit_var(const core::Var &variable) {
   // constant builtins (nil etc.) emit a single opcode with no operand
-  if (auto it = this->const_builtins.find(variable.id);
-      it != this->const_builtins.end()) {
+  if (auto it = this->gen.const_builtins.find(variable.id);
+      it != this->gen.const_builtins.end()) {
     add_instruction(it->second, std::nullopt);
     return;
   }
-  if (std::find(this->global_symbols.begin(), this->global_symbols.end(),
-                variable.id) != this->global_symbols.end()) {
+  if (is_global(variable.id)) {
+    add_instruction(ISA::Operation::LOADGLOBAL, variable.id);
+  } else if (auto slot = find_local(variable.id)) {
+    add_instruction(ISA::Operation::GETLOCAL, *slot);
+  } else if (!this->gen.builtins.contains(variable.id)) {
+    // defined by another module, the scoper took it for an extern
     add_instruction(ISA::Operation::LOADGLOBAL, variable.id);
-  } else if (this->local_symbols.find(variable.id) !=
-             this->local_symbols.end()) {
-    add_instruction(ISA::Operation::GETLOCAL, this->local_symbols[variable.id]);
   } else {
     std::cerr << "Variable not found" << std::endl;
   }
 };
 
-void Generator::emit_set(const core::Set &set_op) {
+void Generator::Fragment::emit_set(const core::Set &set_op) {
   emit_expr(*set_op.rhs);
-  if (this->local_symbols.find(set_op.name) != this->local_symbols.end()) {
-    add_instruction(ISA::Operation::SETLOCAL,
-                    this->local_symbols.at(set_op.name));
-  } else if (std::find(this->global_symbols.begin(), this->global_symbols.end(),
-                       set_op.name) != this->global_symbols.end()) {
+  if (auto slot = find_local(set_op.name)) {
+    add_instruction(ISA::Operation::SETLOCAL, *slot);
+  } else if (is_global(set_op.name) ||
+             !this->gen.builtins.contains(set_op.name)) {
     add_instruction(ISA::Operation::MUTGLOBAL, set_op.name);
   } else {
     std::cerr << "Variable not found for set!" << std::endl;
   }
+  // set! is still an expression, leave an unspecified value behind for the
+  // DROP that follows it in a body
+  add_instruction(ISA::Operation::PUSH, 0);
 }
@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <backend/generator/register_generator.hpp>
+#include <backend/isa/register_isa.hpp>
+#include <cstdint>
+#include <frontend/core.hpp>
+#include <iostream>
+#include <type_traits>
+#include <variant>
+
+using RegISA::Operation;
+
+void print_register_code(const std::vector<RegISA::Instruction> &code) {
+  for (size_t i = 0; i < code.size(); i++) {
+    const auto &instr = code[i];
+    std::cerr << "[" << i << "] "
+              << RegISA::spec_list[static_cast<uint8_t>(instr.op)].mnemonic
+              << " " << instr.a << " " << instr.b << " " << instr.c << " "
+              << instr.k << "\n";
+  }
+}
+
+namespace {
+
+// ids referenced (read or set!), bound and set! within the expression
+void scan(const core::Expr &expr, std::set<core::SymbolId> &refs,
+          std::set<core::SymbolId> &binders, std::set<core::SymbolId> &sets) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          refs.insert(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          refs.insert(node.name);
+          sets.insert(node.name);
+          scan(*node.rhs, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          // a define within a body stores to a global
+          sets.insert(node.name);
+          scan(*node.rhs, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &formal : node.formals)
+            binders.insert(*formal);
+          for (auto &stmt : node.body)
+            scan(*stmt, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          scan(*node.condition, refs, binders, sets);
+          scan(*node.then, refs, binders, sets);
+          scan(*node.otherwise, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          scan(*node.callee, refs, binders, sets);
+          for (auto &arg : node.args)
+            scan(*arg, refs, binders, sets);
+        }
+      },
+      expr.node);
+}
+
+bool is_let(const core::Apply &apply) {
+  auto *lam = std::get_if<core::Lambda>(&apply.callee->node);
+  return lam && lam->formals.size() == apply.args.size();
+}
+
+} // namespace
+
+void RegisterGenerator::analyse() {
+  std::set<core::SymbolId> refs;
+  std::set<core::SymbolId> locals;
+  std::map<core::SymbolId, size_t> define_count;
+  for (auto &top : this->program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      this->globals.insert(def->name);
+      define_count[def->name]++;
+      scan(*def->rhs, refs, locals, this->assigned);
+    } else {
+      scan(std::get<core::Expr>(top), refs, locals, this->assigned);
+    }
+  }
+  for (auto id : this->assigned) {
+    if (!locals.contains(id))
+      this->globals.insert(id);
+  }
+  for (auto id : this->globals)
+    this->global_slots.emplace(id, this->global_slots.size());
+  for (auto &top : this->program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      auto *lam = std::get_if<core::Lambda>(&def->rhs->node);
+      if (lam && define_count[def->name] == 1 &&
+          !this->assigned.contains(def->name))
+        this->direct[def->name] = lam;
+    }
+  }
+
+  // the free locals of every lambda which is not a let, scoper ids are unique
+  // so whatever a lambda references and does not bind is bound outside it
+  std::set<core::SymbolId> captured;
+  auto visit = [&](auto &&self, const core::Expr &expr) -> void {
+    std::visit(
+        [&](const auto &node) {
+          using T = std::decay_t<decltype(node)>;
+          if constexpr (std::is_same_v<T, core::Lambda>) {
+            std::set<core::SymbolId> inner_refs;
+            std::set<core::SymbolId> inner_binders;
+            std::set<core::SymbolId> inner_sets;
+            scan(expr, inner_refs, inner_binders, inner_sets);
+            auto &env = this->free[&node];
+            for (auto id : inner_refs) {
+              if (locals.contains(id) && !inner_binders.contains(id)) {
+                env.push_back(id);
+                captured.insert(id);
+              }
+            }
+            for (auto &stmt : node.body)
+              self(self, *stmt);
+          } else if constexpr (std::is_same_v<T, core::Apply>) {
+            if (is_let(node)) {
+              for (auto &stmt : std::get<core::Lambda>(node.callee->node).body)
+                self(self, *stmt);
+            } else {
+              self(self, *node.callee);
+            }
+            for (auto &arg : node.args)
+              self(self, *arg);
+          } else if constexpr (std::is_same_v<T, core::Cond>) {
+            self(self, *node.condition);
+            self(self, *node.then);
+            self(self, *node.otherwise);
+          } else if constexpr (std::is_same_v<T, core::Set> ||
+                               std::is_same_v<T, core::Define>) {
+            self(self, *node.rhs);
+          }
+        },
+        expr.node);
+  };
+  for (auto &top : this->program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      visit(visit, *def->rhs);
+    } else {
+      visit(visit, std::get<core::Expr>(top));
+    }
+  }
+  for (auto id : captured) {
+    if (this->assigned.contains(id))
+      this->boxed.insert(id);
+  }
+}
+
+std::vector<RegISA::Instruction> RegisterGenerator::generate() {
+  // ENTER        #the top level frame
+  // CLOSURE      #one per directly called function
+  // STOREG
+  // emit<top>*
+  // HALT
+  // <function>*  #every lambda body, queued as it is referenced
+  analyse();
+  const auto enter = this->code.size();
+  emit({.op = Operation::ENTER});
+  const auto result = alloc();
+  bool has_result = false;
+  for (auto &top : this->program) {
+    auto *def = std::get_if<core::Define>(&top);
+    if (!def || !this->direct.contains(def->name))
+      continue;
+    const auto mark = this->next;
+    const auto reg = emit_closure(*this->direct.at(def->name), std::nullopt);
+    emit({.op = Operation::STOREG,
+          .a = reg,
+          .k = this->global_slots.at(def->name)});
+    this->next = mark;
+  }
+  for (auto &top : this->program) {
+    const auto mark = this->next;
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      if (!this->direct.contains(def->name)) {
+        const auto reg = emit_expr(*def->rhs);
+        emit({.op = Operation::STOREG,
+              .a = reg,
+              .k = this->global_slots.at(def->name)});
+      }
+    } else {
+      emit_expr(std::get<core::Expr>(top), result);
+      has_result = true;
+    }
+    this->next = mark;
+  }
+  emit({.op = Operation::HALT, .a = result, .b = has_result ? 1U : 0U});
+  this->code[enter].k = this->frame;
+
+  std::map<const core::Lambda *, uint64_t> entries;
+  // a body may reference lambdas which are not queued yet
+  for (size_t i = 0; i < this->functions.size(); i++) {
+    entries[this->functions[i]] = this->code.size();
+    emit_function(*this->functions[i]);
+  }
+  for (auto &[lambda, uses] : this->entry_uses) {
+    for (auto idx : uses)
+      this->code[idx].k = entries.at(lambda);
+  }
+  return this->code;
+}
+
+void RegisterGenerator::emit(RegISA::Instruction instr) {
+  this->code.push_back(instr);
+}
+
+uint32_t RegisterGenerator::alloc() {
+  const auto reg = this->next++;
+  this->frame = std::max(this->frame, this->next);
+  return reg;
+}
+
+uint32_t RegisterGenerator::target(std::optional<uint32_t> dest) {
+  return dest ? *dest : alloc();
+}
+
+void RegisterGenerator::use_entry(const core::Lambda &lambda) {
+  if (!this->entry_uses.contains(&lambda))
+    this->functions.push_back(&lambda);
+  this->entry_uses[&lambda].push_back(this->code.size());
+}
+
+void RegisterGenerator::emit_function(const core::Lambda &lambda) {
+  // ENTER        #formals, then the captured locals, then the rest
+  // BOX*         #the formals captured and set!
+  // emit<body>   #ending in RET or a tail call
+  this->slots.clear();
+  this->next = 0;
+  this->frame = 0;
+  for (auto &formal : lambda.formals)
+    this->slots[*formal] = Slot{alloc(), this->boxed.contains(*formal)};
+  // a captured box arrives as the box itself
+  for (auto id : this->free.at(&lambda))
+    this->slots[id] = Slot{alloc(), this->boxed.contains(id)};
+  const auto enter = this->code.size();
+  emit({.op = Operation::ENTER});
+  for (auto &formal : lambda.formals) {
+    if (this->boxed.contains(*formal))
+      emit({.op = Operation::BOX, .a = this->slots.at(*formal).reg});
+  }
+  emit_body(lambda.body, std::nullopt, true);
+  this->code[enter].k = this->frame;
+}
+
+void RegisterGenerator::emit_body(
+    const std::vector<std::unique_ptr<core::Expr>> &body,
+    std::optional<uint32_t> dest, bool tail) {
+  for (size_t i = 0; i + 1 < body.size(); i++)
+    emit_effect(*body[i]);
+  emit_expr(*body.back(), dest, tail);
+}
+
+uint32_t RegisterGenerator::result(uint32_t reg, bool tail) {
+  if (tail)
+    emit({.op = Operation::RET, .a = reg});
+  return reg;
+}
+
+uint32_t RegisterGenerator::emit_expr(const core::Expr &expr,
+                                      std::optional<uint32_t> dest,
+                                      bool tail) {
+  return std::visit(
+      [&](const auto &node) -> uint32_t {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Const>) {
+          const auto reg = target(dest);
+          emit({.op = Operation::LOADK, .a = reg, .k = node.value});
+          return result(reg, tail);
+        } else if constexpr (std::is_same_v<T, core::Var>) {
+          return result(emit_var(node, dest), tail);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          emit_set(node);
+          // set! is still an expression with an unspecified value
+          const auto reg = target(dest);
+          emit({.op = Operation::LOADK, .a = reg, .k = 0});
+          return result(reg, tail);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          const auto mark = this->next;
+          const auto value = emit_expr(*node.rhs);
+          emit({.op = Operation::STOREG,
+                .a = value,
+                .k = this->global_slots.at(node.name)});
+          this->next = mark;
+          const auto reg = target(dest);
+          emit({.op = Operation::LOADK, .a = reg, .k = 0});
+          return result(reg, tail);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          return result(emit_closure(node, dest), tail);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          return emit_cond(node, dest, tail);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          return emit_apply(node, dest, tail);
+        } else {
+          const auto reg = target(dest);
+          emit({.op = Operation::LOADK, .a = reg, .k = 0});
+          return result(reg, tail);
+        }
+      },
+      expr.node);
+}
+
+void RegisterGenerator::emit_effect(const core::Expr &expr) {
+  const auto mark = this->next;
+  if (auto *set = std::get_if<core::Set>(&expr.node)) {
+    emit_set(*set);
+  } else {
+    emit_expr(expr);
+  }
+  this->next = mark;
+}
+
+uint32_t RegisterGenerator::emit_var(const core::Var &var,
+                                     std::optional<uint32_t> dest) {
+  if (var.id == this->nil_id) {
+    const auto reg = target(dest);
+    emit({.op = Operation::LOADNIL, .a = reg});
+    return reg;
+  }
+  if (auto it = this->slots.find(var.id); it != this->slots.end()) {
+    const auto slot = it->second;
+    if (slot.boxed) {
+      const auto reg = target(dest);
+      emit({.op = Operation::UNBOX, .a = reg, .b = slot.reg});
+      return reg;
+    }
+    // a local which is never set! is read in place, one that is could be
+    // stored to by a later operand of the same operation
+    if (!dest && !this->assigned.contains(var.id))
+      return slot.reg;
+    const auto reg = target(dest);
+    if (reg != slot.reg)
+      emit({.op = Operation::MOV, .a = reg, .b = slot.reg});
+    return reg;
+  }
+  const auto reg = target(dest);
+  if (this->globals.contains(var.id)) {
+    emit({.op = Operation::LOADG,
+          .a = reg,
+          .k = this->global_slots.at(var.id)});
+  } else {
+    std::cerr << "Variable not found" << std::endl;
+  }
+  return reg;
+}
+
+void RegisterGenerator::emit_set(const core::Set &set) {
+  const auto mark = this->next;
+  if (auto it = this->slots.find(set.name); it != this->slots.end()) {
+    if (it->second.boxed) {
+      const auto value = emit_expr(*set.rhs);
+      emit({.op = Operation::SETBOX, .a = it->second.reg, .b = value});
+    } else {
+      emit_expr(*set.rhs, it->second.reg);
+    }
+  } else if (this->globals.contains(set.name)) {
+    const auto value = emit_expr(*set.rhs);
+    emit({.op = Operation::STOREG,
+          .a = value,
+          .k = this->global_slots.at(set.name)});
+  } else {
+    std::cerr << "Variable not found for set!" << std::endl;
+  }
+  this->next = mark;
+}
+
+uint32_t RegisterGenerator::emit_closure(const core::Lambda &lambda,
+                                         std::optional<uint32_t> dest) {
+  // MOV*         #the captured locals, or their boxes, side by side
+  // CLOSURE
+  const auto reg = target(dest);
+  const auto mark = this->next;
+  const auto &env = this->free.at(&lambda);
+  const auto base = this->next;
+  for (auto id : env) {
+    emit({.op = Operation::MOV, .a = alloc(), .b = this->slots.at(id).reg});
+  }
+  use_entry(lambda);
+  emit({.op = Operation::CLOSURE,
+        .a = reg,
+        .b = base,
+        .c = static_cast<uint32_t>(env.size())});
+  this->next = mark;
+  return reg;
+}
+
+uint32_t RegisterGenerator::emit_cond(const core::Cond &cond,
+                                      std::optional<uint32_t> dest,
+                                      bool tail) {
+  // J<not cond> otherwise
+  // emit<then>
+  // JMP end      #unless then returned
+  // otherwise:
+  // emit<otherwise>
+  // end:
+  const auto reg = tail ? 0 : target(dest);
+  const auto branch_dest = tail ? std::nullopt : std::optional<uint32_t>(reg);
+  const auto mark = this->next;
+  const auto branch = emit_branch(*cond.condition);
+  this->next = mark;
+  emit_expr(*cond.then, branch_dest, tail);
+  this->next = mark;
+  size_t skip = 0;
+  if (!tail) {
+    skip = this->code.size();
+    emit({.op = Operation::JMP});
+  }
+  this->code[branch].k = this->code.size();
+  emit_expr(*cond.otherwise, branch_dest, tail);
+  this->next = mark;
+  if (!tail)
+    this->code[skip].k = this->code.size();
+  return reg;
+}
+
+size_t RegisterGenerator::emit_branch(const core::Expr &condition) {
+  auto *apply = std::get_if<core::Apply>(&condition.node);
+  auto *callee = apply ? std::get_if<core::Var>(&apply->callee->node) : nullptr;
+  if (callee && apply->args.size() == 2) {
+    if (auto it = this->negated_branches.find(callee->id);
+        it != this->negated_branches.end()) {
+      const auto a = emit_expr(*apply->args[0]);
+      const auto b = emit_expr(*apply->args[1]);
+      emit({.op = it->second, .a = a, .b = b});
+      return this->code.size() - 1;
+    }
+  }
+  const auto reg = emit_expr(condition);
+  emit({.op = Operation::JF, .a = reg});
+  return this->code.size() - 1;
+}
+
+uint32_t RegisterGenerator::emit_apply(const core::Apply &apply,
+                                       std::optional<uint32_t> dest,
+                                       bool tail) {
+  if (is_let(apply)) {
+    return emit_let(std::get<core::Lambda>(apply.callee->node), apply.args,
+                    dest, tail);
+  }
+  auto *callee = std::get_if<core::Var>(&apply.callee->node);
+  if (!callee)
+    return emit_call(apply, dest, tail);
+  auto binary = this->binary_builtins.find(callee->id);
+  auto unary = this->unary_builtins.find(callee->id);
+  if (binary != this->binary_builtins.end() && apply.args.size() == 2) {
+    const auto reg = tail ? alloc() : target(dest);
+    const auto mark = this->next;
+    // (+ x k), (+ k x) and (- x k) add an immediate
+    auto *lhs = std::get_if<core::Const>(&apply.args[0]->node);
+    auto *rhs = std::get_if<core::Const>(&apply.args[1]->node);
+    if ((callee->id == this->add_id && (lhs || rhs)) ||
+        (callee->id == this->sub_id && rhs)) {
+      const auto &operand = rhs ? *apply.args[0] : *apply.args[1];
+      const auto imm = rhs ? rhs->value : lhs->value;
+      const auto a = emit_expr(operand);
+      emit({.op = Operation::ADDI,
+            .a = reg,
+            .b = a,
+            .k = callee->id == this->add_id ? imm : uint64_t{0} - imm});
+    } else {
+      const auto a = emit_expr(*apply.args[0]);
+      const auto b = emit_expr(*apply.args[1]);
+      emit({.op = binary->second, .a = reg, .b = a, .c = b});
+    }
+    this->next = mark;
+    return result(reg, tail);
+  }
+  if (unary != this->unary_builtins.end() && apply.args.size() == 1) {
+    const auto reg = tail ? alloc() : target(dest);
+    const auto mark = this->next;
+    const auto a = emit_expr(*apply.args[0]);
+    emit({.op = unary->second, .a = reg, .b = a});
+    this->next = mark;
+    return result(reg, tail);
+  }
+  return emit_call(apply, dest, tail);
+}
+
+uint32_t RegisterGenerator::emit_let(
+    const core::Lambda &lambda,
+    const std::vector<std::unique_ptr<core::Expr>> &args,
+    std::optional<uint32_t> dest, bool tail) {
+  // ((lambda (x_i)* body) e_i*) binds each x_i to a register of the frame
+  const auto reg = tail ? 0 : target(dest);
+  const auto mark = this->next;
+  for (size_t i = 0; i < args.size(); i++) {
+    const auto formal = *lambda.formals[i];
+    const bool boxed = this->boxed.contains(formal);
+    // a copy of a local which neither side stores to shares its register
+    auto *var = std::get_if<core::Var>(&args[i]->node);
+    if (var && !boxed && !this->assigned.contains(formal) &&
+        !this->assigned.contains(var->id)) {
+      if (auto it = this->slots.find(var->id);
+          it != this->slots.end() && !it->second.boxed) {
+        this->slots[formal] = it->second;
+        continue;
+      }
+    }
+    const auto slot = alloc();
+    emit_expr(*args[i], slot);
+    this->next = slot + 1;
+    this->slots[formal] = Slot{slot, boxed};
+    if (boxed)
+      emit({.op = Operation::BOX, .a = slot});
+  }
+  emit_body(lambda.body, tail ? std::nullopt : std::optional<uint32_t>(reg),
+            tail);
+  this->next = mark;
+  return reg;
+}
+
+uint32_t RegisterGenerator::emit_call(const core::Apply &apply,
+                                      std::optional<uint32_t> dest,
+                                      bool tail) {
+  // the arguments are computed into registers side by side, which the call
+  // copies into the formals of the new frame
+  const auto reg = tail ? 0 : target(dest);
+  const auto mark = this->next;
+  const core::Lambda *known = nullptr;
+  uint32_t closure = 0;
+  auto *callee = std::get_if<core::Var>(&apply.callee->node);
+  if (auto it = callee ? this->direct.find(callee->id) : this->direct.end();
+      it != this->direct.end() &&
+      it->second->formals.size() == apply.args.size()) {
+    known = it->second;
+  } else {
+    closure = emit_expr(*apply.callee);
+  }
+  const auto base = this->next;
+  for (auto &arg : apply.args) {
+    const auto slot = alloc();
+    emit_expr(*arg, slot);
+    this->next = slot + 1;
+  }
+  const auto argc = static_cast<uint32_t>(apply.args.size());
+  if (known) {
+    use_entry(*known);
+    emit({.op = tail ? Operation::TAILCALLDIRECT : Operation::CALLDIRECT,
+          .a = reg,
+          .b = argc,
+          .c = base});
+  } else {
+    emit({.op = tail ? Operation::TAILCALL : Operation::CALL,
+          .a = reg,
+          .b = closure,
+          .c = base,
+          .k = argc});
+  }
+  this->next = mark;
+  return reg;
+}
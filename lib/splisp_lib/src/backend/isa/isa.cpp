@@ -1,19 +1,97 @@
 #include <backend/isa/isa.hpp>
 #include <cstdint>
+#include <limits>
+#include <stdexcept>
 
-std::array<uint8_t, 9> ISA::Instruction::to_bytes() const {
-  std::array<uint8_t, 9> ret{};
-  ret[0] = static_cast<uint8_t>(op);
+ISA::Encoded ISA::encode(const std::vector<ISA::Instruction> &code) {
+  // addresses are fixed width, so every offset is known before any target
+  Encoded out;
+  out.offsets.reserve(code.size() + 1);
+  uint32_t offset = 0;
+  for (const auto &instr : code) {
+    out.offsets.push_back(offset);
+    offset++;
+    switch (spec_list[static_cast<uint8_t>(instr.op)].operand) {
+    case (OperandKind::NONE):
+      break;
+    case (OperandKind::U64):
+      for (uint64_t value = instr.operand.value_or(0); value >= 0x80;
+           value >>= 7)
+        offset++;
+      offset++;
+      break;
+    case (OperandKind::ADD):
+      offset += 4;
+      break;
+    }
+  }
+  out.offsets.push_back(offset);
 
-  const uint64_t value = operand.value_or(0);
-  ret[1] = static_cast<uint8_t>(value & 0xFF);
-  ret[2] = static_cast<uint8_t>((value >> 8) & 0xFF);
-  ret[3] = static_cast<uint8_t>((value >> 16) & 0xFF);
-  ret[4] = static_cast<uint8_t>((value >> 24) & 0xFF);
-  ret[5] = static_cast<uint8_t>((value >> 32) & 0xFF);
-  ret[6] = static_cast<uint8_t>((value >> 40) & 0xFF);
-  ret[7] = static_cast<uint8_t>((value >> 48) & 0xFF);
-  ret[8] = static_cast<uint8_t>((value >> 56) & 0xFF);
+  out.bytes.reserve(offset);
+  for (const auto &instr : code) {
+    out.bytes.push_back(static_cast<uint8_t>(instr.op));
+    switch (spec_list[static_cast<uint8_t>(instr.op)].operand) {
+    case (OperandKind::NONE):
+      break;
+    case (OperandKind::U64): {
+      uint64_t value = instr.operand.value_or(0);
+      for (; value >= 0x80; value >>= 7)
+        out.bytes.push_back(static_cast<uint8_t>(value | 0x80));
+      out.bytes.push_back(static_cast<uint8_t>(value));
+      break;
+    }
+    case (OperandKind::ADD): {
+      const uint32_t target = out.offsets.at(instr.operand.value_or(0));
+      for (unsigned shift = 0; shift < 32; shift += 8)
+        out.bytes.push_back(static_cast<uint8_t>(target >> shift));
+      break;
+    }
+    }
+  }
+  return out;
+}
+
+std::vector<ISA::Instruction>
+ISA::decode_code(std::span<const uint8_t> bytes) {
+  constexpr auto between = std::numeric_limits<std::size_t>::max();
+  std::vector<Instruction> code;
+  // the index of the instruction starting at each offset
+  std::vector<std::size_t> index(bytes.size() + 1, between);
+  for (std::size_t offset = 0; offset < bytes.size();) {
+    const auto instr = decode(bytes.data(), offset);
+    index[offset] = code.size();
+    std::optional<uint64_t> operand;
+    if (spec_list[static_cast<uint8_t>(instr.op)].operand != OperandKind::NONE)
+      operand = instr.operand;
+    code.push_back(Instruction{instr.op, operand});
+    offset = instr.next;
+  }
+  index[bytes.size()] = code.size();
+  for (auto &instr : code) {
+    if (!is_address(instr.op))
+      continue;
+    const auto target = index.at(*instr.operand);
+    if (target == between)
+      throw std::out_of_range("address between instructions");
+    instr.operand = target;
+  }
+  return code;
+}
+
+std::set<std::size_t>
+ISA::jump_targets(const std::vector<ISA::Instruction> &code) {
+  std::set<std::size_t> found;
+  for (const auto &instr : code) {
+    if (is_address(instr.op) && instr.operand)
+      found.insert(*instr.operand);
+  }
+  return found;
+}
 
-  return ret;
+void ISA::relocate(std::vector<ISA::Instruction> &code,
+                   const std::vector<std::size_t> &moved) {
+  for (auto &instr : code) {
+    if (is_address(instr.op) && instr.operand)
+      instr.operand = moved.at(*instr.operand);
+  }
 }
@@ -0,0 +1,109 @@
+#include <backend/module/module.hpp>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool is_global_slot(ISA::Operation op) {
+  switch (op) {
+  case (ISA::Operation::MKGLOBAL):
+  case (ISA::Operation::LOADGLOBAL):
+  case (ISA::Operation::MUTGLOBAL):
+  case (ISA::Operation::CALLGLOBAL):
+  case (ISA::Operation::TAILCALLGLOBAL):
+    return true;
+  default:
+    return false;
+  }
+}
+
+// the global call superinstructions keep the slot in the low half
+uint64_t slot_of(const ISA::Instruction &instr) {
+  return ISA::low(instr.operand.value_or(0));
+}
+
+void set_slot(ISA::Instruction &instr, uint64_t slot) {
+  if (instr.op == ISA::Operation::CALLGLOBAL ||
+      instr.op == ISA::Operation::TAILCALLGLOBAL)
+    instr.operand = ISA::pack(slot, ISA::high(*instr.operand));
+  else
+    instr.operand = slot;
+}
+
+} // namespace
+
+SPLC::Linked SPLC::link(const std::vector<Module> &modules) {
+  // a program was optimized as all there is, it may have dropped or called
+  // straight into the globals another module would use
+  for (size_t m = 0; modules.size() > 1 && m < modules.size(); m++) {
+    if (modules[m].kind() == Kind::PROGRAM)
+      throw std::runtime_error(
+          "module " + std::to_string(m + 1) +
+          " is a program and cannot be linked, compile it with -c");
+  }
+  Linked out;
+  std::map<std::string, uint64_t, std::less<>> slots;
+  // the module defining each named slot
+  std::map<uint64_t, size_t> definer;
+  std::vector<std::vector<uint64_t>> slot_maps;
+  for (size_t m = 0; m < modules.size(); m++) {
+    auto &slot_map = slot_maps.emplace_back();
+    for (const auto &global : modules[m].globals()) {
+      const auto name = modules[m].name(global);
+      auto it = name.empty() ? slots.end() : slots.find(name);
+      if (it == slots.end()) {
+        const auto slot = out.globals.size();
+        out.globals.push_back(Symbol{std::string(name), false});
+        if (!name.empty())
+          it = slots.emplace(std::string(name), slot).first;
+        slot_map.push_back(slot);
+      } else {
+        slot_map.push_back(it->second);
+      }
+      if (!global.defined)
+        continue;
+      const auto slot = slot_map.back();
+      if (out.globals[slot].defined)
+        throw std::runtime_error(std::string(name) +
+                                 " is defined by more than one module");
+      out.globals[slot].defined = true;
+      definer[slot] = m;
+    }
+  }
+  for (const auto &symbol : out.globals) {
+    if (!symbol.defined)
+      throw std::runtime_error(symbol.name + " is used but never defined");
+  }
+
+  for (size_t m = 0; m < modules.size(); m++) {
+    auto code = ISA::decode_code(modules[m].code());
+    const auto base = out.code.size();
+    // the drop of what the top level left follows the code of the module, so
+    // none of its addresses move
+    const auto end = base + code.size();
+    const auto last = m + 1 == modules.size();
+    for (auto &instr : code) {
+      if (is_address(instr.op)) {
+        instr.operand = *instr.operand + base;
+      } else if (is_global_slot(instr.op)) {
+        const auto slot = slot_maps[m].at(slot_of(instr));
+        if (instr.op == ISA::Operation::MUTGLOBAL && definer.at(slot) != m)
+          throw std::runtime_error(out.globals[slot].name +
+                                   " is set! outside the module defining it");
+        set_slot(instr, slot);
+      } else if (instr.op == ISA::Operation::HALT && !last) {
+        // on to the top level of the next module
+        instr = ISA::Instruction{ISA::Operation::JMP, end};
+      }
+      out.code.push_back(instr);
+    }
+    if (!last && modules[m].halt_depth() > 0)
+      out.code.push_back(
+          ISA::Instruction{ISA::Operation::DROP, modules[m].halt_depth()});
+  }
+  if (!modules.empty())
+    out.halt_depth = modules.back().halt_depth();
+  return out;
+}
@@ -0,0 +1,206 @@
+#include <backend/module/module.hpp>
+#include <bit>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+static_assert(std::endian::native == std::endian::little,
+              "modules are mapped as they are stored, little endian");
+
+namespace {
+
+constexpr size_t align(size_t offset) { return (offset + 7) & ~size_t{7}; }
+
+// the offset of each section following the header
+struct Layout {
+  size_t code;
+  size_t globals;
+  size_t names;
+  size_t sites;
+  size_t end;
+};
+
+Layout layout(size_t code_size, size_t global_count, size_t names_size,
+              size_t site_count) {
+  Layout out{};
+  out.code = align(sizeof(SPLC::Header));
+  out.globals = align(out.code + code_size);
+  out.names = out.globals + global_count * sizeof(SPLC::Global);
+  out.sites = align(out.names + names_size);
+  out.end = out.sites + site_count * sizeof(SPLC::Site);
+  return out;
+}
+
+} // namespace
+
+std::vector<SPLC::Symbol>
+SPLC::symbols(const std::vector<core::SymbolId> &slot_ids,
+              const Scoper &scoper) {
+  const auto names = scoper.global_names();
+  std::vector<Symbol> out;
+  for (auto id : slot_ids) {
+    auto it = names.find(id);
+    if (it == names.end())
+      out.push_back(Symbol{});
+    else
+      out.push_back(Symbol{it->second,
+                           !scoper.extern_names().contains(it->second)});
+  }
+  return out;
+}
+
+SPLC::Image SPLC::make_image(const std::vector<ISA::Instruction> &code,
+                             std::vector<Symbol> globals, Kind kind,
+                             uint32_t halt_depth) {
+  auto encoded = ISA::encode(code);
+  Image image{kind, std::move(encoded.bytes), std::move(globals), {},
+              halt_depth};
+  for (size_t i = 0; i < code.size(); i++) {
+    if (code[i].site != 0)
+      image.sites.push_back(Site{encoded.offsets[i], code[i].site});
+  }
+  return image;
+}
+
+uint32_t SPLC::checksum(std::span<const uint8_t> bytes) {
+  uint32_t hash = 2166136261U;
+  for (auto byte : bytes) {
+    hash ^= byte;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+void SPLC::write(std::ostream &out, const Image &image) {
+  std::vector<Global> globals;
+  std::string names;
+  for (const auto &symbol : image.globals) {
+    Global global{no_name, symbol.defined};
+    if (!symbol.name.empty()) {
+      global.name = names.size();
+      names += symbol.name;
+      names += '\0';
+    }
+    globals.push_back(global);
+  }
+
+  const auto at = layout(image.code.size(), globals.size(), names.size(),
+                         image.sites.size());
+  std::vector<uint8_t> bytes(at.end, 0);
+  std::memcpy(bytes.data() + at.code, image.code.data(), image.code.size());
+  std::memcpy(bytes.data() + at.globals, globals.data(),
+              globals.size() * sizeof(Global));
+  std::memcpy(bytes.data() + at.names, names.data(), names.size());
+  std::memcpy(bytes.data() + at.sites, image.sites.data(),
+              image.sites.size() * sizeof(Site));
+
+  Header header{};
+  header.magic = magic;
+  header.version = version;
+  header.kind = image.kind;
+  header.code_offset = at.code;
+  header.code_size = image.code.size();
+  header.globals_offset = at.globals;
+  header.global_count = globals.size();
+  header.names_offset = at.names;
+  header.names_size = names.size();
+  header.sites_offset = at.sites;
+  header.site_count = image.sites.size();
+  header.halt_depth = image.halt_depth;
+  header.checksum = checksum(std::span(bytes).subspan(sizeof(Header)));
+  std::memcpy(bytes.data(), &header, sizeof(header));
+  out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+SPLC::Module SPLC::Module::load(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("cannot open " + path);
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("cannot stat " + path);
+  }
+  Module module;
+  module.length = info.st_size;
+  if (module.length < sizeof(Header)) {
+    ::close(fd);
+    throw std::runtime_error(path + " is not a module");
+  }
+  module.mapping =
+      ::mmap(nullptr, module.length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (module.mapping == MAP_FAILED) {
+    module.mapping = nullptr;
+    throw std::runtime_error("cannot map " + path);
+  }
+
+  const auto *base = static_cast<const uint8_t *>(module.mapping);
+  const auto &header = *reinterpret_cast<const Header *>(base);
+  if (header.magic != magic)
+    throw std::runtime_error(path + " is not a module");
+  if (header.version != version)
+    throw std::runtime_error(path + " is a module of version " +
+                             std::to_string(header.version) + ", not " +
+                             std::to_string(version));
+  const auto at = layout(header.code_size, header.global_count,
+                         header.names_size, header.site_count);
+  if (header.code_offset != at.code || header.globals_offset != at.globals ||
+      header.names_offset != at.names || header.sites_offset != at.sites ||
+      module.length != at.end ||
+      (header.kind != Kind::PROGRAM && header.kind != Kind::OBJECT))
+    throw std::runtime_error(path + " has a corrupt header");
+  if (checksum({base + sizeof(Header), module.length - sizeof(Header)}) !=
+      header.checksum)
+    throw std::runtime_error(path + " fails its checksum");
+
+  module.kind_ = header.kind;
+  module.halt_depth_ = header.halt_depth;
+  module.code_ = {base + at.code, header.code_size};
+  module.globals_ = {reinterpret_cast<const Global *>(base + at.globals),
+                     header.global_count};
+  module.names_ = {reinterpret_cast<const char *>(base + at.names),
+                   header.names_size};
+  module.sites_ = {reinterpret_cast<const Site *>(base + at.sites),
+                   header.site_count};
+  for (const auto &global : module.globals_) {
+    if (global.name != no_name && global.name >= module.names_.size())
+      throw std::runtime_error(path + " has a corrupt global table");
+  }
+  if (!module.names_.empty() && module.names_.back() != '\0')
+    throw std::runtime_error(path + " has a corrupt global table");
+  return module;
+}
+
+std::string_view SPLC::Module::name(const Global &global) const {
+  if (global.name == no_name)
+    return {};
+  return std::string_view(this->names_.data() + global.name);
+}
+
+SPLC::Module::Module(Module &&other) noexcept { *this = std::move(other); }
+
+SPLC::Module &SPLC::Module::operator=(Module &&other) noexcept {
+  if (this != &other) {
+    if (this->mapping)
+      ::munmap(this->mapping, this->length);
+    this->mapping = std::exchange(other.mapping, nullptr);
+    this->length = std::exchange(other.length, 0);
+    this->kind_ = other.kind_;
+    this->halt_depth_ = other.halt_depth_;
+    this->code_ = std::exchange(other.code_, {});
+    this->globals_ = std::exchange(other.globals_, {});
+    this->names_ = std::exchange(other.names_, {});
+    this->sites_ = std::exchange(other.sites_, {});
+  }
+  return *this;
+}
+
+SPLC::Module::~Module() {
+  if (this->mapping)
+    ::munmap(this->mapping, this->length);
+}
@@ -0,0 +1,228 @@
+#include <backend/vm/jit.hpp>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using ISA::Operation;
+
+// jumps whose target is their operand, the only transfers kept native
+bool is_branch(Operation op) {
+  switch (op) {
+  case (Operation::JMP):
+  case (Operation::CJMP):
+  case (Operation::CJMPZ):
+  case (Operation::JLT):
+  case (Operation::JLE):
+  case (Operation::JEQ):
+  case (Operation::JNE):
+  case (Operation::JGE):
+  case (Operation::JGT):
+  case (Operation::JNULL):
+  case (Operation::JNNULL):
+    return true;
+  default:
+    return false;
+  }
+}
+
+// the instructions after which the function does not go on
+bool ends_function(Operation op) {
+  switch (op) {
+  case (Operation::JMP):
+  case (Operation::RET):
+  case (Operation::RETN):
+  case (Operation::TAILCALL):
+  case (Operation::TAILCALLGLOBAL):
+  case (Operation::TAILCALLDIRECT):
+  case (Operation::HALT):
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool is_call(Operation op) {
+  return op == Operation::CALL || op == Operation::CALLGLOBAL ||
+         op == Operation::CALLDIRECT;
+}
+
+// x86-64 machine code with rel32 jumps to labels placed later
+class Assembler {
+public:
+  std::vector<uint8_t> bytes;
+
+  void emit(std::initializer_list<uint8_t> code) {
+    this->bytes.insert(this->bytes.end(), code);
+  }
+  void imm64(uint64_t value) {
+    for (int i = 0; i < 8; i++)
+      this->bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+  // a jump (E9) or a conditional jump (0F 8x) to label
+  void jump(std::initializer_list<uint8_t> opcode, size_t label) {
+    emit(opcode);
+    this->fixups.emplace_back(this->bytes.size(), label);
+    this->bytes.insert(this->bytes.end(), 4, 0);
+  }
+  void place(size_t label) { this->labels[label] = this->bytes.size(); }
+  size_t label(size_t label) const { return this->labels.at(label); }
+  void link() {
+    for (auto [at, label] : this->fixups) {
+      const auto rel = static_cast<int32_t>(
+          static_cast<int64_t>(this->labels.at(label)) -
+          static_cast<int64_t>(at + 4));
+      std::memcpy(this->bytes.data() + at, &rel, 4);
+    }
+  }
+
+private:
+  std::map<size_t, size_t> labels;
+  std::vector<std::pair<size_t, size_t>> fixups;
+};
+
+} // namespace
+
+bool Jit::supported() {
+#if defined(__x86_64__) && defined(__linux__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+Jit::Jit(std::span<const uint8_t> code, std::array<Op, ISA::op_count> ops,
+         uint32_t threshold)
+    : code(code), ops(ops), threshold(threshold), calls(code.size()),
+      natives(code.size()) {}
+
+Jit::Jit(Jit &&other) noexcept { *this = std::move(other); }
+
+Jit &Jit::operator=(Jit &&other) noexcept {
+  if (this != &other) {
+    for (auto [block, length] : this->blocks)
+      ::munmap(block, length);
+    this->code = other.code;
+    this->ops = other.ops;
+    this->threshold = other.threshold;
+    this->calls = std::move(other.calls);
+    this->natives = std::move(other.natives);
+    this->blocks = std::exchange(other.blocks, {});
+    this->perf_map = std::move(other.perf_map);
+  }
+  return *this;
+}
+
+Jit::~Jit() {
+  for (auto [block, length] : this->blocks)
+    ::munmap(block, length);
+}
+
+void Jit::called(size_t entry) {
+  if (entry < this->calls.size() && ++this->calls[entry] == this->threshold)
+    compile(entry);
+}
+
+void Jit::compile(size_t entry) {
+  if (!supported() || entry >= this->code.size() || this->natives[entry])
+    return;
+  // the instructions of the function and where native code may be entered:
+  // the function itself and the instruction after each call, where the
+  // callee returns to
+  std::map<size_t, ISA::Decoded> body;
+  std::set<size_t> entries{entry};
+  std::vector<size_t> work{entry};
+  while (!work.empty()) {
+    const auto at = work.back();
+    work.pop_back();
+    if (at >= this->code.size() || body.contains(at))
+      continue;
+    if (this->code[at] >= ISA::op_count)
+      continue;
+    const auto instr = ISA::decode(this->code.data(), at);
+    body.emplace(at, instr);
+    if (is_branch(instr.op))
+      work.push_back(instr.operand);
+    if (!ends_function(instr.op))
+      work.push_back(instr.next);
+    if (is_call(instr.op))
+      entries.insert(instr.next);
+  }
+
+  // labels: the offset of each instruction, the exit after them all and the
+  // entry stub of each entry point after that
+  const size_t exit = this->code.size();
+  Assembler as;
+  for (auto &[at, instr] : body) {
+    if (!entries.contains(at) || this->natives[at])
+      continue;
+    as.place(exit + 1 + at);
+    as.emit({0x53});             // push rbx
+    as.emit({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    as.jump({0xE9}, at);         // jmp <at>
+  }
+  for (auto it = body.begin(); it != body.end(); ++it) {
+    const auto &[at, instr] = *it;
+    as.place(at);
+    // handler(vm, operand, at, next)
+    as.emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+    as.emit({0x48, 0xBE});       // mov rsi, operand
+    as.imm64(instr.operand);
+    as.emit({0x48, 0xBA}); // mov rdx, at
+    as.imm64(at);
+    as.emit({0x48, 0xB9}); // mov rcx, next
+    as.imm64(instr.next);
+    as.emit({0x48, 0xB8}); // mov rax, handler
+    as.imm64(reinterpret_cast<uint64_t>(
+        this->ops[static_cast<uint8_t>(instr.op)]));
+    as.emit({0xFF, 0xD0}); // call rax
+    if (is_branch(instr.op) && body.contains(instr.operand)) {
+      as.emit({0x83, 0xF8, jumped});        // cmp eax, jumped
+      as.jump({0x0F, 0x84}, instr.operand); // je <target>
+    }
+    as.emit({0x85, 0xC0});       // test eax, eax
+    as.jump({0x0F, 0x85}, exit); // jnz exit
+    auto following = std::next(it);
+    if (following == body.end() || following->first != instr.next)
+      as.jump({0xE9}, exit);
+  }
+  as.place(exit);
+  as.emit({0x5B}); // pop rbx
+  as.emit({0xC3}); // ret
+  as.link();
+
+  const auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  const auto length = (as.bytes.size() + page - 1) / page * page;
+  void *block = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (block == MAP_FAILED)
+    return;
+  std::memcpy(block, as.bytes.data(), as.bytes.size());
+  if (::mprotect(block, length, PROT_READ | PROT_EXEC) != 0) {
+    ::munmap(block, length);
+    return;
+  }
+  this->blocks.emplace_back(block, length);
+
+  auto *base = static_cast<uint8_t *>(block);
+  for (auto at : entries) {
+    if (body.contains(at) && !this->natives[at])
+      this->natives[at] =
+          reinterpret_cast<Native>(base + as.label(exit + 1 + at));
+  }
+
+  if (!this->perf_map.is_open())
+    this->perf_map.open("/tmp/perf-" + std::to_string(::getpid()) + ".map",
+                        std::ios::app);
+  this->perf_map << std::hex << reinterpret_cast<uintptr_t>(block) << " "
+                 << as.bytes.size() << std::dec << " splisp_jit_" << entry
+                 << std::endl;
+}
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <backend/isa/register_isa.hpp>
+#include <backend/vm/register.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+using RegISA::Operation;
+
+RegisterMachine::RegisterMachine(std::vector<RegISA::Instruction> program,
+                                 bool dbg) {
+  this->dbg = dbg;
+  this->program_mem = std::move(program);
+}
+
+MachineState RegisterMachine::run_program() {
+  while (this->pc < this->program_mem.size()) {
+    const auto prev_pc = this->pc;
+    MachineState state;
+    try {
+      state = step();
+    } catch (const std::exception &e) {
+      const uint8_t op = static_cast<uint8_t>(this->program_mem[prev_pc].op);
+      std::cerr << "runtime error at pc=" << prev_pc
+                << " op=" << RegISA::spec_list[op].mnemonic << ": "
+                << e.what() << "\n";
+      std::cerr << "  frame depth=" << this->frames.size()
+                << " registers=" << this->regs.size()
+                << " heap size=" << this->heap.size() << "\n";
+      return MachineState::INVALID_OP;
+    }
+    if (state != MachineState::OKAY)
+      return state;
+  }
+  return MachineState::HALT;
+}
+
+RegisterMachine::Value RegisterMachine::alloc(Object object, Tag tag) {
+  this->heap.push_back(std::move(object));
+  return Value{static_cast<int64_t>(this->heap.size() - 1), tag};
+}
+
+void RegisterMachine::enter(uint64_t entry, size_t args, size_t count,
+                            const std::vector<Value> &env, bool tail,
+                            uint32_t dest) {
+  const auto needed = count + env.size();
+  if (tail) {
+    // the arguments may live anywhere in the frame they overwrite
+    this->scratch.assign(this->regs.begin() + args,
+                         this->regs.begin() + args + count);
+    this->scratch.insert(this->scratch.end(), env.begin(), env.end());
+    if (this->regs.size() < this->base + needed)
+      this->regs.resize(this->base + needed);
+    std::copy(this->scratch.begin(), this->scratch.end(),
+              this->regs.begin() + this->base);
+  } else {
+    this->frames.push_back(Frame{this->pc, this->base, this->top, dest});
+    const auto next = this->top;
+    if (this->regs.size() < next + needed)
+      this->regs.resize(next + needed);
+    std::copy_n(this->regs.begin() + args, count, this->regs.begin() + next);
+    std::copy(env.begin(), env.end(), this->regs.begin() + next + count);
+    this->base = next;
+  }
+  // the ENTER heading the function is read rather than run
+  this->top = this->base + this->program_mem.at(entry).k;
+  if (this->regs.size() < this->top)
+    this->regs.resize(this->top);
+  this->pc = entry + 1;
+}
+
+MachineState RegisterMachine::step() {
+  const auto instr = this->program_mem[this->pc++];
+  this->steps++;
+  if (this->dbg) {
+    std::cerr << "pc=" << this->pc - 1 << " op="
+              << RegISA::spec_list[static_cast<uint8_t>(instr.op)].mnemonic
+              << " regs=[";
+    for (auto i = this->base; i < this->top; i++) {
+      if (i != this->base)
+        std::cerr << ", ";
+      std::cerr << this->regs[i].value;
+      if (this->regs[i].tag == Tag::FUNCTION)
+        std::cerr << "f";
+    }
+    std::cerr << "]\n";
+  }
+  // arithmetic takes anything but a function, like the stack machine
+  auto numbers = [&]() {
+    return reg(instr.b).tag != Tag::FUNCTION &&
+           reg(instr.c).tag != Tag::FUNCTION;
+  };
+  auto boolean = [](bool holds) { return Value{holds ? 1 : 0, Tag::INT}; };
+  // the operand order of the comparisons, see register_isa.hpp
+  auto compare = [&](Operation op, int64_t lhs, int64_t rhs) {
+    switch (op) {
+    case (Operation::LT):
+    case (Operation::JLT):
+      return lhs < rhs;
+    case (Operation::LE):
+    case (Operation::JLE):
+      return lhs <= rhs;
+    case (Operation::EQ):
+    case (Operation::JEQ):
+      return lhs == rhs;
+    case (Operation::JNE):
+      return lhs != rhs;
+    case (Operation::GE):
+    case (Operation::JGE):
+      return lhs >= rhs;
+    default:
+      return lhs > rhs;
+    }
+  };
+
+  switch (instr.op) {
+  case (Operation::MOV):
+    reg(instr.a) = reg(instr.b);
+    break;
+  case (Operation::LOADK):
+    reg(instr.a) = Value{static_cast<int64_t>(instr.k), Tag::INT};
+    break;
+  case (Operation::LOADNIL):
+    reg(instr.a) = Value{0, Tag::NIL};
+    break;
+  case (Operation::LOADG):
+    if (!this->globals.at(instr.k))
+      throw std::runtime_error("global read before it was defined");
+    reg(instr.a) = *this->globals[instr.k];
+    break;
+  case (Operation::STOREG):
+    if (instr.k >= this->globals.size())
+      this->globals.resize(instr.k + 1);
+    this->globals[instr.k] = reg(instr.a);
+    break;
+  case (Operation::ADD):
+  case (Operation::SUB):
+  case (Operation::MUL):
+  case (Operation::DIV):
+  case (Operation::MOD): {
+    if (!numbers())
+      return MachineState::INVALID_ADD;
+    const auto lhs = reg(instr.b).value;
+    const auto rhs = reg(instr.c).value;
+    if ((instr.op == Operation::DIV || instr.op == Operation::MOD) &&
+        rhs == 0)
+      return MachineState::INVALID_OP;
+    int64_t value = 0;
+    switch (instr.op) {
+    case (Operation::ADD):
+      value = lhs + rhs;
+      break;
+    case (Operation::SUB):
+      value = lhs - rhs;
+      break;
+    case (Operation::MUL):
+      value = lhs * rhs;
+      break;
+    case (Operation::DIV):
+      value = lhs / rhs;
+      break;
+    default:
+      value = lhs % rhs;
+      break;
+    }
+    reg(instr.a) = Value{value, Tag::INT};
+    break;
+  }
+  case (Operation::ADDI): {
+    if (reg(instr.b).tag == Tag::FUNCTION)
+      return MachineState::INVALID_ADD;
+    reg(instr.a) = Value{reg(instr.b).value + static_cast<int64_t>(instr.k),
+                         Tag::INT};
+    break;
+  }
+  case (Operation::LT):
+  case (Operation::LE):
+  case (Operation::EQ):
+  case (Operation::GE):
+  case (Operation::GT):
+    reg(instr.a) =
+        boolean(compare(instr.op, reg(instr.c).value, reg(instr.b).value));
+    break;
+  case (Operation::JMP):
+    this->pc = instr.k;
+    break;
+  case (Operation::JT):
+    if (reg(instr.a).value != 0)
+      this->pc = instr.k;
+    break;
+  case (Operation::JF):
+    if (reg(instr.a).value == 0)
+      this->pc = instr.k;
+    break;
+  case (Operation::JLT):
+  case (Operation::JLE):
+  case (Operation::JEQ):
+  case (Operation::JNE):
+  case (Operation::JGE):
+  case (Operation::JGT):
+    if (compare(instr.op, reg(instr.b).value, reg(instr.a).value))
+      this->pc = instr.k;
+    break;
+  case (Operation::CONS):
+    reg(instr.a) = alloc(Pair{reg(instr.b), reg(instr.c)}, Tag::PAIR);
+    break;
+  case (Operation::CAR):
+  case (Operation::CDR): {
+    const auto cell = reg(instr.b);
+    if (cell.tag != Tag::PAIR)
+      return MachineState::INVALID_INSTR;
+    const auto &pair = std::get<Pair>(this->heap.at(cell.value));
+    reg(instr.a) = instr.op == Operation::CAR ? pair.head : pair.tail;
+    break;
+  }
+  case (Operation::ISNULL):
+    reg(instr.a) = boolean(reg(instr.b).tag == Tag::NIL);
+    break;
+  case (Operation::BOX):
+    reg(instr.a) = alloc(Box{reg(instr.a)}, Tag::BOX);
+    break;
+  case (Operation::UNBOX):
+    reg(instr.a) = std::get<Box>(this->heap.at(reg(instr.b).value)).value;
+    break;
+  case (Operation::SETBOX):
+    std::get<Box>(this->heap.at(reg(instr.a).value)).value = reg(instr.b);
+    break;
+  case (Operation::CLOSURE): {
+    const auto from = this->regs.begin() + this->base + instr.b;
+    reg(instr.a) = alloc(Closure{instr.k, {from, from + instr.c}},
+                         Tag::FUNCTION);
+    break;
+  }
+  case (Operation::CALL):
+  case (Operation::TAILCALL): {
+    const auto callee = reg(instr.b);
+    if (callee.tag != Tag::FUNCTION)
+      return MachineState::INVALID_INSTR;
+    const auto &closure = std::get<Closure>(this->heap.at(callee.value));
+    enter(closure.entry, this->base + instr.c, instr.k, closure.env,
+          instr.op == Operation::TAILCALL, instr.a);
+    break;
+  }
+  case (Operation::CALLDIRECT):
+  case (Operation::TAILCALLDIRECT):
+    enter(instr.k, this->base + instr.c, instr.b, {},
+          instr.op == Operation::TAILCALLDIRECT, instr.a);
+    break;
+  case (Operation::ENTER):
+    this->top = this->base + instr.k;
+    if (this->regs.size() < this->top)
+      this->regs.resize(this->top);
+    break;
+  case (Operation::RET): {
+    if (this->frames.empty())
+      throw std::runtime_error("return without a caller");
+    const auto value = reg(instr.a);
+    const auto frame = this->frames.back();
+    this->frames.pop_back();
+    this->pc = frame.ret;
+    this->base = frame.base;
+    this->top = frame.top;
+    reg(frame.dest) = value;
+    break;
+  }
+  case (Operation::HALT):
+    if (instr.b == 1)
+      this->halted_with = reg(instr.a);
+    return MachineState::HALT;
+  default:
+    return MachineState::INVALID_OP;
+  }
+  return MachineState::OKAY;
+}
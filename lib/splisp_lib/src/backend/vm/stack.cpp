@@ -7,6 +7,7 @@
 #include <linux/limits.h>
 #include <memory>
 #include <stdexcept>
+#include <utility>
 
 namespace {
 
@@ -23,11 +24,24 @@ std::shared_ptr<Cell> clone_cell(const Cell &cell) {
 
 Stack::Stack(std::vector<ISA::Instruction> program, bool dbg) {
   this->dbg = dbg;
-  this->program_mem = std::move(program);
+  auto encoded = ISA::encode(program);
+  this->encoded = std::move(encoded.bytes);
+  this->program_mem = this->encoded;
+  this->offsets = std::move(encoded.offsets);
+  for (size_t i = 0; i < program.size(); i++) {
+    if (program[i].site != 0)
+      this->site_at[this->offsets[i]] = program[i].site;
+  }
 };
 
-uint64_t read_operand(const std::vector<ISA::Instruction> &instrs, size_t pc) {
-  return instrs[pc / 9].operand.value_or(0);
+Stack::Stack(const SPLC::Module &module, bool dbg) {
+  if (module.kind() != SPLC::Kind::PROGRAM)
+    throw std::invalid_argument("an object module runs once it is linked");
+  this->dbg = dbg;
+  this->program_mem = module.code();
+  this->global_tbl.resize(module.globals().size());
+  for (const auto &site : module.sites())
+    this->site_at[site.offset] = site.site;
 }
 
 MachineState Stack::setState(MachineState next) {
@@ -42,7 +56,7 @@ Stack::run_program_dbg(const std::vector<ISA::Instruction> &source) {
     std::cerr << "── program ──\n";
     for (size_t i = 0; i < source.size(); i++) {
       const auto &spec = ISA::spec_list[static_cast<uint8_t>(source[i].op)];
-      bool current = (i * 9 == this->pc);
+      bool current = (this->offsets[i] == this->pc);
       std::cerr << (current ? " * " : "   ") << "[" << i << "] "
                 << spec.mnemonic;
       if (source[i].operand.has_value())
@@ -91,9 +105,11 @@ Stack::run_program_dbg(const std::vector<ISA::Instruction> &source) {
     }
     // globals
     std::cerr << "── globals ──\n";
-    for (auto &[id, cell] : this->global_tbl) {
-      std::cerr << "  [" << id << "] " << cell->value
-                << (cell->function ? "f" : "") << "\n";
+    for (size_t i = 0; i < this->global_tbl.size(); i++) {
+      if (!this->global_tbl[i])
+        continue;
+      std::cerr << "  [" << i << "] " << this->global_tbl[i]->value
+                << (this->global_tbl[i]->function ? "f" : "") << "\n";
     }
     std::cerr << "────────────  pc=" << this->pc
               << "  frame_base=" << this->frame_base << "\n";
@@ -111,8 +127,7 @@ Stack::run_program_dbg(const std::vector<ISA::Instruction> &source) {
     try {
       this->machine_state = runInstruction();
     } catch (const std::exception &e) {
-      const uint8_t op =
-          static_cast<uint8_t>(this->program_mem[prev_pc / 9].op);
+      const uint8_t op = this->program_mem[prev_pc];
       std::cerr << "runtime error at pc=" << prev_pc
                 << " op=" << ISA::spec_list[op].mnemonic << ": " << e.what()
                 << "\n";
@@ -121,8 +136,8 @@ Stack::run_program_dbg(const std::vector<ISA::Instruction> &source) {
     if (this->machine_state != MachineState::OKAY)
       break;
     if (this->pc == prev_pc)
-      this->pc += 9;
-    if (this->pc >= this->program_mem.size() * 9) {
+      this->pc = this->next_pc;
+    if (this->pc >= this->program_mem.size()) {
       print_state();
       return setState(MachineState::HALT);
     }
@@ -131,14 +146,41 @@ Stack::run_program_dbg(const std::vector<ISA::Instruction> &source) {
   return setState(this->machine_state);
 }
 
+MachineState Stack::run_compiled(Compiled code) {
+  try {
+    return setState(code(*this));
+  } catch (const std::exception &e) {
+    const uint8_t op = this->program_mem[this->pc];
+    std::cerr << "runtime error at pc=" << this->pc
+              << " op=" << ISA::spec_list[op].mnemonic << ": " << e.what()
+              << "\n";
+    return setState(MachineState::INVALID_OP);
+  }
+}
+
 MachineState Stack::run_program() {
+  return this->verified ? run_loop<false>() : run_loop<true>();
+}
+
+void Stack::verify() {
+  const auto proof = verify_bytecode(this->program_mem);
+  this->frame_depth.assign(this->program_mem.size(), 0);
+  for (auto [entry, depth] : proof.max_depth)
+    this->frame_depth[entry] = depth;
+  if (this->global_tbl.size() < proof.globals)
+    this->global_tbl.resize(proof.globals);
+  if (!this->program_mem.empty())
+    this->data_stack.reserve(this->frame_depth[0]);
+  this->verified = true;
+}
+
+template <bool checked> MachineState Stack::run_loop() {
   while (true) {
     const auto prev_pc = this->pc;
     try {
       this->machine_state = runInstruction();
     } catch (const std::exception &e) {
-      const uint8_t op =
-          static_cast<uint8_t>(this->program_mem[prev_pc / 9].op);
+      const uint8_t op = this->program_mem[prev_pc];
       const auto &spec = ISA::spec_list[op];
       std::cerr << "runtime error at pc=" << prev_pc << " op=" << spec.mnemonic
                 << ": " << e.what() << "\n";
@@ -150,17 +192,145 @@ MachineState Stack::run_program() {
     if (this->machine_state != MachineState::OKAY)
       break;
     if (this->pc == prev_pc)
-      this->pc += 9;
-    if (this->pc >= this->program_mem.size() * 9)
+      this->pc = this->next_pc;
+    // verified code never runs off the end
+    if (checked && this->pc >= this->program_mem.size())
       return MachineState::HALT;
-    continue;
   }
   return setState(this->machine_state);
 }
 
+std::shared_ptr<Cell> &Stack::global(uint64_t slot) {
+  if (slot >= this->global_tbl.size())
+    this->global_tbl.resize(slot + 1);
+  return this->global_tbl[slot];
+}
+
+const std::shared_ptr<Cell> &Stack::read_global(uint64_t slot) {
+  // verify sized the table for every slot the code names
+  const auto &cell =
+      this->verified ? this->global_tbl[slot] : this->global_tbl.at(slot);
+  if (!cell)
+    throw std::runtime_error("global read before it was defined");
+  return cell;
+}
+
+std::shared_ptr<Cell> &Stack::cell(std::size_t index) {
+  return this->verified ? this->data_stack[index] : this->data_stack.at(index);
+}
+
+void Stack::check_arity(const CodeEnv &env, uint64_t args) const {
+  if (this->verified &&
+      ISA::decode(this->program_mem.data(), env.code_idx).operand !=
+          args + env.captured_vars.size())
+    throw std::runtime_error("closure called with the wrong argument count");
+}
+
+void Stack::enable_profile() {
+  this->profiling = true;
+  this->window.clear();
+  this->jit.reset();
+}
+
+bool Stack::enable_jit(uint32_t threshold) {
+  if (!Jit::supported() || this->profiling || this->dbg)
+    return false;
+  this->jit = std::make_unique<Jit>(this->program_mem, jit_ops(), threshold);
+  return true;
+}
+
+bool Stack::step(uint8_t op, uint64_t operand, size_t at, size_t after) {
+  this->steps++;
+  this->pc = at;
+  this->operand = operand;
+  this->next_pc = after;
+  return execute(op) == MachineState::OKAY;
+}
+
+template <uint8_t op>
+int Stack::jit_op(Stack *vm, uint64_t operand, uint64_t at, uint64_t after) {
+  try {
+    if (!vm->step(op, operand, at, after))
+      return Jit::stop;
+  } catch (...) {
+    // an exception cannot unwind through the native frames
+    vm->jit_error = std::current_exception();
+    return Jit::stop;
+  }
+  return vm->pc == at ? Jit::next : Jit::jumped;
+}
+
+std::array<Jit::Op, ISA::op_count> Stack::jit_ops() {
+  return []<size_t... ops>(std::index_sequence<ops...>) {
+    return std::array<Jit::Op, ISA::op_count>{&jit_op<ops>...};
+  }(std::make_index_sequence<ISA::op_count>{});
+}
+
+MachineState Stack::run_native(Jit::Native native) {
+  const auto left = native(this);
+  if (this->jit_error)
+    std::rethrow_exception(std::exchange(this->jit_error, nullptr));
+  // pc is where the interpreter goes on, even when it is where native code
+  // was entered
+  this->next_pc = this->pc;
+  return left == Jit::stop ? this->machine_state : setState(MachineState::OKAY);
+}
+
+void Stack::record(ISA::Operation op) {
+  if (this->window.empty() || this->pc != this->window_next)
+    this->window.clear();
+  this->window.push_back(op);
+  if (this->window.size() > 3)
+    this->window.erase(this->window.begin());
+  this->window_next = this->next_pc;
+  for (size_t n = 2; n <= this->window.size(); n++) {
+    std::vector<ISA::Operation> run(this->window.end() - n,
+                                    this->window.end());
+    this->sequences[run]++;
+  }
+}
+
+std::vector<std::pair<std::vector<ISA::Operation>, uint64_t>>
+hot_sequences(const std::map<std::vector<ISA::Operation>, uint64_t> &profile,
+              size_t n) {
+  std::vector<std::pair<std::vector<ISA::Operation>, uint64_t>> hot(
+      profile.begin(), profile.end());
+  std::stable_sort(hot.begin(), hot.end(), [](auto &a, auto &b) {
+    return a.second > b.second;
+  });
+  if (hot.size() > n)
+    hot.resize(n);
+  return hot;
+}
+
 MachineState Stack::runInstruction() {
-  uint8_t curr = static_cast<uint8_t>(this->program_mem[this->pc / 9].op);
+  if (this->jit) {
+    if (auto native = this->jit->native(this->pc))
+      return run_native(native);
+  }
+  this->steps++;
+  if (!this->profiling)
+    return dispatch();
+  const auto site = this->site_at.find(this->pc);
+  if (site == this->site_at.end())
+    return dispatch();
+  const auto before = this->pc;
+  const auto state = dispatch();
+  auto &counts = this->sites[site->second];
+  counts.count++;
+  if (this->pc != before)
+    counts.taken++;
+  return state;
+}
+
+MachineState Stack::dispatch() {
+  const auto instr = ISA::decode(this->program_mem.data(), this->pc);
+  this->operand = instr.operand;
+  this->next_pc = instr.next;
+  uint8_t curr = static_cast<uint8_t>(instr.op);
   const auto spec = ISA::spec_list[curr];
+  if (this->profiling)
+    record(static_cast<ISA::Operation>(curr));
   if (this->dbg) {
     std::cerr << "pc=" << this->pc << " op=" << spec.mnemonic << " stack=[";
     for (size_t i = 0; i < this->data_stack.size(); ++i) {
@@ -172,7 +342,11 @@ MachineState Stack::runInstruction() {
     }
     std::cerr << "]\n";
   }
-  switch (spec.operation) {
+  return execute(curr);
+};
+
+MachineState Stack::execute(uint8_t curr) {
+  switch (ISA::spec_list[curr].operation) {
   case (ISA::OperationKind::ARITHMETIC): {
     return setState(this->handleArithmetic(curr));
   }
@@ -191,7 +365,7 @@ MachineState Stack::runInstruction() {
   default:
     return setState(MachineState::INVALID_OP);
   }
-};
+}
 
 MachineState Stack::handleArithmetic(uint8_t op) {
   switch (static_cast<ISA::Operation>(op)) {
@@ -263,6 +437,42 @@ MachineState Stack::handleArithmetic(uint8_t op) {
     data_stack.push_back(std::make_shared<Cell>(Cell{a->value - 1}));
     break;
   }
+  case (ISA::Operation::ADDI): {
+    // the operand is a two's complement immediate
+    const auto imm =
+        static_cast<int64_t>(this->operand);
+    auto &a = data_stack.back();
+    if (a->function) {
+      return MachineState::INVALID_ADD;
+    }
+    a = std::make_shared<Cell>(Cell{a->value + imm});
+    break;
+  }
+  // superinstructions, see optimizer/superinstructions.hpp
+  case (ISA::Operation::ADDLL): {
+    // GETLOCAL a; GETLOCAL b; ADD
+    const uint64_t operand = this->operand;
+    const auto &a = local(ISA::low(operand));
+    // b may be the slot the copy of a takes, as after GETLOCAL a
+    const auto at_b = this->frame_base + ISA::high(operand);
+    const auto &b = at_b == data_stack.size() ? a : cell(at_b);
+    if (a->function || b->function) {
+      return MachineState::INVALID_ADD;
+    }
+    data_stack.push_back(std::make_shared<Cell>(Cell{a->value + b->value}));
+    break;
+  }
+  case (ISA::Operation::ADDLI): {
+    // GETLOCAL a; ADDI k
+    const uint64_t operand = this->operand;
+    const auto &a = local(ISA::low(operand));
+    if (a->function) {
+      return MachineState::INVALID_ADD;
+    }
+    const auto imm = static_cast<int32_t>(ISA::high(operand));
+    data_stack.push_back(std::make_shared<Cell>(Cell{a->value + imm}));
+    break;
+  }
   case (ISA::Operation::MAX): {
     auto a = std::move(data_stack.back());
     data_stack.pop_back();
@@ -281,6 +491,42 @@ MachineState Stack::handleArithmetic(uint8_t op) {
         std::make_shared<Cell>(Cell{std::min(a->value, b->value)}));
     break;
   }
+  // the typer proved both operands are integers, no tag test
+  case (ISA::Operation::UADD): {
+    auto a = std::move(data_stack.back());
+    data_stack.pop_back();
+    auto &b = data_stack.back();
+    b = std::make_shared<Cell>(Cell{b->value + a->value});
+    break;
+  }
+  case (ISA::Operation::USUB): {
+    auto a = std::move(data_stack.back());
+    data_stack.pop_back();
+    auto &b = data_stack.back();
+    b = std::make_shared<Cell>(Cell{b->value - a->value});
+    break;
+  }
+  case (ISA::Operation::UMUL): {
+    auto a = std::move(data_stack.back());
+    data_stack.pop_back();
+    auto &b = data_stack.back();
+    b = std::make_shared<Cell>(Cell{b->value * a->value});
+    break;
+  }
+  case (ISA::Operation::UDIV): {
+    auto a = std::move(data_stack.back());
+    data_stack.pop_back();
+    auto &b = data_stack.back();
+    b = std::make_shared<Cell>(Cell{b->value / a->value});
+    break;
+  }
+  case (ISA::Operation::UMOD): {
+    auto a = std::move(data_stack.back());
+    data_stack.pop_back();
+    auto &b = data_stack.back();
+    b = std::make_shared<Cell>(Cell{b->value % a->value});
+    break;
+  }
   default:
     throw std::invalid_argument(
         "Non-arithmatic operation dispatched to arithmetic handler");
@@ -341,7 +587,7 @@ MachineState Stack::handleLogic(uint8_t op) {
   return setState(MachineState::OKAY);
 };
 MachineState Stack::handleTransfer(uint8_t op) {
-  const uint64_t operand = read_operand(this->program_mem, this->pc);
+  const uint64_t operand = this->operand;
   switch (static_cast<ISA::Operation>(op)) {
   case (ISA::Operation::DROP): {
     for (uint64_t i = 0; i < operand; i++) {
@@ -383,18 +629,136 @@ MachineState Stack::handleControl(uint8_t op) {
     // Closure handles are heap indexes. Calling one restores captured values so
     // the callee sees the same left-to-right stack order they had before
     // MKCLOSURE consumed them. The closure
-    const uint64_t arg_count = read_operand(this->program_mem, this->pc);
+    const uint64_t arg_count = this->operand;
     const size_t handle_idx = this->data_stack.size() - arg_count - 1;
-    const auto heap_idx = this->data_stack.at(handle_idx)->value;
-    this->return_stack.push(make_cell(this->pc + 9, false));
+    const auto heap_idx = cell(handle_idx)->value;
+    auto &region = cell(handle_idx)->local ? this->frame_heap : this->heap;
+    this->return_stack.push(make_cell(this->next_pc, false));
     data_stack.erase(this->data_stack.begin() + handle_idx);
-    CodeEnv &env = std::get<CodeEnv>(this->heap.at(heap_idx));
+    CodeEnv &env = std::get<CodeEnv>(region.at(heap_idx));
+    check_arity(env, arg_count);
     for (size_t i = 0; i < env.captured_vars.size(); ++i) {
       this->data_stack.push_back(env.captured_vars[i]);
     }
     this->pc = env.code_idx;
+    if (this->jit)
+      this->jit->called(this->pc);
     break;
   }
+  case (ISA::Operation::TAILCALL): {
+    // A call in tail position: the arguments replace the current frame and the
+    // caller's return address is kept, so the callee's RET goes straight back
+    // to it and loops run in constant stack space.
+    if (this->frame_base_stack.empty())
+      throw std::runtime_error("tail call outside of a frame");
+    const uint64_t arg_count = this->operand;
+    const size_t handle_idx = this->data_stack.size() - arg_count - 1;
+    const auto heap_idx = cell(handle_idx)->value;
+    auto &region = cell(handle_idx)->local ? this->frame_heap : this->heap;
+    CodeEnv &env = std::get<CodeEnv>(region.at(heap_idx));
+    check_arity(env, arg_count);
+    this->data_stack.erase(this->data_stack.begin() + this->frame_base,
+                           this->data_stack.begin() + handle_idx + 1);
+    for (size_t i = 0; i < env.captured_vars.size(); ++i) {
+      this->data_stack.push_back(env.captured_vars[i]);
+    }
+    this->pc = env.code_idx;
+    if (this->jit)
+      this->jit->called(this->pc);
+    // the callee's ENTER opens the frame again
+    this->frame_base = this->frame_base_stack.top();
+    this->frame_base_stack.pop();
+    if (!this->frame_heap_marks.empty()) {
+      this->frame_heap.erase(this->frame_heap.begin() +
+                                 this->frame_heap_marks.top(),
+                             this->frame_heap.end());
+      this->frame_heap_marks.pop();
+    }
+    break;
+  }
+  case (ISA::Operation::CALLGLOBAL): {
+    // LOADGLOBAL g; <args>; CALL n with the closure read straight from the
+    // global table, so no handle sits under the arguments
+    const uint64_t operand = this->operand;
+    const auto &handle = read_global(ISA::low(operand));
+    auto &region = handle->local ? this->frame_heap : this->heap;
+    CodeEnv &env = std::get<CodeEnv>(region.at(handle->value));
+    check_arity(env, ISA::high(operand));
+    this->return_stack.push(make_cell(this->next_pc, false));
+    for (size_t i = 0; i < env.captured_vars.size(); ++i) {
+      this->data_stack.push_back(env.captured_vars[i]);
+    }
+    this->pc = env.code_idx;
+    if (this->jit)
+      this->jit->called(this->pc);
+    break;
+  }
+  case (ISA::Operation::TAILCALLGLOBAL): {
+    if (this->frame_base_stack.empty())
+      throw std::runtime_error("tail call outside of a frame");
+    const uint64_t operand = this->operand;
+    const uint64_t arg_count = ISA::high(operand);
+    const auto &handle = read_global(ISA::low(operand));
+    auto &region = handle->local ? this->frame_heap : this->heap;
+    CodeEnv &env = std::get<CodeEnv>(region.at(handle->value));
+    check_arity(env, arg_count);
+    this->data_stack.erase(this->data_stack.begin() + this->frame_base,
+                           this->data_stack.end() - arg_count);
+    for (size_t i = 0; i < env.captured_vars.size(); ++i) {
+      this->data_stack.push_back(env.captured_vars[i]);
+    }
+    this->pc = env.code_idx;
+    if (this->jit)
+      this->jit->called(this->pc);
+    this->frame_base = this->frame_base_stack.top();
+    this->frame_base_stack.pop();
+    if (!this->frame_heap_marks.empty()) {
+      this->frame_heap.erase(this->frame_heap.begin() +
+                                 this->frame_heap_marks.top(),
+                             this->frame_heap.end());
+      this->frame_heap_marks.pop();
+    }
+    break;
+  }
+  case (ISA::Operation::CALLDIRECT): {
+    // The operand is the ENTER of a function which captures nothing, the
+    // arguments already on the stack are its whole frame.
+    this->return_stack.push(make_cell(this->next_pc, false));
+    this->pc = this->operand;
+    if (this->jit)
+      this->jit->called(this->pc);
+    break;
+  }
+  case (ISA::Operation::TAILCALLDIRECT): {
+    // As TAILCALL, the argument count is the operand of the callee's ENTER
+    if (this->frame_base_stack.empty())
+      throw std::runtime_error("tail call outside of a frame");
+    const uint64_t entry = this->operand;
+    const uint64_t arg_count =
+        ISA::decode(this->program_mem.data(), entry).operand;
+    this->data_stack.erase(this->data_stack.begin() + this->frame_base,
+                           this->data_stack.end() - arg_count);
+    this->pc = entry;
+    if (this->jit)
+      this->jit->called(this->pc);
+    this->frame_base = this->frame_base_stack.top();
+    this->frame_base_stack.pop();
+    if (!this->frame_heap_marks.empty()) {
+      this->frame_heap.erase(this->frame_heap.begin() +
+                                 this->frame_heap_marks.top(),
+                             this->frame_heap.end());
+      this->frame_heap_marks.pop();
+    }
+    break;
+  }
+  case (ISA::Operation::RETN): {
+    // NROT n+1; DROP n; RET in one: the result replaces the n cells under it
+    const uint64_t operand = this->operand;
+    auto result = std::move(this->data_stack.back());
+    this->data_stack.resize(this->data_stack.size() - operand);
+    this->data_stack.back() = std::move(result);
+    [[fallthrough]];
+  }
   case (ISA::Operation::RET): {
     if (this->return_stack.empty())
       throw std::runtime_error("return stack underflow");
@@ -403,19 +767,77 @@ MachineState Stack::handleControl(uint8_t op) {
     this->pc = dest->value;
     this->frame_base = this->frame_base_stack.top();
     this->frame_base_stack.pop();
+    // release everything the frame allocated locally
+    if (!this->frame_heap_marks.empty()) {
+      this->frame_heap.erase(this->frame_heap.begin() +
+                                 this->frame_heap_marks.top(),
+                             this->frame_heap.end());
+      this->frame_heap_marks.pop();
+    }
     break;
   }
   case (ISA::Operation::JMP): {
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    const uint64_t operand = this->operand;
     this->pc = operand;
     break;
   }
-  case (ISA::Operation::CJMP): {
-    // (condition)
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+  case (ISA::Operation::CJMP):
+  case (ISA::Operation::CJMPZ): {
+    // (condition), CJMPZ jumps when it is false
+    const uint64_t operand = this->operand;
+    auto a = std::move(this->data_stack.back());
+    this->data_stack.pop_back();
+    const bool when = op == static_cast<uint8_t>(ISA::Operation::CJMP);
+    if ((a->value != 0) == when) {
+      this->pc = operand;
+    }
+    break;
+  }
+  case (ISA::Operation::JLT):
+  case (ISA::Operation::JLE):
+  case (ISA::Operation::JEQ):
+  case (ISA::Operation::JNE):
+  case (ISA::Operation::JGE):
+  case (ISA::Operation::JGT): {
+    // the comparison followed by CJMP, with the operands in the same order
+    const uint64_t operand = this->operand;
+    auto a = std::move(this->data_stack.back());
+    this->data_stack.pop_back();
+    auto b = std::move(this->data_stack.back());
+    this->data_stack.pop_back();
+    bool taken = false;
+    switch (static_cast<ISA::Operation>(op)) {
+    case (ISA::Operation::JLT):
+      taken = a->value < b->value;
+      break;
+    case (ISA::Operation::JLE):
+      taken = a->value <= b->value;
+      break;
+    case (ISA::Operation::JEQ):
+      taken = a->value == b->value;
+      break;
+    case (ISA::Operation::JNE):
+      taken = a->value != b->value;
+      break;
+    case (ISA::Operation::JGE):
+      taken = a->value >= b->value;
+      break;
+    default:
+      taken = a->value > b->value;
+      break;
+    }
+    if (taken) {
+      this->pc = operand;
+    }
+    break;
+  }
+  case (ISA::Operation::JNULL):
+  case (ISA::Operation::JNNULL): {
+    const uint64_t operand = this->operand;
     auto a = std::move(this->data_stack.back());
     this->data_stack.pop_back();
-    if (a->value != 0) {
+    const bool when = op == static_cast<uint8_t>(ISA::Operation::JNULL);
+    if (a->null == when) {
       this->pc = operand;
     }
     break;
@@ -431,51 +853,80 @@ MachineState Stack::handleControl(uint8_t op) {
     // capture everything in the current frame by taking the shared pointer and
     // adding it to the code env
     CodeEnv ret;
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    const uint64_t operand = this->operand;
     for (size_t i = this->frame_base; i < this->data_stack.size(); i++) {
-      ret.captured_vars.push_back(this->data_stack.at(i));
+      ret.captured_vars.push_back(this->data_stack[i]);
     }
     ret.code_idx = operand;
     this->heap.push_back(std::move(ret));
     this->data_stack.push_back(make_cell(this->heap.size() - 1, true));
     break;
   }
+  case (ISA::Operation::MKLOCALCLOSURE): {
+    // same capture as MKCLOSURE, but the closure lives in the frame heap
+    CodeEnv ret;
+    const uint64_t operand = this->operand;
+    for (size_t i = this->frame_base; i < this->data_stack.size(); i++) {
+      ret.captured_vars.push_back(this->data_stack[i]);
+    }
+    ret.code_idx = operand;
+    this->frame_heap.push_back(std::move(ret));
+    auto handle = make_cell(this->frame_heap.size() - 1, true);
+    handle->local = true;
+    this->data_stack.push_back(std::move(handle));
+    break;
+  }
   case (ISA::Operation::MKGLOBAL): {
-    // read from the operand the global map label, error check against repeat
+    // read from the operand the global slot, error check against repeat
     // labels (?)
     // add to the map the current PC code generator should then emit + 1
     // the rhs of the global + RET
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    const uint64_t operand = this->operand;
     auto glob_value = std::move(this->data_stack.back());
     this->data_stack.pop_back();
-    this->global_tbl[operand] = glob_value;
+    global(operand) = std::move(glob_value);
     break;
   }
   case (ISA::Operation::LOADGLOBAL): {
     //  1. read from the operand the global we'd like to retrieve
-    //  2. read from global table and copy it to the stack
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
-    this->data_stack.push_back(this->global_tbl[operand]);
+    //  2. read its slot in the global table and copy it to the stack
+    const uint64_t operand = this->operand;
+    this->data_stack.push_back(read_global(operand));
     break;
   }
   case (ISA::Operation::MUTGLOBAL): {
-    // Pop a value and store it under the symbol-id operand.
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    // Pop a value and store it in the slot operand.
+    const uint64_t operand = this->operand;
     auto value = std::move(this->data_stack.back());
     this->data_stack.pop_back();
-    this->global_tbl[operand] = std::move(value);
+    global(operand) = std::move(value);
     break;
   }
   case (ISA::Operation::ENTER): {
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    const uint64_t operand = this->operand;
     this->frame_base_stack.push(this->frame_base);
     this->frame_base = this->data_stack.size() - operand;
+    this->frame_heap_marks.push(this->frame_heap.size());
+    if (this->verified) {
+      // room for everything the function pushes, growing geometrically
+      const auto need = this->frame_base + this->frame_depth[this->pc];
+      const auto capacity = this->data_stack.capacity();
+      if (capacity < need)
+        this->data_stack.reserve(std::max(need, 2 * capacity));
+    }
     break;
   }
   case (ISA::Operation::GETLOCAL): {
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    const uint64_t operand = this->operand;
     this->data_stack.push_back(
-        clone_cell(*this->data_stack.at(this->frame_base + operand)));
+        clone_cell(*local(operand)));
+    break;
+  }
+  case (ISA::Operation::GETLOCAL2): {
+    const uint64_t operand = this->operand;
+    this->data_stack.push_back(clone_cell(*local(ISA::low(operand))));
+    // read after the push, b may be the copy of a
+    this->data_stack.push_back(clone_cell(*local(ISA::high(operand))));
     break;
   }
   case (ISA::Operation::SETLOCAL): {
@@ -483,9 +934,9 @@ MachineState Stack::handleControl(uint8_t op) {
     // mutate take the value off the top of the stack and mutate the value of
     // the cell at the target index but maintain the pointer, every environment
     // which sees this value will have the mutated value in it
-    const uint64_t operand = read_operand(this->program_mem, this->pc);
+    const uint64_t operand = this->operand;
     auto value = std::move(data_stack.back());
-    *data_stack.at(frame_base + operand) = *value;
+    *local(operand) = *value;
     data_stack.pop_back();
     break;
   }
@@ -512,12 +963,30 @@ MachineState Stack::handleList(uint8_t op) {
     }));
     break;
   }
+  case (ISA::Operation::LOCALCONS): {
+    auto tail = this->data_stack.back();
+    this->data_stack.pop_back();
+    auto head = this->data_stack.back();
+    this->data_stack.pop_back();
+    Pair cons = {.head = head, .tail = tail};
+    this->frame_heap.push_back(cons);
+    this->data_stack.push_back(std::make_shared<Cell>(Cell{
+        .value = static_cast<int64_t>(this->frame_heap.size() - 1),
+        .function = false,
+        .pair = true,
+        .null = false,
+        .local = true,
+    }));
+    break;
+  }
   case (ISA::Operation::CAR): {
     if (!this->data_stack.back()->pair) {
       this->machine_state = MachineState::INVALID_INSTR;
     } else {
+      auto &region =
+          this->data_stack.back()->local ? this->frame_heap : this->heap;
       if (auto *pair =
-              std::get_if<Pair>(&this->heap[this->data_stack.back()->value])) {
+              std::get_if<Pair>(&region[this->data_stack.back()->value])) {
         this->data_stack.pop_back();
         this->data_stack.push_back(pair->head);
       }
@@ -528,14 +997,50 @@ MachineState Stack::handleList(uint8_t op) {
     if (!this->data_stack.back()->pair) {
       this->machine_state = MachineState::INVALID_INSTR;
     } else {
+      auto &region =
+          this->data_stack.back()->local ? this->frame_heap : this->heap;
       if (auto *pair =
-              std::get_if<Pair>(&this->heap[this->data_stack.back()->value])) {
+              std::get_if<Pair>(&region[this->data_stack.back()->value])) {
         this->data_stack.pop_back();
         this->data_stack.push_back(pair->tail);
       }
     }
     break;
   }
+  // the typer proved the operand is a pair, but the code may come from a
+  // module nothing vouches for, so the tag is still checked. Only the lookup
+  // of the pair and the pop and push are skipped
+  case (ISA::Operation::UCAR):
+  case (ISA::Operation::UCDR): {
+    auto &cell = this->data_stack.back();
+    if (!cell->pair) {
+      this->machine_state = MachineState::INVALID_INSTR;
+      break;
+    }
+    auto &region = cell->local ? this->frame_heap : this->heap;
+    auto &pair = std::get<Pair>(region[cell->value]);
+    cell = static_cast<ISA::Operation>(op) == ISA::Operation::UCAR ? pair.head
+                                                                    : pair.tail;
+    break;
+  }
+  case (ISA::Operation::LOCALCAR):
+  case (ISA::Operation::LOCALCDR): {
+    // GETLOCAL a; CAR without the copy of the local
+    const uint64_t operand = this->operand;
+    const auto &cell = local(operand);
+    if (!cell->pair) {
+      this->data_stack.push_back(clone_cell(*cell));
+      this->machine_state = MachineState::INVALID_INSTR;
+      break;
+    }
+    auto &region = cell->local ? this->frame_heap : this->heap;
+    auto &pair = std::get<Pair>(region.at(cell->value));
+    this->data_stack.push_back(static_cast<ISA::Operation>(op) ==
+                                       ISA::Operation::LOCALCAR
+                                   ? pair.head
+                                   : pair.tail);
+    break;
+  }
   case (ISA::Operation::PUSHNIL): {
     this->data_stack.push_back(std::make_shared<Cell>(
         Cell{.value = 0, .function = false, .pair = false, .null = true}));
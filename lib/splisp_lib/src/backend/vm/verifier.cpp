@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <backend/isa/isa.hpp>
+#include <backend/vm/verifier.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using ISA::Operation;
+
+[[noreturn]] void reject(std::size_t at, const std::string &why) {
+  throw std::runtime_error("bytecode at " + std::to_string(at) + ": " + why);
+}
+
+// ISA::decode, reading nothing past the end of the code
+ISA::Decoded decode(std::span<const uint8_t> code, std::size_t at) {
+  if (code[at] >= ISA::op_count)
+    reject(at, "unknown opcode " + std::to_string(code[at]));
+  auto end = at + 1;
+  switch (ISA::spec_list[code[at]].operand) {
+  case (ISA::OperandKind::NONE):
+    break;
+  case (ISA::OperandKind::U64):
+    while (end < code.size() && end - at <= 10 && (code[end] & 0x80))
+      end++;
+    end++;
+    break;
+  case (ISA::OperandKind::ADD):
+    end += 4;
+    break;
+  }
+  if (end > code.size() || end - at > 11)
+    reject(at, "truncated instruction");
+  return ISA::decode(code.data(), at);
+}
+
+bool is_branch(Operation op) {
+  return ISA::is_address(op) && op != Operation::MKCLOSURE &&
+         op != Operation::MKLOCALCLOSURE && op != Operation::CALLDIRECT &&
+         op != Operation::TAILCALLDIRECT;
+}
+
+bool falls_through(Operation op) {
+  switch (op) {
+  case (Operation::JMP):
+  case (Operation::RET):
+  case (Operation::RETN):
+  case (Operation::TAILCALL):
+  case (Operation::TAILCALLGLOBAL):
+  case (Operation::TAILCALLDIRECT):
+  case (Operation::HALT):
+    return false;
+  default:
+    return true;
+  }
+}
+
+class Walk {
+public:
+  Walk(std::span<const uint8_t> code) : code(code), depth(code.size()) {
+    for (std::size_t at = 0; at < code.size();) {
+      this->starts.push_back(at);
+      this->instrs.push_back(decode(code, at));
+      at = this->instrs.back().next;
+    }
+    for (std::size_t i = 0; i < this->instrs.size(); i++) {
+      const auto &instr = this->instrs[i];
+      if (ISA::is_address(instr.op))
+        target(this->starts[i], instr.operand);
+      switch (instr.op) {
+      case (Operation::MKCLOSURE):
+      case (Operation::MKLOCALCLOSURE):
+      case (Operation::CALLDIRECT):
+      case (Operation::TAILCALLDIRECT):
+        if (at(instr.operand).op != Operation::ENTER)
+          reject(this->starts[i], "a function entry which is not an ENTER");
+        this->entries.push_back(instr.operand);
+        break;
+      default:
+        break;
+      }
+    }
+    std::sort(this->entries.begin(), this->entries.end());
+    this->entries.erase(
+        std::unique(this->entries.begin(), this->entries.end()),
+        this->entries.end());
+  }
+
+  Verified run() {
+    Verified out;
+    if (!this->code.empty())
+      out.max_depth[0] = function(0, 0);
+    for (auto entry : this->entries)
+      out.max_depth[entry] = function(entry, std::nullopt);
+    out.globals = this->globals;
+    return out;
+  }
+
+private:
+  std::span<const uint8_t> code;
+  std::vector<std::size_t> starts;
+  std::vector<ISA::Decoded> instrs;
+  std::vector<std::size_t> entries;
+  // the cells above the frame base before each instruction, once reached
+  std::vector<std::optional<std::size_t>> depth;
+  std::size_t globals = 0;
+
+  const ISA::Decoded &at(std::size_t offset) const {
+    const auto it =
+        std::lower_bound(this->starts.begin(), this->starts.end(), offset);
+    return this->instrs[it - this->starts.begin()];
+  }
+
+  void target(std::size_t from, std::size_t offset) const {
+    if (!std::binary_search(this->starts.begin(), this->starts.end(), offset))
+      reject(from, "an address which is not an instruction");
+  }
+
+  void global(uint64_t slot) {
+    this->globals = std::max<std::size_t>(this->globals, slot + 1);
+  }
+
+  // walks the function entered at entry, where the top level starts with
+  // depth cells and a function with none before its ENTER. Returns the most
+  // cells it holds
+  std::size_t function(std::size_t entry, std::optional<std::size_t> start) {
+    std::size_t most = start.value_or(0);
+    std::vector<std::pair<std::size_t, std::size_t>> work;
+    const auto reach = [&](std::size_t from, std::size_t offset,
+                           std::size_t cells) {
+      if (offset >= this->code.size())
+        reject(from, "runs off the end of the code");
+      if (this->depth[offset]) {
+        if (*this->depth[offset] != cells)
+          reject(offset, "reached with " + std::to_string(cells) +
+                             " cells and with " +
+                             std::to_string(*this->depth[offset]));
+        return;
+      }
+      if (offset != entry && at(offset).op == Operation::ENTER)
+        reject(offset, "an ENTER which is not a function entry");
+      this->depth[offset] = cells;
+      work.emplace_back(offset, cells);
+    };
+
+    if (start) {
+      reach(entry, entry, *start);
+    } else {
+      const auto &enter = at(entry);
+      most = std::max<std::size_t>(most, enter.operand);
+      reach(entry, enter.next, enter.operand);
+    }
+    while (!work.empty()) {
+      const auto [offset, cells] = work.back();
+      work.pop_back();
+      const auto &instr = at(offset);
+      const auto &spec = ISA::spec_list[static_cast<uint8_t>(instr.op)];
+      const auto need = [&](std::size_t n) {
+        if (cells < n)
+          reject(offset, "pops " + std::to_string(n) + " of " +
+                             std::to_string(cells) + " cells");
+      };
+      // a local among the cells, more of them after the instruction pushed
+      const auto local = [&](uint64_t index, std::size_t pushed = 0) {
+        if (index >= cells + pushed)
+          reject(offset, "local " + std::to_string(index) + " of " +
+                             std::to_string(cells + pushed) + " cells");
+      };
+      std::size_t after = cells;
+      switch (instr.op) {
+      case (Operation::DROP):
+        need(instr.operand);
+        after = cells - instr.operand;
+        break;
+      case (Operation::NROT):
+        // the top cell goes under the n - 1 below it, there is no NROT 0
+        if (instr.operand == 0)
+          reject(offset, "rotates no cells");
+        need(instr.operand);
+        break;
+      case (Operation::CALL):
+      case (Operation::TAILCALL):
+        // the handle under the arguments goes, the result comes back
+        need(instr.operand + 1);
+        after = cells - instr.operand;
+        break;
+      case (Operation::CALLGLOBAL):
+      case (Operation::TAILCALLGLOBAL):
+        global(ISA::low(instr.operand));
+        need(ISA::high(instr.operand));
+        after = cells - ISA::high(instr.operand) + 1;
+        break;
+      case (Operation::CALLDIRECT):
+      case (Operation::TAILCALLDIRECT): {
+        const auto arity = at(instr.operand).operand;
+        need(arity);
+        after = cells - arity + 1;
+        break;
+      }
+      case (Operation::RET):
+      case (Operation::RETN): {
+        // the frame under the result is dropped, leaving only the result
+        const auto dropped = instr.op == Operation::RETN ? instr.operand : 0;
+        if (start)
+          reject(offset, "returns from the top level");
+        if (cells != dropped + 1)
+          reject(offset, "returns with " + std::to_string(cells) +
+                             " cells dropping " + std::to_string(dropped));
+        break;
+      }
+      case (Operation::ENTER):
+        reject(offset, "an ENTER which is not a function entry");
+      case (Operation::MKCLOSURE):
+      case (Operation::MKLOCALCLOSURE):
+        // the closure captures the whole frame, the rest of the ENTER are its
+        // arguments
+        if (at(instr.operand).operand < cells)
+          reject(offset, "captures more than its function's frame");
+        after = cells + 1;
+        break;
+      case (Operation::MKGLOBAL):
+      case (Operation::LOADGLOBAL):
+      case (Operation::MUTGLOBAL):
+        global(instr.operand);
+        need(spec.pops);
+        after = cells - spec.pops + spec.pushes;
+        break;
+      case (Operation::GETLOCAL):
+      case (Operation::LOCALCAR):
+      case (Operation::LOCALCDR):
+        local(instr.operand);
+        after = cells + 1;
+        break;
+      case (Operation::SETLOCAL):
+        need(1);
+        local(instr.operand);
+        after = cells - 1;
+        break;
+      case (Operation::GETLOCAL2):
+      case (Operation::ADDLL):
+        // the second local may be the copy of the first, as after GETLOCAL
+        local(ISA::low(instr.operand));
+        local(ISA::high(instr.operand), 1);
+        after = cells + spec.pushes;
+        break;
+      case (Operation::ADDLI):
+        local(ISA::low(instr.operand));
+        after = cells + 1;
+        break;
+      default:
+        need(spec.pops);
+        after = cells - spec.pops + spec.pushes;
+        break;
+      }
+      most = std::max({most, cells, after});
+      if (is_branch(instr.op))
+        reach(offset, instr.operand, after);
+      if (falls_through(instr.op))
+        reach(offset, instr.next, after);
+    }
+    return most;
+  }
+};
+
+} // namespace
+
+Verified verify_bytecode(std::span<const uint8_t> code) {
+  return Walk(code).run();
+}
@@ -5,6 +5,7 @@
 #include <frontend/core.hpp>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
@@ -223,7 +224,8 @@ void print_var(const Var &var, int level) {
 void print_apply(const Apply &apply, int level) {
   std::cout << std::endl;
   print_indent(level);
-  std::cout << "Apply";
+  std::cout << "Apply" << (apply.frame_local ? " (frame local)" : "")
+            << (apply.unchecked ? " (unchecked)" : "");
 
   std::cout << std::endl;
   print_indent(level + 1);
@@ -260,7 +262,7 @@ void print_apply(const Apply &apply, int level) {
 void print_lambda(const Lambda &lambda, int level) {
   std::cout << std::endl;
   print_indent(level);
-  std::cout << "Lambda";
+  std::cout << "Lambda" << (lambda.frame_local ? " (frame local)" : "");
 
   std::cout << std::endl;
   print_indent(level + 1);
@@ -434,4 +436,141 @@ void print_program(const Program &program) {
   std::cout << std::endl;
 }
 
+std::size_t expr_size(const Expr &expr) {
+  return 1 + std::visit(
+                 [](const auto &node) -> std::size_t {
+                   using T = std::decay_t<decltype(node)>;
+                   if constexpr (std::is_same_v<T, Apply>) {
+                     std::size_t size = expr_size(*node.callee);
+                     for (const auto &arg : node.args)
+                       size += expr_size(*arg);
+                     return size;
+                   } else if constexpr (std::is_same_v<T, Lambda>) {
+                     std::size_t size = 0;
+                     for (const auto &stmt : node.body)
+                       size += expr_size(*stmt);
+                     return size;
+                   } else if constexpr (std::is_same_v<T, Cond>) {
+                     return expr_size(*node.condition) +
+                            expr_size(*node.then) +
+                            expr_size(*node.otherwise);
+                   } else if constexpr (std::is_same_v<T, Define> ||
+                                        std::is_same_v<T, Set>) {
+                     return expr_size(*node.rhs);
+                   } else {
+                     return 0;
+                   }
+                 },
+                 expr.node);
+}
+
+std::size_t program_size(const Program &program) {
+  std::size_t size = 0;
+  for (const auto &top : program) {
+    if (auto *def = std::get_if<Define>(&top)) {
+      size += 1 + expr_size(*def->rhs);
+    } else {
+      size += expr_size(std::get<Expr>(top));
+    }
+  }
+  return size;
+}
+
+namespace {
+
+// calls f on every call, lambda and cond of the expression in pre-order
+template <typename F> void each_site(Expr &expr, F &f) {
+  std::visit(
+      [&](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, Apply>) {
+          f(node);
+          each_site(*node.callee, f);
+          for (auto &arg : node.args)
+            each_site(*arg, f);
+        } else if constexpr (std::is_same_v<T, Lambda>) {
+          f(node);
+          for (auto &stmt : node.body)
+            each_site(*stmt, f);
+        } else if constexpr (std::is_same_v<T, Cond>) {
+          f(node);
+          each_site(*node.condition, f);
+          each_site(*node.then, f);
+          each_site(*node.otherwise, f);
+        } else if constexpr (std::is_same_v<T, Define> ||
+                             std::is_same_v<T, Set>) {
+          each_site(*node.rhs, f);
+        }
+      },
+      expr.node);
+}
+
+template <typename F> void each_site(Program &program, F &f) {
+  for (auto &top : program) {
+    if (auto *def = std::get_if<Define>(&top)) {
+      each_site(*def->rhs, f);
+    } else {
+      each_site(std::get<Expr>(top), f);
+    }
+  }
+}
+
+} // namespace
+
+void number_sites(Program &program) {
+  // 0 marks a node without a site
+  uint32_t next = 1;
+  auto number = [&](auto &node) {
+    node.site = next;
+    // a cond has a site for each of its branches
+    next += std::is_same_v<std::decay_t<decltype(node)>, Cond> ? 2 : 1;
+  };
+  each_site(program, number);
+}
+
+void apply_profile(Program &program, const Profile &profile) {
+  auto at = [&](uint32_t site) {
+    auto it = profile.find(site);
+    return site == 0 || it == profile.end() ? SiteCount{} : it->second;
+  };
+  auto annotate = [&](auto &node) {
+    using T = std::decay_t<decltype(node)>;
+    if constexpr (std::is_same_v<T, Cond>) {
+      // the generator lays a cond out with either branch behind the jump
+      const auto to_then = at(node.site);
+      const auto to_otherwise = at(node.site == 0 ? 0 : node.site + 1);
+      node.then_count =
+          to_then.taken + (to_otherwise.count - to_otherwise.taken);
+      node.otherwise_count =
+          to_otherwise.taken + (to_then.count - to_then.taken);
+    } else {
+      node.count = at(node.site).count;
+    }
+  };
+  each_site(program, annotate);
+}
+
+void write_profile(std::ostream &out, const Profile &profile) {
+  out << "# site count taken\n";
+  for (const auto &[site, counts] : profile)
+    out << site << " " << counts.count << " " << counts.taken << "\n";
+}
+
+Profile read_profile(std::istream &in) {
+  Profile profile;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line.front() == '#')
+      continue;
+    std::istringstream fields(line);
+    uint32_t site = 0;
+    SiteCount counts;
+    if (!(fields >> site >> counts.count >> counts.taken))
+      throw std::invalid_argument("malformed profile line: " + line);
+    profile[site].count += counts.count;
+    profile[site].taken += counts.taken;
+  }
+  return profile;
+}
+
 } // namespace core
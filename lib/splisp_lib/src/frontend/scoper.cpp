@@ -9,7 +9,7 @@
 #include <type_traits>
 #include <variant>
 
-Scoper::Scoper() {
+Scoper::Scoper(bool externs) : externs(externs) {
   // create global scope
   root.scope_id = 0;
   root.parent = nullptr;
@@ -183,9 +183,35 @@ Binding Scoper::search(std::string ident, size_t lowest_scope) {
       table = table->parent;
     }
   }
-  throw std::invalid_argument(ident + " symbol not found in any scope");
+  if (!this->externs)
+    throw std::invalid_argument(ident + " symbol not found in any scope");
+  this->externs_.insert(ident);
+  const Binding binding{.kind = BindingKind::FUNC,
+                        .value = this->next_binding_id++};
+  this->root.symbols.emplace(ident, binding);
+  return binding;
 };
 
+std::map<uint64_t, std::string> Scoper::global_names() const {
+  std::map<uint64_t, std::string> names;
+  for (const auto &[name, binding] : this->root.symbols) {
+    if (binding.value >= builtin.size())
+      names.emplace(binding.value, name);
+  }
+  return names;
+}
+
+std::set<uint64_t> Scoper::exported() const {
+  std::set<uint64_t> ids;
+  if (!this->externs)
+    return ids;
+  for (const auto &[id, name] : global_names()) {
+    if (!this->externs_.contains(name))
+      ids.insert(id);
+  }
+  return ids;
+}
+
 void print_symbol_table(std::ostream &os, const SymbolTable &table,
                         size_t indent) {
   const auto kind_name = [](BindingKind kind) -> const char * {
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <frontend/core.hpp>
+#include <middle/middle_end.hpp>
+#include <middle/passes.hpp>
+#include <middle/ssa.hpp>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+void MiddleEnd::run(core::Program &program) {
+  ssa::Builder builder;
+  auto functions = builder.build(program);
+  ssa::SCCP sccp;
+  ssa::GVN gvn;
+  ssa::DeadValues dead_values;
+  for (auto &function : functions) {
+    sccp.run(function);
+    gvn.run(function);
+    dead_values.run(function);
+    collect(function);
+  }
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      rewrite(*def->rhs, def->rhs.get());
+    } else {
+      auto &expr = std::get<core::Expr>(top);
+      rewrite(expr, &expr);
+    }
+  }
+}
+
+void MiddleEnd::collect(const ssa::Function &function) {
+  const auto &values = function.values;
+  std::vector<std::vector<ssa::ValueId>> users(values.size());
+  for (ssa::ValueId id = 0; id < values.size(); id++) {
+    for (auto arg : values[id].args)
+      users[arg].push_back(id);
+  }
+  // an expression can only be replaced when nothing outside of it uses the
+  // values it computes along the way, a set! it contains for instance
+  auto removable = [&](std::pair<ssa::ValueId, ssa::ValueId> range,
+                       ssa::ValueId result) {
+    for (auto id = range.first; id < range.second; id++) {
+      const auto &value = values[id];
+      if (ssa::has_effect(value))
+        return false;
+      // a value its leader already computed has faulted there if at all
+      if (ssa::may_fault(function, value) && function.leader[id] == id)
+        return false;
+      if (id == result || value.op == ssa::Op::PARAM)
+        continue;
+      if (id == function.result)
+        return false;
+      for (auto user : users[id]) {
+        if (user < range.first || user >= range.second)
+          return false;
+      }
+    }
+    return true;
+  };
+
+  for (auto &[expr, value] : function.value_of) {
+    const auto range = function.range_of.at(expr);
+    if (auto *cond = std::get_if<core::Cond>(&expr->node)) {
+      const auto *condition = cond->condition.get();
+      const auto &lattice = function.lattice[function.value_of.at(condition)];
+      if (lattice.kind == ssa::Lattice::CONST &&
+          removable(function.range_of.at(condition),
+                    function.value_of.at(condition))) {
+        this->branches[expr] = lattice.value != 0;
+      }
+    }
+    if (!removable(range, value))
+      continue;
+    bool used = function.live[value];
+    for (auto id = range.first; id < range.second; id++)
+      used = used || function.live[id];
+    if (!used) {
+      this->dead.insert(expr);
+      continue;
+    }
+    const auto &lattice = function.lattice[value];
+    if (lattice.kind == ssa::Lattice::CONST &&
+        !std::holds_alternative<core::Const>(expr->node)) {
+      this->constants[expr] = lattice.value;
+      continue;
+    }
+    // a local already holding the same value replaces the recomputation
+    const auto leader = function.leader[value];
+    if (auto names = function.names_at.find(expr);
+        names != function.names_at.end() && leader != value) {
+      for (auto &[name, held] : names->second) {
+        if (function.leader[held] == leader) {
+          this->copies[expr] = name;
+          break;
+        }
+      }
+    }
+  }
+}
+
+void MiddleEnd::prune(std::vector<std::unique_ptr<core::Expr>> &body) {
+  if (body.empty())
+    return;
+  // the last statement is the value of the body
+  const auto *last = body.back().get();
+  std::erase_if(body, [&](const std::unique_ptr<core::Expr> &stmt) {
+    return stmt.get() != last && this->dead.contains(stmt.get());
+  });
+}
+
+void MiddleEnd::rewrite(core::Expr &expr, const core::Expr *key) {
+  if (auto it = this->constants.find(key); it != this->constants.end()) {
+    expr.node = core::Const{static_cast<uint64_t>(it->second)};
+    return;
+  }
+  if (auto it = this->copies.find(key); it != this->copies.end()) {
+    expr.node = core::Var{it->second};
+    return;
+  }
+  if (auto it = this->branches.find(key); it != this->branches.end()) {
+    auto &cond = std::get<core::Cond>(expr.node);
+    auto taken = std::move(it->second ? cond.then : cond.otherwise);
+    expr.node = std::move(taken->node);
+    rewrite(expr, taken.get());
+    return;
+  }
+  std::visit(
+      [this](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+          if (lam && lam->formals.size() == node.args.size()) {
+            prune(lam->body);
+            for (auto &stmt : lam->body)
+              rewrite(*stmt, stmt.get());
+          } else {
+            rewrite(*node.callee, node.callee.get());
+          }
+          for (auto &arg : node.args)
+            rewrite(*arg, arg.get());
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          prune(node.body);
+          for (auto &stmt : node.body)
+            rewrite(*stmt, stmt.get());
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          rewrite(*node.condition, node.condition.get());
+          rewrite(*node.then, node.then.get());
+          rewrite(*node.otherwise, node.otherwise.get());
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          rewrite(*node.rhs, node.rhs.get());
+        }
+      },
+      expr.node);
+}
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <middle/passes.hpp>
+#include <middle/ssa.hpp>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace ssa {
+
+Lattice SCCP::fold(core::SymbolId builtin, int64_t lhs, int64_t rhs) const {
+  // wrap like the VM does, without signed overflow
+  const auto l = static_cast<uint64_t>(lhs);
+  const auto r = static_cast<uint64_t>(rhs);
+  const bool trap = rhs == 0 ||
+                    (lhs == std::numeric_limits<int64_t>::min() && rhs == -1);
+  auto result = [](auto v) {
+    return Lattice{.kind = Lattice::CONST, .value = static_cast<int64_t>(v)};
+  };
+  // comparisons follow the VM, which tests the second operand against the
+  // first
+  switch (builtin) {
+  case 0:
+    return result(l + r);
+  case 1:
+    return result(l - r);
+  case 2:
+    return result(l * r);
+  case 3:
+    return trap ? Lattice{.kind = Lattice::BOTTOM} : result(lhs / rhs);
+  case 4:
+    return trap ? Lattice{.kind = Lattice::BOTTOM} : result(lhs % rhs);
+  case 10:
+    return result(lhs == rhs);
+  case 11:
+    return result(rhs < lhs);
+  case 12:
+    return result(rhs <= lhs);
+  case 13:
+    return result(rhs >= lhs);
+  case 14:
+    return result(rhs > lhs);
+  default:
+    return {.kind = Lattice::BOTTOM};
+  }
+}
+
+Lattice SCCP::evaluate(const Function &function, ValueId id) const {
+  const auto &value = function.values[id];
+  switch (value.op) {
+  case Op::CONST:
+    return {.kind = Lattice::CONST, .value = value.constant};
+  case Op::COPY:
+    return function.lattice[value.args[0]];
+  case Op::PHI: {
+    // only incoming edges from reachable blocks count
+    const auto &block = function.blocks[value.block];
+    Lattice meet;
+    for (size_t i = 0; i < value.args.size(); i++) {
+      if (!function.reachable[block.preds[i]])
+        continue;
+      const auto &in = function.lattice[value.args[i]];
+      if (in.kind == Lattice::TOP)
+        continue;
+      if (meet.kind == Lattice::TOP) {
+        meet = in;
+      } else if (in.kind == Lattice::BOTTOM || in.value != meet.value) {
+        return {.kind = Lattice::BOTTOM};
+      }
+    }
+    return meet;
+  }
+  case Op::BUILTIN: {
+    for (auto arg : value.args) {
+      if (function.lattice[arg].kind == Lattice::BOTTOM)
+        return {.kind = Lattice::BOTTOM};
+    }
+    for (auto arg : value.args) {
+      if (function.lattice[arg].kind == Lattice::TOP)
+        return {};
+    }
+    if (value.builtin == 9) {
+      // integers are never nil
+      return {.kind = Lattice::CONST, .value = 0};
+    }
+    if (value.args.size() != 2)
+      return {.kind = Lattice::BOTTOM};
+    return fold(value.builtin, function.lattice[value.args[0]].value,
+                function.lattice[value.args[1]].value);
+  }
+  default:
+    return {.kind = Lattice::BOTTOM};
+  }
+}
+
+void SCCP::run(Function &function) {
+  const auto n = function.values.size();
+  function.lattice.assign(n, {});
+  function.reachable.assign(function.blocks.size(), false);
+
+  std::vector<std::vector<ValueId>> users(n);
+  std::vector<std::vector<BlockId>> branches(n);
+  for (ValueId id = 0; id < n; id++) {
+    for (auto arg : function.values[id].args)
+      users[arg].push_back(id);
+  }
+  for (BlockId b = 0; b < function.blocks.size(); b++) {
+    if (function.blocks[b].condition)
+      branches[*function.blocks[b].condition].push_back(b);
+  }
+
+  std::set<std::pair<BlockId, BlockId>> edges;
+  std::vector<BlockId> block_work{0};
+  std::vector<ValueId> value_work;
+  function.reachable[0] = true;
+
+  auto update = [&](ValueId id) {
+    const auto next = evaluate(function, id);
+    auto &current = function.lattice[id];
+    if (next.kind != current.kind || next.value != current.value) {
+      current = next;
+      value_work.push_back(id);
+    }
+  };
+  auto follow = [&](BlockId from, BlockId to) {
+    if (!edges.emplace(from, to).second)
+      return;
+    if (!function.reachable[to]) {
+      function.reachable[to] = true;
+      block_work.push_back(to);
+      return;
+    }
+    for (auto id : function.blocks[to].values) {
+      if (function.values[id].op == Op::PHI)
+        update(id);
+    }
+  };
+  auto terminate = [&](BlockId b) {
+    const auto &block = function.blocks[b];
+    if (!block.condition) {
+      for (auto succ : block.succs)
+        follow(b, succ);
+      return;
+    }
+    const auto &condition = function.lattice[*block.condition];
+    if (condition.kind == Lattice::CONST) {
+      follow(b, block.succs[condition.value != 0 ? 0 : 1]);
+    } else if (condition.kind == Lattice::BOTTOM) {
+      follow(b, block.succs[0]);
+      follow(b, block.succs[1]);
+    }
+  };
+
+  while (!block_work.empty() || !value_work.empty()) {
+    if (!block_work.empty()) {
+      const auto b = block_work.back();
+      block_work.pop_back();
+      for (auto id : function.blocks[b].values)
+        update(id);
+      terminate(b);
+      continue;
+    }
+    const auto id = value_work.back();
+    value_work.pop_back();
+    for (auto user : users[id]) {
+      if (function.reachable[function.values[user].block])
+        update(user);
+    }
+    for (auto b : branches[id]) {
+      if (function.reachable[b])
+        terminate(b);
+    }
+  }
+}
+
+void GVN::run(Function &function) {
+  const auto blocks = function.blocks.size();
+  // blocks are built in topological order, so one sweep finds every idom
+  function.idom.assign(blocks, 0);
+  std::vector<std::vector<BlockId>> children(blocks);
+  for (BlockId b = 1; b < blocks; b++) {
+    const auto &preds = function.blocks[b].preds;
+    auto idom = preds.at(0);
+    for (auto pred : preds) {
+      auto a = pred;
+      while (a != idom) {
+        if (a > idom) {
+          a = function.idom[a];
+        } else {
+          idom = function.idom[idom];
+        }
+      }
+    }
+    function.idom[b] = idom;
+    children[idom].push_back(b);
+  }
+
+  function.leader.resize(function.values.size());
+  for (ValueId id = 0; id < function.values.size(); id++)
+    function.leader[id] = id;
+
+  using Key = std::tuple<Op, int64_t, std::vector<ValueId>>;
+  auto walk = [&](auto &self, BlockId b, std::map<Key, ValueId> table) -> void {
+    for (auto id : function.blocks[b].values) {
+      const auto &value = function.values[id];
+      std::vector<ValueId> args;
+      for (auto arg : value.args)
+        args.push_back(function.leader[arg]);
+      if (value.op == Op::COPY ||
+          (value.op == Op::PHI &&
+           std::all_of(args.begin(), args.end(),
+                       [&](ValueId arg) { return arg == args[0]; }))) {
+        function.leader[id] = args[0];
+        continue;
+      }
+      Key key;
+      if (value.op == Op::CONST) {
+        key = {Op::CONST, value.constant, {}};
+      } else if (value.op == Op::BUILTIN && value.builtin != this->cons_id) {
+        if (this->commutative.contains(value.builtin))
+          std::sort(args.begin(), args.end());
+        key = {Op::BUILTIN, value.builtin, args};
+      } else {
+        continue;
+      }
+      if (auto it = table.find(key); it != table.end()) {
+        function.leader[id] = it->second;
+      } else {
+        table.emplace(key, id);
+      }
+    }
+    for (auto child : children[b])
+      self(self, child, table);
+  };
+  walk(walk, 0, {});
+}
+
+void DeadValues::run(Function &function) {
+  function.live.assign(function.values.size(), false);
+  std::vector<ValueId> work;
+  auto mark = [&](ValueId id) {
+    if (!function.live[id]) {
+      function.live[id] = true;
+      work.push_back(id);
+    }
+  };
+  for (ValueId id = 0; id < function.values.size(); id++) {
+    const auto &value = function.values[id];
+    if (has_effect(value) || may_fault(function, value))
+      mark(id);
+  }
+  for (auto &block : function.blocks) {
+    if (block.condition)
+      mark(*block.condition);
+  }
+  mark(function.result);
+  while (!work.empty()) {
+    const auto id = work.back();
+    work.pop_back();
+    for (auto arg : function.values[id].args)
+      mark(arg);
+  }
+}
+
+} // namespace ssa
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <frontend/core.hpp>
+#include <middle/ssa.hpp>
+#include <type_traits>
+#include <variant>
+
+namespace ssa {
+
+bool may_fault(const Function &function, const Value &value) {
+  if (value.op != Op::BUILTIN || value.builtin > 4)
+    return false;
+  if (value.builtin == 3 || value.builtin == 4)
+    return true;
+  // + - * fault on a closure, a constant operand is always a number
+  return !std::all_of(value.args.begin(), value.args.end(), [&](ValueId arg) {
+    return function.values[arg].op == Op::CONST ||
+           (arg < function.lattice.size() &&
+            function.lattice[arg].kind == Lattice::CONST);
+  });
+}
+
+bool has_effect(const Value &value) {
+  return value.op == Op::CALL || value.op == Op::EFFECT;
+}
+
+std::vector<Function> Builder::build(core::Program &program) {
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      scan(*def->rhs, 0);
+    } else {
+      scan(std::get<core::Expr>(top), 0);
+    }
+  }
+  for (auto &top : program) {
+    begin(0);
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      finish(lower(*def->rhs));
+    } else {
+      finish(lower(std::get<core::Expr>(top)));
+    }
+  }
+  return std::move(this->functions);
+}
+
+void Builder::scan(const core::Expr &expr, size_t function) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          if (auto it = this->owner.find(node.id);
+              it != this->owner.end() && it->second != function) {
+            this->captured.insert(node.id);
+          }
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          if (auto it = this->owner.find(node.name); it != this->owner.end()) {
+            this->assigned.insert(node.name);
+            if (it->second != function) {
+              this->captured.insert(node.name);
+              this->remote_assigned.insert(node.name);
+            }
+          }
+          scan(*node.rhs, function);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          scan(*node.rhs, function);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          scan(*node.condition, function);
+          scan(*node.then, function);
+          scan(*node.otherwise, function);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          const auto inner = ++this->lambdas;
+          this->lambda_index[&node] = inner;
+          for (auto &formal : node.formals)
+            this->owner[*formal] = inner;
+          for (auto &stmt : node.body)
+            scan(*stmt, inner);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+          if (lam && lam->formals.size() == node.args.size()) {
+            // a let runs in the current function
+            for (auto &formal : lam->formals)
+              this->owner[*formal] = function;
+            for (auto &stmt : lam->body)
+              scan(*stmt, function);
+          } else {
+            scan(*node.callee, function);
+          }
+          for (auto &arg : node.args)
+            scan(*arg, function);
+        }
+      },
+      expr.node);
+}
+
+void Builder::begin(size_t index) {
+  this->states.emplace_back();
+  this->states.back().index = index;
+  new_block();
+}
+
+void Builder::finish(ValueId result) {
+  this->states.back().function.result = result;
+  this->functions.push_back(std::move(this->states.back().function));
+  this->states.pop_back();
+}
+
+ValueId Builder::emit(Value value) {
+  auto &state = this->states.back();
+  value.block = state.current;
+  const auto id = state.function.values.size();
+  state.function.values.push_back(std::move(value));
+  state.function.blocks[state.current].values.push_back(id);
+  return id;
+}
+
+BlockId Builder::new_block() {
+  auto &blocks = this->states.back().function.blocks;
+  blocks.emplace_back();
+  return blocks.size() - 1;
+}
+
+void Builder::link(BlockId from, BlockId to) {
+  auto &blocks = this->states.back().function.blocks;
+  blocks[from].succs.push_back(to);
+  blocks[to].preds.push_back(from);
+}
+
+bool Builder::tracked(core::SymbolId id) const {
+  auto it = this->owner.find(id);
+  return it != this->owner.end() && it->second == this->states.back().index &&
+         !this->remote_assigned.contains(id);
+}
+
+ValueId Builder::lower(core::Expr &expr) {
+  const auto start = this->states.back().function.values.size();
+  const auto value = std::visit(
+      [&](auto &node) -> ValueId {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Const>) {
+          return emit({.op = Op::CONST,
+                       .constant = static_cast<int64_t>(node.value)});
+        } else if constexpr (std::is_same_v<T, core::Undef>) {
+          return emit({.op = Op::CONST});
+        } else if constexpr (std::is_same_v<T, core::Var>) {
+          return lower_var(node);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          return lower_set(node);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          return lower_apply(node);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          return lower_cond(node);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          return lower_lambda(node);
+        } else {
+          const auto rhs = lower(*node.rhs);
+          emit({.op = Op::EFFECT, .args = {rhs}});
+          return emit({.op = Op::CONST});
+        }
+      },
+      expr.node);
+  auto &state = this->states.back();
+  state.function.value_of[&expr] = value;
+  state.function.range_of[&expr] = {start, state.function.values.size()};
+  if (value >= start && state.function.values[value].op == Op::BUILTIN) {
+    state.function.names_at[&expr].assign(state.env.begin(), state.env.end());
+  }
+  return value;
+}
+
+ValueId Builder::lower_body(std::vector<std::unique_ptr<core::Expr>> &body) {
+  if (body.empty())
+    return emit({.op = Op::CONST});
+  ValueId result = 0;
+  for (auto &stmt : body)
+    result = lower(*stmt);
+  return result;
+}
+
+ValueId Builder::lower_var(const core::Var &var) {
+  auto &state = this->states.back();
+  auto it = this->owner.find(var.id);
+  if (it == this->owner.end())
+    return emit({.op = Op::READ});
+  if (it->second == state.index) {
+    if (auto local = state.env.find(var.id); local != state.env.end())
+      return emit({.op = Op::COPY, .args = {local->second}});
+    return emit({.op = Op::READ});
+  }
+  if (this->assigned.contains(var.id))
+    return emit({.op = Op::READ});
+  // a capture nobody sets holds the same value for the whole call
+  auto param = state.params.find(var.id);
+  if (param == state.params.end()) {
+    auto &function = state.function;
+    const auto id = function.values.size();
+    function.values.push_back({.op = Op::PARAM, .block = 0});
+    function.blocks[0].values.insert(function.blocks[0].values.begin(), id);
+    param = state.params.emplace(var.id, id).first;
+  }
+  return emit({.op = Op::COPY, .args = {param->second}});
+}
+
+ValueId Builder::lower_set(core::Set &set) {
+  const auto rhs = lower(*set.rhs);
+  if (tracked(set.name)) {
+    this->states.back().env[set.name] = rhs;
+    // closures read the cell, the store itself has to stay
+    if (this->captured.contains(set.name))
+      emit({.op = Op::EFFECT, .args = {rhs}});
+  } else {
+    emit({.op = Op::EFFECT, .args = {rhs}});
+  }
+  // set! leaves a 0 behind
+  return emit({.op = Op::CONST});
+}
+
+ValueId Builder::lower_apply(core::Apply &apply) {
+  std::vector<ValueId> args;
+  if (auto *lam = std::get_if<core::Lambda>(&apply.callee->node);
+      lam && lam->formals.size() == apply.args.size()) {
+    for (auto &arg : apply.args)
+      args.push_back(lower(*arg));
+    for (size_t i = 0; i < args.size(); i++) {
+      if (tracked(*lam->formals[i]))
+        this->states.back().env[*lam->formals[i]] = args[i];
+    }
+    const auto result = lower_body(lam->body);
+    for (auto &formal : lam->formals)
+      this->states.back().env.erase(*formal);
+    return result;
+  }
+  if (auto *var = std::get_if<core::Var>(&apply.callee->node);
+      var && var->id < this->builtin_count && var->id != this->nil_id &&
+      apply.args.size() == (this->unary.contains(var->id) ? 1U : 2U)) {
+    for (auto &arg : apply.args)
+      args.push_back(lower(*arg));
+    return emit({.op = Op::BUILTIN, .builtin = var->id, .args = args});
+  }
+  args.push_back(lower(*apply.callee));
+  for (auto &arg : apply.args)
+    args.push_back(lower(*arg));
+  return emit({.op = Op::CALL, .args = args});
+}
+
+ValueId Builder::lower_cond(core::Cond &cond) {
+  const auto condition = lower(*cond.condition);
+  const auto head = this->states.back().current;
+  const auto then_block = new_block();
+  const auto else_block = new_block();
+  this->states.back().function.blocks[head].condition = condition;
+  link(head, then_block);
+  link(head, else_block);
+  const auto saved = this->states.back().env;
+
+  this->states.back().current = then_block;
+  const auto then = lower(*cond.then);
+  const auto then_end = this->states.back().current;
+  const auto then_env = this->states.back().env;
+
+  this->states.back().env = saved;
+  this->states.back().current = else_block;
+  const auto otherwise = lower(*cond.otherwise);
+  const auto else_end = this->states.back().current;
+  const auto else_env = this->states.back().env;
+
+  const auto join = new_block();
+  link(then_end, join);
+  link(else_end, join);
+  this->states.back().current = join;
+  this->states.back().env = saved;
+  for (auto &[id, value] : saved) {
+    const auto a = then_env.at(id);
+    const auto b = else_env.at(id);
+    this->states.back().env[id] =
+        a == b ? a : emit({.op = Op::PHI, .args = {a, b}});
+  }
+  return then == otherwise ? then
+                           : emit({.op = Op::PHI, .args = {then, otherwise}});
+}
+
+ValueId Builder::lower_lambda(core::Lambda &lambda) {
+  begin(this->lambda_index.at(&lambda));
+  for (auto &formal : lambda.formals) {
+    if (tracked(*formal))
+      this->states.back().env[*formal] = emit({.op = Op::PARAM});
+  }
+  finish(lower_body(lambda.body));
+  // the closure itself
+  return emit({.op = Op::READ});
+}
+
+} // namespace ssa
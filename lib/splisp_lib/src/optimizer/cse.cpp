@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <frontend/core.hpp>
+#include <optimizer/cse.hpp>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace {
+
+// ids referenced, bound and set! within the expression
+void collect(const core::Expr &expr, std::set<core::SymbolId> &ids,
+             std::set<core::SymbolId> &sets) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          ids.insert(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          ids.insert(node.name);
+          sets.insert(node.name);
+          collect(*node.rhs, ids, sets);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          ids.insert(node.name);
+          collect(*node.rhs, ids, sets);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &formal : node.formals)
+            ids.insert(*formal);
+          for (auto &stmt : node.body)
+            collect(*stmt, ids, sets);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          collect(*node.condition, ids, sets);
+          collect(*node.then, ids, sets);
+          collect(*node.otherwise, ids, sets);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          collect(*node.callee, ids, sets);
+          for (auto &arg : node.args)
+            collect(*arg, ids, sets);
+        }
+      },
+      expr.node);
+}
+
+// candidates are trees of builtin applications over variables and constants
+bool same(const core::Expr &a, const core::Expr &b) {
+  if (auto *x = std::get_if<core::Var>(&a.node)) {
+    auto *y = std::get_if<core::Var>(&b.node);
+    return y && x->id == y->id;
+  }
+  if (auto *x = std::get_if<core::Const>(&a.node)) {
+    auto *y = std::get_if<core::Const>(&b.node);
+    return y && x->value == y->value;
+  }
+  auto *x = std::get_if<core::Apply>(&a.node);
+  auto *y = std::get_if<core::Apply>(&b.node);
+  if (!x || !y || x->args.size() != y->args.size() ||
+      !same(*x->callee, *y->callee))
+    return false;
+  for (size_t i = 0; i < x->args.size(); i++) {
+    if (!same(*x->args[i], *y->args[i]))
+      return false;
+  }
+  return true;
+}
+
+core::Expr clone(const core::Expr &expr) {
+  if (auto *apply = std::get_if<core::Apply>(&expr.node)) {
+    core::Apply copy;
+    copy.callee = std::make_unique<core::Expr>(clone(*apply->callee));
+    for (auto &arg : apply->args)
+      copy.args.push_back(std::make_unique<core::Expr>(clone(*arg)));
+    return core::Expr{.node = std::move(copy)};
+  }
+  if (auto *konst = std::get_if<core::Const>(&expr.node))
+    return core::Expr{.node = *konst};
+  return core::Expr{.node = std::get<core::Var>(expr.node)};
+}
+
+// instructions the generator emits for a candidate
+size_t cost(const core::Expr &expr) {
+  size_t n = 1;
+  if (auto *apply = std::get_if<core::Apply>(&expr.node)) {
+    for (auto &arg : apply->args)
+      n += cost(*arg);
+  }
+  return n;
+}
+
+void operands(const core::Expr &expr, std::set<core::SymbolId> &ids) {
+  if (auto *var = std::get_if<core::Var>(&expr.node)) {
+    ids.insert(var->id);
+  } else if (auto *apply = std::get_if<core::Apply>(&expr.node)) {
+    for (auto &arg : apply->args)
+      operands(*arg, ids);
+  }
+}
+
+} // namespace
+
+void CSE::run(core::Program &program) {
+  std::set<core::SymbolId> ids;
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      ids.insert(def->name);
+      collect(*def->rhs, ids, this->assigned);
+    } else {
+      collect(std::get<core::Expr>(top), ids, this->assigned);
+    }
+  }
+  for (auto id : ids)
+    this->next_id = std::max(this->next_id, id + 1);
+
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      visit(*def->rhs, {});
+    } else {
+      visit(std::get<core::Expr>(top), {});
+    }
+  }
+}
+
+void CSE::visit(core::Expr &expr, const std::set<core::SymbolId> &scope) {
+  std::visit(
+      [&](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+          if (lam && lam->formals.size() == node.args.size()) {
+            for (auto &arg : node.args)
+              visit(*arg, scope);
+            auto inner = scope;
+            for (auto &formal : lam->formals)
+              inner.insert(*formal);
+            visit_body(lam->body, inner);
+            return;
+          }
+          visit(*node.callee, scope);
+          for (auto &arg : node.args)
+            visit(*arg, scope);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          // captured locals are read from the closure frame like formals
+          auto inner = scope;
+          for (auto &formal : node.formals)
+            inner.insert(*formal);
+          visit_body(node.body, inner);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          visit(*node.condition, scope);
+          // a branch is a body of its own, a binding there is only made
+          // when the branch is taken
+          for (auto *branch : {&node.then, &node.otherwise}) {
+            std::vector<std::unique_ptr<core::Expr>> body;
+            body.push_back(std::move(*branch));
+            visit_body(body, scope);
+            *branch = std::move(body.front());
+          }
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          visit(*node.rhs, scope);
+        }
+      },
+      expr.node);
+}
+
+void CSE::visit_body(std::vector<std::unique_ptr<core::Expr>> &body,
+                     const std::set<core::SymbolId> &scope) {
+  while (eliminate(body, scope)) {
+  }
+  // the bindings made above end the body, so the statements they enclose
+  // are visited with the temporaries in scope
+  for (auto &stmt : body)
+    visit(*stmt, scope);
+}
+
+bool CSE::eliminate(std::vector<std::unique_ptr<core::Expr>> &body,
+                    const std::set<core::SymbolId> &scope) {
+  std::vector<const core::Expr *> found;
+  for (auto &stmt : body)
+    candidates(*stmt, scope, found);
+  std::vector<const core::Expr *> unique;
+  for (auto *expr : found) {
+    if (std::none_of(unique.begin(), unique.end(),
+                     [&](auto *seen) { return same(*seen, *expr); }))
+      unique.push_back(expr);
+  }
+  // the largest first, its subexpressions are then gone with it
+  std::stable_sort(unique.begin(), unique.end(), [](auto *a, auto *b) {
+    return cost(*a) > cost(*b);
+  });
+
+  for (auto *target : unique) {
+    std::set<core::SymbolId> ids;
+    operands(*target, ids);
+    // a set! of an operand ends the run of occurrences, so later statements
+    // may start a run of their own
+    for (size_t start = 0; start < body.size(); start++) {
+      Walk state{.target = target, .operands = ids};
+      for (auto i = start; i < body.size() && state.valid; i++)
+        walk(*body[i], state);
+      if (!state.hoistable || state.count < 2)
+        continue;
+      // every occurrence but the first saves its instructions, the let
+      // costs a read per occurrence and its NROT and DROP
+      if ((state.count - 1) * cost(*target) <= state.count + 2)
+        continue;
+
+      const auto temp = this->next_id++;
+      auto value = std::make_unique<core::Expr>(clone(*target));
+      // the target itself is among the occurrences replaced
+      Walk rewrite{.target = value.get(), .operands = ids, .temp = &temp};
+      core::Lambda let;
+      let.formals.push_back(std::make_unique<core::SymbolId>(temp));
+      for (auto i = start; i < body.size(); i++) {
+        if (rewrite.valid)
+          walk(*body[i], rewrite);
+        let.body.push_back(std::move(body[i]));
+      }
+      body.resize(start);
+      core::Apply apply;
+      apply.callee =
+          std::make_unique<core::Expr>(core::Expr{.node = std::move(let)});
+      apply.args.push_back(std::move(value));
+      body.push_back(
+          std::make_unique<core::Expr>(core::Expr{.node = std::move(apply)}));
+      return true;
+    }
+  }
+  return false;
+}
+
+void CSE::candidates(const core::Expr &expr,
+                     const std::set<core::SymbolId> &scope,
+                     std::vector<const core::Expr *> &found) const {
+  if (candidate(expr, scope))
+    found.push_back(&expr);
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          // a let body is in the same frame, a closure body is not
+          auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+          if (lam && lam->formals.size() == node.args.size()) {
+            for (auto &stmt : lam->body)
+              candidates(*stmt, scope, found);
+          } else {
+            candidates(*node.callee, scope, found);
+          }
+          for (auto &arg : node.args)
+            candidates(*arg, scope, found);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          candidates(*node.condition, scope, found);
+          candidates(*node.then, scope, found);
+          candidates(*node.otherwise, scope, found);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          candidates(*node.rhs, scope, found);
+        }
+      },
+      expr.node);
+}
+
+void CSE::walk(core::Expr &expr, Walk &state) const {
+  if (!state.valid)
+    return;
+  if (same(expr, *state.target)) {
+    if (state.count == 0)
+      state.hoistable = state.must && state.pure;
+    state.count++;
+    if (state.temp)
+      expr.node = core::Var{*state.temp};
+    return;
+  }
+  std::visit(
+      [&](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          auto *callee = std::get_if<core::Var>(&node.callee->node);
+          if (is_builtin(*node.callee) || (callee && callee->id == cons_id)) {
+            for (auto &arg : node.args)
+              walk(*arg, state);
+            return;
+          }
+          auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+          if (lam && lam->formals.size() == node.args.size()) {
+            for (auto &arg : node.args)
+              walk(*arg, state);
+            for (auto &stmt : lam->body)
+              walk(*stmt, state);
+            return;
+          }
+          walk(*node.callee, state);
+          for (auto &arg : node.args)
+            walk(*arg, state);
+          // the callee may store into any local that is set! somewhere
+          state.pure = false;
+          for (auto id : state.operands) {
+            if (this->assigned.contains(id))
+              state.valid = false;
+          }
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          walk(*node.condition, state);
+          const auto must = state.must;
+          const auto valid = state.valid;
+          const auto pure = state.pure;
+          state.must = false;
+          walk(*node.then, state);
+          const auto then_valid = state.valid;
+          const auto then_pure = state.pure;
+          state.valid = valid;
+          state.pure = pure;
+          walk(*node.otherwise, state);
+          state.valid = state.valid && then_valid;
+          state.pure = state.pure && then_pure;
+          state.must = must;
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          walk(*node.rhs, state);
+          state.pure = false;
+          if (state.operands.contains(node.name))
+            state.valid = false;
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          walk(*node.rhs, state);
+          state.pure = false;
+          state.valid = false;
+        }
+      },
+      expr.node);
+}
+
+bool CSE::candidate(const core::Expr &expr,
+                    const std::set<core::SymbolId> &scope) const {
+  auto *apply = std::get_if<core::Apply>(&expr.node);
+  if (!apply || !is_builtin(*apply->callee))
+    return false;
+  for (auto &arg : apply->args) {
+    if (auto *var = std::get_if<core::Var>(&arg->node)) {
+      if (!scope.contains(var->id))
+        return false;
+    } else if (!std::holds_alternative<core::Const>(arg->node) &&
+               !candidate(*arg, scope)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CSE::is_builtin(const core::Expr &callee) const {
+  auto *var = std::get_if<core::Var>(&callee.node);
+  return var && this->builtins.contains(var->id);
+}
@@ -0,0 +1,153 @@
+#include <frontend/core.hpp>
+#include <optimizer/escape.hpp>
+#include <type_traits>
+#include <variant>
+
+namespace {
+
+// ((lambda (x_i)* body) e_i*) is compiled in the current frame by the generator
+const core::Lambda *as_let(const core::Apply &apply) {
+  if (auto *lam = std::get_if<core::Lambda>(&apply.callee->node)) {
+    if (lam->formals.size() == apply.args.size()) {
+      return lam;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+void EscapeAnalyzer::run(core::Program &program) {
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      visit(*def->rhs);
+    } else {
+      visit(std::get<core::Expr>(top));
+    }
+  }
+}
+
+bool EscapeAnalyzer::is_cons(const core::Expr &expr) const {
+  if (auto *apply = std::get_if<core::Apply>(&expr.node)) {
+    if (auto *var = std::get_if<core::Var>(&apply->callee->node)) {
+      return var->id == cons_id && apply->args.size() == 2;
+    }
+  }
+  return false;
+}
+
+void EscapeAnalyzer::visit(core::Expr &expr) {
+  std::visit(
+      [this](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          if (auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+              lam && as_let(node)) {
+            // a let bound value stays in the frame when the body only calls
+            // it (closures) or only reads through it (pairs)
+            for (size_t i = 0; i < node.args.size(); i++) {
+              const auto id = *lam->formals.at(i);
+              auto &arg = *node.args.at(i);
+              const bool is_lambda =
+                  std::holds_alternative<core::Lambda>(arg.node);
+              if (!is_lambda && !is_cons(arg)) {
+                continue;
+              }
+              const auto use = is_lambda ? CALLEE : PAIR;
+              bool local = true;
+              for (auto &stmt : lam->body) {
+                local = local && contained(*stmt, id, use, false);
+              }
+              if (is_lambda) {
+                std::get<core::Lambda>(arg.node).frame_local = local;
+              } else {
+                std::get<core::Apply>(arg.node).frame_local = local;
+              }
+            }
+          }
+          if (auto *var = std::get_if<core::Var>(&node.callee->node);
+              var && pair_readers.contains(var->id) && node.args.size() == 1 &&
+              is_cons(*node.args.front())) {
+            // (car (cons a b)) consumes the pair immediately
+            std::get<core::Apply>(node.args.front()->node).frame_local = true;
+          }
+          visit(*node.callee);
+          for (auto &arg : node.args)
+            visit(*arg);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &stmt : node.body)
+            visit(*stmt);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          visit(*node.condition);
+          visit(*node.then);
+          visit(*node.otherwise);
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          visit(*node.rhs);
+        }
+      },
+      expr.node);
+}
+
+bool EscapeAnalyzer::contained(const core::Expr &expr, core::SymbolId id,
+                               Use use, bool in_closure) const {
+  return std::visit(
+      [&](const auto &node) -> bool {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          // any reference not matched by an allowed use below escapes
+          return node.id != id;
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          return node.name != id && contained(*node.rhs, id, use, in_closure);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          return contained(*node.rhs, id, use, in_closure);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          return contained(*node.condition, id, use, in_closure) &&
+                 contained(*node.then, id, use, in_closure) &&
+                 contained(*node.otherwise, id, use, in_closure);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          // a closure may be called after the frame is gone
+          for (auto &stmt : node.body) {
+            if (!contained(*stmt, id, use, true))
+              return false;
+          }
+          return true;
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          bool callee_ok = false;
+          if (auto *var = std::get_if<core::Var>(&node.callee->node)) {
+            if (var->id == id) {
+              callee_ok = use == CALLEE && !in_closure;
+            } else if (use == PAIR && !in_closure &&
+                       pair_readers.contains(var->id) &&
+                       node.args.size() == 1) {
+              if (auto *arg = std::get_if<core::Var>(&node.args[0]->node);
+                  arg && arg->id == id) {
+                return true;
+              }
+              callee_ok = true;
+            } else {
+              callee_ok = true;
+            }
+          } else if (auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+                     lam && as_let(node)) {
+            // the body of a let runs in this frame
+            callee_ok = true;
+            for (auto &stmt : lam->body) {
+              callee_ok = callee_ok && contained(*stmt, id, use, in_closure);
+            }
+          } else {
+            callee_ok = contained(*node.callee, id, use, in_closure);
+          }
+          if (!callee_ok)
+            return false;
+          for (auto &arg : node.args) {
+            if (!contained(*arg, id, use, in_closure))
+              return false;
+          }
+          return true;
+        } else {
+          return true;
+        }
+      },
+      expr.node);
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <frontend/core.hpp>
+#include <optimizer/inliner.hpp>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace {
+
+// ids referenced, ids set! and the hottest call count within the
+// expression, and whether it holds a define
+void scan(const core::Expr &expr, std::set<core::SymbolId> &refs,
+          std::set<core::SymbolId> &sets, uint64_t &hottest, bool &defines) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          refs.insert(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          refs.insert(node.name);
+          sets.insert(node.name);
+          scan(*node.rhs, refs, sets, hottest, defines);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          defines = true;
+          refs.insert(node.name);
+          scan(*node.rhs, refs, sets, hottest, defines);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &formal : node.formals)
+            refs.insert(*formal);
+          for (auto &stmt : node.body)
+            scan(*stmt, refs, sets, hottest, defines);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          scan(*node.condition, refs, sets, hottest, defines);
+          scan(*node.then, refs, sets, hottest, defines);
+          scan(*node.otherwise, refs, sets, hottest, defines);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          hottest = std::max(hottest, node.count);
+          scan(*node.callee, refs, sets, hottest, defines);
+          for (auto &arg : node.args)
+            scan(*arg, refs, sets, hottest, defines);
+        }
+      },
+      expr.node);
+}
+
+} // namespace
+
+void Inliner::run(core::Program &program) {
+  std::set<core::SymbolId> refs;
+  std::set<core::SymbolId> sets;
+  std::map<core::SymbolId, size_t> define_count;
+  uint64_t hottest = 0;
+  for (auto &top : program) {
+    bool defines = false;
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      refs.insert(def->name);
+      define_count[def->name]++;
+      scan(*def->rhs, refs, sets, hottest, defines);
+    } else {
+      scan(std::get<core::Expr>(top), refs, sets, hottest, defines);
+    }
+  }
+  if (hottest == 0)
+    return;
+  for (auto id : refs)
+    this->next_id = std::max(this->next_id, id + 1);
+  this->threshold = std::max<uint64_t>(1, hottest / 10);
+
+  for (auto &top : program) {
+    auto *def = std::get_if<core::Define>(&top);
+    if (!def || define_count[def->name] != 1 || sets.contains(def->name) ||
+        !std::holds_alternative<core::Lambda>(def->rhs->node) ||
+        core::expr_size(*def->rhs) > max_size)
+      continue;
+    std::set<core::SymbolId> body_refs;
+    std::set<core::SymbolId> body_sets;
+    uint64_t body_hottest = 0;
+    bool defines = false;
+    scan(*def->rhs, body_refs, body_sets, body_hottest, defines);
+    if (defines || body_refs.contains(def->name))
+      continue;
+    std::map<core::SymbolId, core::SymbolId> renamed;
+    this->functions.emplace(def->name, copy(*def->rhs, renamed));
+  }
+
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      visit(*def->rhs);
+    } else {
+      visit(std::get<core::Expr>(top));
+    }
+  }
+}
+
+void Inliner::visit(core::Expr &expr) {
+  std::visit(
+      [this](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          visit(*node.callee);
+          for (auto &arg : node.args)
+            visit(*arg);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &stmt : node.body)
+            visit(*stmt);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          visit(*node.condition);
+          visit(*node.then);
+          visit(*node.otherwise);
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          visit(*node.rhs);
+        }
+      },
+      expr.node);
+
+  // (f e_i*) -> ((lambda (x_i'*) body') e_i*), the copy is not visited so
+  // a function is inlined one level deep
+  auto *apply = std::get_if<core::Apply>(&expr.node);
+  if (!apply || apply->count < this->threshold)
+    return;
+  auto *callee = std::get_if<core::Var>(&apply->callee->node);
+  if (!callee)
+    return;
+  auto fn = this->functions.find(callee->id);
+  if (fn == this->functions.end())
+    return;
+  const auto &lambda = std::get<core::Lambda>(fn->second.node);
+  if (lambda.formals.size() != apply->args.size())
+    return;
+  std::map<core::SymbolId, core::SymbolId> renamed;
+  auto copied = copy(fn->second, renamed);
+  auto let = std::move(std::get<core::Lambda>(copied.node));
+  let.site = 0;
+  let.count = 0;
+  apply->callee =
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(let)});
+  apply->site = 0;
+  apply->count = 0;
+}
+
+core::Expr Inliner::copy(const core::Expr &expr,
+                         std::map<core::SymbolId, core::SymbolId> &renamed) {
+  auto name = [&](core::SymbolId id) {
+    auto it = renamed.find(id);
+    return it == renamed.end() ? id : it->second;
+  };
+  auto sub = [&](const std::unique_ptr<core::Expr> &e) {
+    return std::make_unique<core::Expr>(copy(*e, renamed));
+  };
+  return std::visit(
+      [&](const auto &node) -> core::Expr {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          return core::Expr{.node = core::Var{name(node.id)}};
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          return core::Expr{
+              .node = core::Set{.name = name(node.name), .rhs = sub(node.rhs)}};
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          return core::Expr{
+              .node = core::Define{.name = node.name, .rhs = sub(node.rhs)}};
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          core::Lambda lam;
+          for (auto &formal : node.formals) {
+            renamed[*formal] = this->next_id;
+            lam.formals.push_back(
+                std::make_unique<core::SymbolId>(this->next_id++));
+          }
+          for (auto &stmt : node.body)
+            lam.body.push_back(sub(stmt));
+          lam.frame_local = node.frame_local;
+          lam.site = node.site;
+          lam.count = node.count;
+          return core::Expr{.node = std::move(lam)};
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          return core::Expr{.node = core::Cond{
+                                .condition = sub(node.condition),
+                                .then = sub(node.then),
+                                .otherwise = sub(node.otherwise),
+                                .site = node.site,
+                                .then_count = node.then_count,
+                                .otherwise_count = node.otherwise_count}};
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          core::Apply copied;
+          copied.callee = sub(node.callee);
+          for (auto &arg : node.args)
+            copied.args.push_back(sub(arg));
+          copied.frame_local = node.frame_local;
+          copied.unchecked = node.unchecked;
+          copied.site = node.site;
+          copied.count = node.count;
+          return core::Expr{.node = std::move(copied)};
+        } else {
+          return core::Expr{.node = node};
+        }
+      },
+      expr.node);
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <frontend/core.hpp>
+#include <optimizer/letrec.hpp>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace {
+
+// ids referenced, ids bound and ids set! within the expression
+void collect(const core::Expr &expr, std::set<core::SymbolId> &refs,
+             std::set<core::SymbolId> &binders,
+             std::set<core::SymbolId> &sets) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          refs.insert(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          refs.insert(node.name);
+          sets.insert(node.name);
+          collect(*node.rhs, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          collect(*node.rhs, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &formal : node.formals)
+            binders.insert(*formal);
+          for (auto &stmt : node.body)
+            collect(*stmt, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          collect(*node.condition, refs, binders, sets);
+          collect(*node.then, refs, binders, sets);
+          collect(*node.otherwise, refs, binders, sets);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          collect(*node.callee, refs, binders, sets);
+          for (auto &arg : node.args)
+            collect(*arg, refs, binders, sets);
+        }
+      },
+      expr.node);
+}
+
+// true when every reference to a name of the group calls it with its arity
+bool calls_only(const core::Expr &expr,
+                const std::map<core::SymbolId, size_t> &arity) {
+  return std::visit(
+      [&](const auto &node) -> bool {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          return !arity.contains(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          return !arity.contains(node.name) && calls_only(*node.rhs, arity);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          return calls_only(*node.rhs, arity);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          return std::all_of(node.body.begin(), node.body.end(),
+                             [&](auto &stmt) {
+                               return calls_only(*stmt, arity);
+                             });
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          return calls_only(*node.condition, arity) &&
+                 calls_only(*node.then, arity) &&
+                 calls_only(*node.otherwise, arity);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          bool ok = true;
+          auto *var = std::get_if<core::Var>(&node.callee->node);
+          if (var && arity.contains(var->id)) {
+            ok = arity.at(var->id) == node.args.size();
+          } else {
+            ok = calls_only(*node.callee, arity);
+          }
+          return ok && std::all_of(node.args.begin(), node.args.end(),
+                                   [&](auto &arg) {
+                                     return calls_only(*arg, arity);
+                                   });
+        } else {
+          return true;
+        }
+      },
+      expr.node);
+}
+
+} // namespace
+
+void LetrecFixer::run(core::Program &program) {
+  std::set<core::SymbolId> refs;
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      refs.insert(def->name);
+      collect(*def->rhs, refs, this->locals, this->assigned);
+    } else {
+      collect(std::get<core::Expr>(top), refs, this->locals, this->assigned);
+    }
+  }
+  for (auto id : refs)
+    this->next_id = std::max(this->next_id, id + 1);
+  for (auto id : this->locals)
+    this->next_id = std::max(this->next_id, id + 1);
+
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      visit(*def->rhs);
+    } else {
+      visit(std::get<core::Expr>(top));
+    }
+  }
+  // lifted bodies may hold groups of their own
+  for (size_t i = 0; i < this->lifted.size(); i++)
+    visit(*this->lifted[i].rhs);
+  program.insert(program.begin(), std::make_move_iterator(this->lifted.begin()),
+                 std::make_move_iterator(this->lifted.end()));
+  this->lifted.clear();
+}
+
+void LetrecFixer::visit(core::Expr &expr) {
+  // outer groups first, so inner groups calling them see global functions
+  while (fix(expr)) {
+  }
+  std::visit(
+      [this](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Apply>) {
+          visit(*node.callee);
+          for (auto &arg : node.args)
+            visit(*arg);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &stmt : node.body)
+            visit(*stmt);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          visit(*node.condition);
+          visit(*node.then);
+          visit(*node.otherwise);
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          visit(*node.rhs);
+        }
+      },
+      expr.node);
+}
+
+bool LetrecFixer::fix(core::Expr &expr) {
+  // ((lambda (f_i)* (set! f_i lambda_i)* body*) Undef*)
+  auto *apply = std::get_if<core::Apply>(&expr.node);
+  if (!apply)
+    return false;
+  auto *let = std::get_if<core::Lambda>(&apply->callee->node);
+  const auto k = apply->args.size();
+  if (!let || k == 0 || let->formals.size() != k || let->body.size() <= k)
+    return false;
+  std::map<core::SymbolId, size_t> arity;
+  for (size_t i = 0; i < k; i++) {
+    auto *set = std::get_if<core::Set>(&let->body[i]->node);
+    if (!std::holds_alternative<core::Undef>(apply->args[i]->node) || !set ||
+        set->name != *let->formals[i])
+      return false;
+    auto *lam = std::get_if<core::Lambda>(&set->rhs->node);
+    if (!lam)
+      return false;
+    arity[set->name] = lam->formals.size();
+  }
+  for (size_t i = 0; i < let->body.size(); i++) {
+    // the initial stores are not references
+    const auto &stmt =
+        i < k ? *std::get<core::Set>(let->body[i]->node).rhs : *let->body[i];
+    if (!calls_only(stmt, arity))
+      return false;
+  }
+
+  // the locals the group closes over, in id order
+  std::vector<core::SymbolId> free;
+  for (size_t i = 0; i < k; i++) {
+    std::set<core::SymbolId> refs, binders, sets;
+    collect(*std::get<core::Set>(let->body[i]->node).rhs, refs, binders, sets);
+    for (auto id : refs) {
+      if (this->locals.contains(id) && !binders.contains(id) &&
+          !arity.contains(id) &&
+          std::find(free.begin(), free.end(), id) == free.end()) {
+        free.push_back(id);
+      }
+    }
+  }
+  std::sort(free.begin(), free.end());
+  for (auto id : free) {
+    // a copy passed as an argument would not see later stores
+    if (this->assigned.contains(id))
+      return false;
+  }
+
+  std::map<core::SymbolId, core::SymbolId> group;
+  for (auto &formal : let->formals)
+    group[*formal] = this->next_id++;
+  for (size_t i = 0; i < k; i++) {
+    auto &set = std::get<core::Set>(let->body[i]->node);
+    auto &lam = std::get<core::Lambda>(set.rhs->node);
+    std::map<core::SymbolId, core::SymbolId> subst;
+    std::vector<std::unique_ptr<core::SymbolId>> formals;
+    for (auto id : free) {
+      subst[id] = this->next_id;
+      this->locals.insert(this->next_id);
+      formals.push_back(std::make_unique<core::SymbolId>(this->next_id++));
+    }
+    for (auto &formal : lam.formals)
+      formals.push_back(std::move(formal));
+    lam.formals = std::move(formals);
+    for (auto &stmt : lam.body)
+      rewrite(*stmt, subst, group, free);
+    this->lifted.push_back(
+        core::Define{.name = group.at(set.name), .rhs = std::move(set.rhs)});
+  }
+
+  std::vector<std::unique_ptr<core::Expr>> body;
+  for (size_t i = k; i < let->body.size(); i++) {
+    rewrite(*let->body[i], {}, group, free);
+    body.push_back(std::move(let->body[i]));
+  }
+  if (body.size() == 1) {
+    auto stmt = std::move(body.front());
+    expr.node = std::move(stmt->node);
+  } else {
+    // a let without bindings keeps the statements in sequence
+    core::Lambda lam;
+    lam.body = std::move(body);
+    core::Apply seq;
+    seq.callee =
+        std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)});
+    expr.node = std::move(seq);
+  }
+  return true;
+}
+
+void LetrecFixer::rewrite(
+    core::Expr &expr, const std::map<core::SymbolId, core::SymbolId> &subst,
+    const std::map<core::SymbolId, core::SymbolId> &group,
+    const std::vector<core::SymbolId> &free) const {
+  std::visit(
+      [&](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          if (auto it = subst.find(node.id); it != subst.end())
+            node.id = it->second;
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          rewrite(*node.rhs, subst, group, free);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          rewrite(*node.rhs, subst, group, free);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &stmt : node.body)
+            rewrite(*stmt, subst, group, free);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          rewrite(*node.condition, subst, group, free);
+          rewrite(*node.then, subst, group, free);
+          rewrite(*node.otherwise, subst, group, free);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          for (auto &arg : node.args)
+            rewrite(*arg, subst, group, free);
+          auto *var = std::get_if<core::Var>(&node.callee->node);
+          if (var && group.contains(var->id)) {
+            var->id = group.at(var->id);
+            std::vector<std::unique_ptr<core::Expr>> args;
+            for (auto id : free) {
+              auto it = subst.find(id);
+              args.push_back(std::make_unique<core::Expr>(core::Expr{
+                  .node = core::Var{it == subst.end() ? id : it->second}}));
+            }
+            for (auto &arg : node.args)
+              args.push_back(std::move(arg));
+            node.args = std::move(args);
+          } else {
+            rewrite(*node.callee, subst, group, free);
+          }
+        }
+      },
+      expr.node);
+}
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <backend/generator/generator.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <middle/middle_end.hpp>
+#include <optimizer/cse.hpp>
+#include <optimizer/escape.hpp>
+#include <optimizer/inliner.hpp>
+#include <optimizer/letrec.hpp>
+#include <optimizer/pass_manager.hpp>
+#include <optimizer/peephole.hpp>
+#include <optimizer/shaker.hpp>
+#include <optimizer/superinstructions.hpp>
+#include <optimizer/typer.hpp>
+#include <utility>
+
+namespace {
+
+template <typename F> double time_millis(F &&f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+std::optional<OptLevel> parse_opt_level(const std::string &flag) {
+  if (flag == "-O0")
+    return OptLevel::O0;
+  if (flag == "-O1")
+    return OptLevel::O1;
+  if (flag == "-O2")
+    return OptLevel::O2;
+  return std::nullopt;
+}
+
+PassManager PassManager::pipeline(OptLevel level,
+                                  const core::Profile *profile,
+                                  const std::set<core::SymbolId> &exported) {
+  PassManager manager;
+  // -O1 keeps to the cheap syntax directed passes, -O2 adds the SSA middle
+  // end after letrec fixing (which removes the set! it cannot see through)
+  // so the shaker sees what it folded away, and the typer last so it sees the
+  // final shape of the tree
+  if (level != OptLevel::O0 && profile) {
+    manager.add_core("profile", [profile = *profile](core::Program &program) {
+      core::apply_profile(program, profile);
+    });
+  }
+  if (level != OptLevel::O0) {
+    manager.add_core("letrec", [](core::Program &program) {
+      LetrecFixer fixer;
+      fixer.run(program);
+    });
+  }
+  if (level != OptLevel::O0 && profile) {
+    // ahead of the middle end, which then folds the inlined bodies
+    manager.add_core("inline", [](core::Program &program) {
+      Inliner inliner;
+      inliner.run(program);
+    });
+  }
+  if (level == OptLevel::O2) {
+    manager.add_core("middle-end", [](core::Program &program) {
+      MiddleEnd middle_end;
+      middle_end.run(program);
+    });
+  }
+  if (level != OptLevel::O0) {
+    manager.add_core("cse", [](core::Program &program) {
+      CSE cse;
+      cse.run(program);
+    });
+    manager.add_core("shaker", [exported](core::Program &program) {
+      Shaker shaker(exported);
+      shaker.run(program);
+    });
+    manager.add_core("escape", [](core::Program &program) {
+      EscapeAnalyzer escape;
+      escape.run(program);
+    });
+    manager.add_bytecode("peephole", [](std::vector<ISA::Instruction> &code) {
+      Peephole peephole;
+      peephole.run(code);
+    });
+  }
+  if (level == OptLevel::O2) {
+    manager.add_core("typer", [exported](core::Program &program) {
+      Typer typer(exported);
+      typer.run(program);
+    });
+    manager.add_bytecode("superinstructions",
+                         [](std::vector<ISA::Instruction> &code) {
+                           Superinstructions superinstructions;
+                           superinstructions.run(code);
+                         });
+  }
+  return manager;
+}
+
+void PassManager::add_core(std::string name, CorePass pass) {
+  this->core_passes.emplace_back(std::move(name), std::move(pass));
+}
+
+void PassManager::add_bytecode(std::string name, BytecodePass pass) {
+  this->bytecode_passes.emplace_back(std::move(name), std::move(pass));
+}
+
+void PassManager::run_core(core::Program &program) {
+  this->reports_.clear();
+  core::number_sites(program);
+  for (auto &[name, pass] : this->core_passes) {
+    PassReport report{.name = name, .ir_before = core::program_size(program)};
+    report.millis = time_millis([&] { pass(program); });
+    report.ir_after = core::program_size(program);
+    this->reports_.push_back(report);
+  }
+}
+
+std::vector<ISA::Instruction> PassManager::run(core::Program &program) {
+  run_core(program);
+  const auto ir_size = core::program_size(program);
+  std::vector<ISA::Instruction> bytecode;
+  PassReport codegen{.name = "codegen", .ir_before = ir_size,
+                     .ir_after = ir_size};
+  codegen.millis = time_millis([&] {
+    Generator gen(program);
+    bytecode = gen.generate();
+    this->global_ids_ = gen.global_ids();
+    this->halt_depth_ = gen.halt_depth();
+  });
+  codegen.bytecode_after = bytecode.size();
+  this->reports_.push_back(codegen);
+  for (auto &[name, pass] : this->bytecode_passes) {
+    PassReport report{.name = name,
+                      .ir_before = ir_size,
+                      .ir_after = ir_size,
+                      .bytecode_before = bytecode.size()};
+    report.millis = time_millis([&] { pass(bytecode); });
+    report.bytecode_after = bytecode.size();
+    this->reports_.push_back(report);
+  }
+  return bytecode;
+}
+
+void PassManager::print_reports() const {
+  // the name column fits the longest name, or the header, with two spaces
+  // to spare
+  size_t width = 4;
+  for (const auto &report : this->reports_)
+    width = std::max(width, report.name.size());
+  width += 2;
+  std::cerr << std::left << std::setw(width) << "pass" << std::right
+            << std::setw(10) << "ms" << std::setw(14) << "ir" << std::setw(14)
+            << "bytecode" << "\n";
+  for (const auto &report : this->reports_) {
+    std::cerr << std::left << std::setw(width) << report.name << std::right
+              << std::setw(10) << std::fixed << std::setprecision(3)
+              << report.millis << std::setw(7) << report.ir_before << " ->"
+              << std::setw(5) << report.ir_after << std::setw(7)
+              << report.bytecode_before << " ->" << std::setw(5)
+              << report.bytecode_after << "\n";
+  }
+}
@@ -0,0 +1,181 @@
+#include <backend/isa/isa.hpp>
+#include <cstdint>
+#include <optimizer/peephole.hpp>
+
+void Peephole::run(std::vector<ISA::Instruction> &code) {
+  // threading can expose a JMP to the next instruction, fusing can expose a
+  // JMP to a return
+  bool changed = true;
+  while (changed) {
+    changed = fuse(code);
+    changed = thread(code) || changed;
+    changed = prune(code) || changed;
+  }
+}
+
+bool Peephole::fuse(std::vector<ISA::Instruction> &code) const {
+  const auto jumped_to = ISA::jump_targets(code);
+  std::vector<ISA::Instruction> out;
+  // old instruction index -> index of the instruction replacing it, a
+  // removed instruction maps to whatever follows it
+  std::vector<size_t> moved(code.size() + 1);
+  // true when instructions i + 1 through i + n - 1 exist and nothing jumps
+  // into the middle of the sequence
+  auto sequence = [&](size_t i, size_t n) {
+    if (i + n > code.size())
+      return false;
+    for (size_t j = i + 1; j < i + n; j++) {
+      if (jumped_to.contains(j))
+        return false;
+    }
+    return true;
+  };
+  auto operand = [&](size_t i) { return code[i].operand.value_or(0); };
+
+  size_t i = 0;
+  while (i < code.size()) {
+    const auto op = code[i].op;
+    size_t length = 1;
+    moved[i] = out.size();
+    if (op == ISA::Operation::PUSH && sequence(i, 2) &&
+        (code[i + 1].op == ISA::Operation::ADD ||
+         code[i + 1].op == ISA::Operation::UADD ||
+         code[i + 1].op == ISA::Operation::SUB ||
+         code[i + 1].op == ISA::Operation::USUB)) {
+      // PUSH k; ADD -> ADDI k, a subtraction adds -k
+      const auto next = code[i + 1].op;
+      const bool add =
+          next == ISA::Operation::ADD || next == ISA::Operation::UADD;
+      const bool unchecked =
+          next == ISA::Operation::UADD || next == ISA::Operation::USUB;
+      const auto imm = add ? operand(i) : uint64_t{0} - operand(i);
+      if (unchecked && operand(i) == 1) {
+        out.push_back({add ? ISA::Operation::INC : ISA::Operation::DEC,
+                       std::nullopt});
+      } else {
+        out.push_back({ISA::Operation::ADDI, imm});
+      }
+      length = 2;
+    } else if (auto it = this->fused_branches.find(op);
+               it != this->fused_branches.end() && sequence(i, 2) &&
+               code[i + 1].op == ISA::Operation::CJMP) {
+      // LT; CJMP l -> JLT l, the branch keeps its profile site
+      out.push_back({it->second, code[i + 1].operand, code[i + 1].site});
+      length = 2;
+    } else if (auto it = this->negated_branches.find(op);
+               it != this->negated_branches.end() && sequence(i, 2) &&
+               code[i + 1].op == ISA::Operation::CJMPZ) {
+      // LT; CJMPZ l -> JGE l
+      out.push_back({it->second, code[i + 1].operand, code[i + 1].site});
+      length = 2;
+    } else if (op == ISA::Operation::NROT && sequence(i, 3) &&
+               code[i + 1].op == ISA::Operation::DROP &&
+               code[i + 2].op == ISA::Operation::RET &&
+               operand(i) == operand(i + 1) + 1) {
+      // NROT n+1; DROP n; RET -> RETN n, a frame of no cells just returns
+      const auto n = operand(i + 1);
+      if (n == 0) {
+        out.push_back({ISA::Operation::RET, std::nullopt});
+      } else {
+        out.push_back({ISA::Operation::RETN, n});
+      }
+      length = 3;
+    } else if ((op == ISA::Operation::NROT && operand(i) == 1) ||
+               (op == ISA::Operation::DROP && operand(i) == 0) ||
+               (op == ISA::Operation::JMP && operand(i) == i + 1)) {
+      // no-ops
+      length = 0;
+    } else {
+      out.push_back(code[i]);
+    }
+    // nothing jumps into the sequence, but give it a sane mapping anyway
+    for (size_t j = i + 1; j < i + length; j++)
+      moved[j] = moved[i];
+    i += length == 0 ? 1 : length;
+  }
+  moved[code.size()] = out.size();
+
+  if (out.size() == code.size())
+    return false;
+  ISA::relocate(out, moved);
+  code = std::move(out);
+  return true;
+}
+
+bool Peephole::thread(std::vector<ISA::Instruction> &code) const {
+  bool changed = false;
+  for (auto &instr : code) {
+    if (!is_branch(instr.op) || !instr.operand)
+      continue;
+    auto target = *instr.operand;
+    // a cycle of JMPs is left alone
+    for (size_t steps = 0; steps < code.size() && target < code.size() &&
+                           code[target].op == ISA::Operation::JMP;
+         steps++) {
+      target = code[target].operand.value_or(0);
+    }
+    if (target >= code.size() || code[target].op == ISA::Operation::JMP)
+      continue;
+    if (target != *instr.operand) {
+      instr.operand = target;
+      changed = true;
+    }
+    if (instr.op == ISA::Operation::JMP &&
+        (code[target].op == ISA::Operation::RET ||
+         code[target].op == ISA::Operation::RETN ||
+         code[target].op == ISA::Operation::HALT)) {
+      instr = code[target];
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool Peephole::prune(std::vector<ISA::Instruction> &code) const {
+  // a tail call does not come back, what follows it is dead up to the next
+  // instruction something jumps to
+  const auto jumped_to = ISA::jump_targets(code);
+  std::vector<ISA::Instruction> out;
+  std::vector<size_t> moved(code.size() + 1);
+  bool dead = false;
+  for (size_t i = 0; i < code.size(); i++) {
+    moved[i] = out.size();
+    dead = dead && !jumped_to.contains(i);
+    if (dead)
+      continue;
+    out.push_back(code[i]);
+    dead = is_tail_call(code[i].op);
+  }
+  moved[code.size()] = out.size();
+
+  if (out.size() == code.size())
+    return false;
+  ISA::relocate(out, moved);
+  code = std::move(out);
+  return true;
+}
+
+bool Peephole::is_tail_call(ISA::Operation op) {
+  return op == ISA::Operation::TAILCALL ||
+         op == ISA::Operation::TAILCALLGLOBAL ||
+         op == ISA::Operation::TAILCALLDIRECT;
+}
+
+bool Peephole::is_branch(ISA::Operation op) {
+  switch (op) {
+  case (ISA::Operation::JMP):
+  case (ISA::Operation::CJMP):
+  case (ISA::Operation::CJMPZ):
+  case (ISA::Operation::JLT):
+  case (ISA::Operation::JLE):
+  case (ISA::Operation::JEQ):
+  case (ISA::Operation::JNE):
+  case (ISA::Operation::JGE):
+  case (ISA::Operation::JGT):
+  case (ISA::Operation::JNULL):
+  case (ISA::Operation::JNNULL):
+    return true;
+  default:
+    return false;
+  }
+}
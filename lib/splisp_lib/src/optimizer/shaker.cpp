@@ -0,0 +1,163 @@
+#include <frontend/core.hpp>
+#include <optimizer/shaker.hpp>
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+void Shaker::run(core::Program &program) {
+  // roots are the top level expressions, exported defines and any define
+  // whose rhs has an effect, everything reachable from them through global
+  // references is live
+  std::set<core::SymbolId> live;
+  std::vector<const core::Expr *> worklist;
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      if (!is_pure(*def->rhs) || this->exported.contains(def->name)) {
+        live.insert(def->name);
+        worklist.push_back(def->rhs.get());
+      }
+    } else {
+      worklist.push_back(&std::get<core::Expr>(top));
+    }
+  }
+  while (!worklist.empty()) {
+    const auto *expr = worklist.back();
+    worklist.pop_back();
+    std::set<core::SymbolId> refs;
+    collect(*expr, refs);
+    for (auto id : refs) {
+      if (live.contains(id)) {
+        continue;
+      }
+      live.insert(id);
+      for (auto &top : program) {
+        if (auto *def = std::get_if<core::Define>(&top);
+            def && def->name == id) {
+          worklist.push_back(def->rhs.get());
+        }
+      }
+    }
+  }
+
+  std::erase_if(program, [&live](const core::Top &top) {
+    auto *def = std::get_if<core::Define>(&top);
+    return def && !live.contains(def->name);
+  });
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      prune(*def->rhs);
+    } else {
+      prune(std::get<core::Expr>(top));
+    }
+  }
+}
+
+void Shaker::collect(const core::Expr &expr,
+                     std::set<core::SymbolId> &refs) const {
+  std::visit(
+      [this, &refs](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          refs.insert(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          refs.insert(node.name);
+          collect(*node.rhs, refs);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          collect(*node.callee, refs);
+          for (auto &arg : node.args)
+            collect(*arg, refs);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          for (auto &expr : node.body)
+            collect(*expr, refs);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          collect(*node.condition, refs);
+          collect(*node.then, refs);
+          collect(*node.otherwise, refs);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          refs.insert(node.name);
+          collect(*node.rhs, refs);
+        }
+      },
+      expr.node);
+}
+
+bool Shaker::is_pure(const core::Expr &expr) const {
+  return std::visit(
+      [this](const auto &node) -> bool {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Const> ||
+                      std::is_same_v<T, core::Var> ||
+                      std::is_same_v<T, core::Undef> ||
+                      std::is_same_v<T, core::Lambda>) {
+          // creating a closure has no effect until it is called
+          return true;
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          return is_pure(*node.condition) && is_pure(*node.then) &&
+                 is_pure(*node.otherwise);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          for (auto &arg : node.args) {
+            if (!is_pure(*arg))
+              return false;
+          }
+          if (auto *var = std::get_if<core::Var>(&node.callee->node)) {
+            if (arithmetic.contains(var->id)) {
+              return node.unchecked ||
+                     std::all_of(node.args.begin(), node.args.end(),
+                                 [](const auto &arg) {
+                                   return std::holds_alternative<core::Const>(
+                                       arg->node);
+                                 });
+            }
+            return pure_builtins.contains(var->id);
+          }
+          // a let is as pure as its body
+          if (auto *lam = std::get_if<core::Lambda>(&node.callee->node)) {
+            if (lam->formals.size() != node.args.size())
+              return false;
+            for (auto &expr : lam->body) {
+              if (!is_pure(*expr))
+                return false;
+            }
+            return true;
+          }
+          return false;
+        } else {
+          return false;
+        }
+      },
+      expr.node);
+}
+
+void Shaker::prune(core::Expr &expr) {
+  std::visit(
+      [this](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Lambda>) {
+          // every statement but the last has its value dropped
+          if (node.body.size() > 1) {
+            auto last = std::move(node.body.back());
+            node.body.pop_back();
+            std::erase_if(node.body,
+                          [this](const auto &stmt) { return is_pure(*stmt); });
+            node.body.push_back(std::move(last));
+          }
+          for (auto &expr : node.body)
+            prune(*expr);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          prune(*node.callee);
+          for (auto &arg : node.args)
+            prune(*arg);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          prune(*node.condition);
+          prune(*node.then);
+          prune(*node.otherwise);
+        } else if constexpr (std::is_same_v<T, core::Set> ||
+                             std::is_same_v<T, core::Define>) {
+          prune(*node.rhs);
+        }
+      },
+      expr.node);
+}
@@ -0,0 +1,119 @@
+#include <backend/isa/isa.hpp>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optimizer/superinstructions.hpp>
+
+void Superinstructions::run(std::vector<ISA::Instruction> &code) const {
+  const auto targets = ISA::jump_targets(code);
+  // LOADGLOBAL index -> the CALL it feeds
+  std::map<size_t, size_t> calls;
+  std::set<size_t> loads;
+  for (size_t i = 0; i < code.size(); i++) {
+    if (code[i].op != ISA::Operation::LOADGLOBAL)
+      continue;
+    if (auto call = global_call(code, i, targets)) {
+      calls[*call] = i;
+      loads.insert(i);
+    }
+  }
+
+  std::vector<ISA::Instruction> out;
+  std::vector<size_t> moved(code.size() + 1);
+  auto fits = [](uint64_t value) {
+    return value <= std::numeric_limits<uint32_t>::max();
+  };
+  // true when the n instructions from i exist, are GETLOCALs up to the last
+  // one and nothing jumps into the middle of them
+  auto locals = [&](size_t i, size_t n) {
+    if (i + n > code.size())
+      return false;
+    for (size_t j = i; j < i + n; j++) {
+      if (j > i && targets.contains(j))
+        return false;
+      if (j + 1 < i + n && (code[j].op != ISA::Operation::GETLOCAL ||
+                            !fits(code[j].operand.value_or(0))))
+        return false;
+    }
+    return true;
+  };
+  auto operand = [&](size_t i) { return code[i].operand.value_or(0); };
+
+  size_t i = 0;
+  while (i < code.size()) {
+    const auto op = code[i].op;
+    size_t length = 1;
+    moved[i] = out.size();
+    if (loads.contains(i)) {
+      // the CALL reads the global itself
+      length = 0;
+    } else if (auto call = calls.find(i); call != calls.end()) {
+      const auto global = code[call->second].operand.value_or(0);
+      out.push_back({op == ISA::Operation::CALL
+                         ? ISA::Operation::CALLGLOBAL
+                         : ISA::Operation::TAILCALLGLOBAL,
+                     ISA::pack(global, operand(i)), code[i].site});
+    } else if (locals(i, 3) &&
+               code[i + 1].op == ISA::Operation::GETLOCAL &&
+               (code[i + 2].op == ISA::Operation::ADD ||
+                code[i + 2].op == ISA::Operation::UADD)) {
+      out.push_back(
+          {ISA::Operation::ADDLL, ISA::pack(operand(i), operand(i + 1))});
+      length = 3;
+    } else if (locals(i, 2) && code[i + 1].op == ISA::Operation::ADDI &&
+               static_cast<int64_t>(operand(i + 1)) ==
+                   static_cast<int32_t>(operand(i + 1))) {
+      out.push_back({ISA::Operation::ADDLI,
+                     ISA::pack(operand(i), static_cast<uint32_t>(
+                                               operand(i + 1)))});
+      length = 2;
+    } else if (locals(i, 2) && (code[i + 1].op == ISA::Operation::CAR ||
+                                code[i + 1].op == ISA::Operation::UCAR)) {
+      out.push_back({ISA::Operation::LOCALCAR, operand(i)});
+      length = 2;
+    } else if (locals(i, 2) && (code[i + 1].op == ISA::Operation::CDR ||
+                                code[i + 1].op == ISA::Operation::UCDR)) {
+      out.push_back({ISA::Operation::LOCALCDR, operand(i)});
+      length = 2;
+    } else if (locals(i, 2) && code[i + 1].op == ISA::Operation::GETLOCAL &&
+               fits(operand(i + 1))) {
+      out.push_back(
+          {ISA::Operation::GETLOCAL2, ISA::pack(operand(i), operand(i + 1))});
+      length = 2;
+    } else {
+      out.push_back(code[i]);
+    }
+    for (size_t j = i + 1; j < i + length; j++)
+      moved[j] = moved[i];
+    i += length == 0 ? 1 : length;
+  }
+  moved[code.size()] = out.size();
+
+  ISA::relocate(out, moved);
+  code = std::move(out);
+}
+
+std::optional<size_t>
+Superinstructions::global_call(const std::vector<ISA::Instruction> &code,
+                               size_t i,
+                               const std::set<size_t> &targets) const {
+  if (code[i].operand.value_or(0) > std::numeric_limits<uint32_t>::max())
+    return std::nullopt;
+  // cells pushed above the closure handle so far
+  size_t depth = 0;
+  for (auto j = i + 1; j < code.size() && !targets.contains(j); j++) {
+    const auto op = code[j].op;
+    if (op == ISA::Operation::CALL || op == ISA::Operation::TAILCALL) {
+      if (code[j].operand.value_or(0) != depth)
+        return std::nullopt;
+      return j;
+    }
+    if (!this->argument_ops.contains(op))
+      return std::nullopt;
+    const auto &spec = ISA::spec_list[static_cast<uint8_t>(op)];
+    if (depth < spec.pops)
+      return std::nullopt;
+    depth = depth + spec.pushes - spec.pops;
+  }
+  return std::nullopt;
+}
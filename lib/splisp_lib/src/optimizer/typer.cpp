@@ -0,0 +1,242 @@
+#include <frontend/core.hpp>
+#include <optimizer/typer.hpp>
+#include <type_traits>
+#include <variant>
+
+namespace {
+
+// ((lambda (x_i)* body) e_i*) binds its formals in the current frame
+core::Lambda *as_let(core::Apply &apply) {
+  if (auto *lam = std::get_if<core::Lambda>(&apply.callee->node)) {
+    if (lam->formals.size() == apply.args.size()) {
+      return lam;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+void Typer::run(core::Program &program) {
+  for (auto &top : program) {
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      this->definitions[def->name]++;
+      scan(*def->rhs, 0);
+    } else {
+      scan(std::get<core::Expr>(top), 0);
+    }
+  }
+  for (auto &top : program) {
+    auto *def = std::get_if<core::Define>(&top);
+    if (!def || this->definitions[def->name] != 1)
+      continue;
+    this->globals[def->name] = NONE;
+    auto *lam = std::get_if<core::Lambda>(&def->rhs->node);
+    if (lam && !this->escaping.contains(def->name)) {
+      this->known[def->name] = lam;
+      this->known_lambdas[lam] = def->name;
+      this->params[def->name].assign(lam->formals.size(), NONE);
+      this->results[def->name] = NONE;
+    }
+  }
+  // every type only grows, so this terminates
+  do {
+    this->changed = false;
+    pass(program);
+  } while (this->changed);
+  this->mark = true;
+  pass(program);
+}
+
+Typer::Type Typer::join(Type a, Type b) {
+  if (a == NONE || a == b)
+    return b;
+  if (b == NONE)
+    return a;
+  return UNKNOWN;
+}
+
+void Typer::scan(const core::Expr &expr, size_t function) {
+  std::visit(
+      [&](const auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Var>) {
+          // a reference outside callee position may call it from anywhere
+          this->escaping.insert(node.id);
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          if (auto it = this->owner.find(node.name); it != this->owner.end()) {
+            this->assigned.insert(node.name);
+            if (it->second != function)
+              this->remote_assigned.insert(node.name);
+          } else {
+            this->definitions[node.name]++;
+          }
+          scan(*node.rhs, function);
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          this->definitions[node.name]++;
+          scan(*node.rhs, function);
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          scan(*node.condition, function);
+          scan(*node.then, function);
+          scan(*node.otherwise, function);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          const auto inner = ++this->functions;
+          for (auto &formal : node.formals)
+            this->owner[*formal] = inner;
+          for (auto &stmt : node.body)
+            scan(*stmt, inner);
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          auto *lam = std::get_if<core::Lambda>(&node.callee->node);
+          if (lam && lam->formals.size() == node.args.size()) {
+            for (auto &formal : lam->formals)
+              this->owner[*formal] = function;
+            for (auto &stmt : lam->body)
+              scan(*stmt, function);
+          } else if (!std::holds_alternative<core::Var>(node.callee->node)) {
+            scan(*node.callee, function);
+          }
+          for (auto &arg : node.args)
+            scan(*arg, function);
+        }
+      },
+      expr.node);
+}
+
+void Typer::pass(core::Program &program) {
+  for (auto &top : program) {
+    Env env;
+    if (auto *def = std::get_if<core::Define>(&top)) {
+      const auto type = infer(*def->rhs, env);
+      if (auto it = this->globals.find(def->name); it != this->globals.end()) {
+        const auto joined = join(it->second, type);
+        this->changed = this->changed || joined != it->second;
+        it->second = joined;
+      }
+    } else {
+      infer(std::get<core::Expr>(top), env);
+    }
+  }
+}
+
+Typer::Type Typer::infer_body(std::vector<std::unique_ptr<core::Expr>> &body,
+                              Env &env) {
+  Type type = NONE;
+  for (auto &stmt : body)
+    type = infer(*stmt, env);
+  return type;
+}
+
+Typer::Type Typer::infer_builtin(core::Apply &apply,
+                                 const std::vector<Type> &args) {
+  const auto id = std::get<core::Var>(apply.callee->node).id;
+  if (this->arithmetic.contains(id)) {
+    bool proven = true;
+    for (auto arg : args)
+      proven = proven && join(arg, INT) == INT;
+    if (this->mark && proven)
+      apply.unchecked = true;
+    return INT;
+  }
+  if (this->predicates.contains(id))
+    return INT;
+  if (id == this->cons_id)
+    return PAIR;
+  if (this->accessors.contains(id) && args.size() == 1 &&
+      join(args.front(), PAIR) == PAIR && this->mark) {
+    apply.unchecked = true;
+  }
+  return UNKNOWN;
+}
+
+Typer::Type Typer::infer(core::Expr &expr, Env &env) {
+  return std::visit(
+      [&](auto &node) -> Type {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, core::Const> ||
+                      std::is_same_v<T, core::Undef>) {
+          return INT;
+        } else if constexpr (std::is_same_v<T, core::Var>) {
+          if (node.id == this->nil_id)
+            return NIL;
+          if (this->owner.contains(node.id)) {
+            auto it = env.find(node.id);
+            if (this->remote_assigned.contains(node.id) || it == env.end())
+              return UNKNOWN;
+            return it->second;
+          }
+          auto it = this->globals.find(node.id);
+          return it == this->globals.end() ? UNKNOWN : it->second;
+        } else if constexpr (std::is_same_v<T, core::Set>) {
+          const auto type = infer(*node.rhs, env);
+          if (this->owner.contains(node.name))
+            env[node.name] = type;
+          return INT;
+        } else if constexpr (std::is_same_v<T, core::Define>) {
+          infer(*node.rhs, env);
+          return UNKNOWN;
+        } else if constexpr (std::is_same_v<T, core::Cond>) {
+          infer(*node.condition, env);
+          Env then_env = env;
+          Env else_env = env;
+          const auto then = infer(*node.then, then_env);
+          const auto otherwise = infer(*node.otherwise, else_env);
+          env = then_env;
+          for (auto &[id, type] : else_env)
+            env[id] = join(env.contains(id) ? env[id] : NONE, type);
+          return join(then, otherwise);
+        } else if constexpr (std::is_same_v<T, core::Lambda>) {
+          // a closure runs later, only captures that are never set! keep
+          // their type
+          Env inner;
+          for (auto &[id, type] : env) {
+            if (!this->assigned.contains(id))
+              inner[id] = type;
+          }
+          auto fn = this->known_lambdas.find(&node);
+          for (size_t i = 0; i < node.formals.size(); i++) {
+            inner[*node.formals[i]] = fn == this->known_lambdas.end()
+                                          ? UNKNOWN
+                                          : this->params[fn->second][i];
+          }
+          const auto result = infer_body(node.body, inner);
+          if (fn != this->known_lambdas.end()) {
+            auto &known_result = this->results[fn->second];
+            const auto joined = join(known_result, result);
+            this->changed = this->changed || joined != known_result;
+            known_result = joined;
+          }
+          return CLOSURE;
+        } else if constexpr (std::is_same_v<T, core::Apply>) {
+          std::vector<Type> args;
+          for (auto &arg : node.args)
+            args.push_back(infer(*arg, env));
+          if (auto *lam = as_let(node)) {
+            for (size_t i = 0; i < args.size(); i++)
+              env[*lam->formals[i]] = args[i];
+            return infer_body(lam->body, env);
+          }
+          auto *var = std::get_if<core::Var>(&node.callee->node);
+          if (var && var->id < this->builtin_count &&
+              !this->owner.contains(var->id)) {
+            return infer_builtin(node, args);
+          }
+          if (auto fn = var ? this->known.find(var->id) : this->known.end();
+              fn != this->known.end()) {
+            auto &formals = this->params[var->id];
+            for (size_t i = 0; i < formals.size(); i++) {
+              // a call with the wrong arity tells nothing about the formals
+              const auto arg = args.size() == formals.size() ? args[i] : UNKNOWN;
+              const auto joined = join(formals[i], arg);
+              this->changed = this->changed || joined != formals[i];
+              formals[i] = joined;
+            }
+            return this->results[var->id];
+          }
+          infer(*node.callee, env);
+          return UNKNOWN;
+        } else {
+          return UNKNOWN;
+        }
+      },
+      expr.node);
+}
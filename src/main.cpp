@@ -1,14 +1,211 @@
+#include <backend/aot/aot.hpp>
 #include <backend/generator/generator.hpp>
+#include <backend/generator/register_generator.hpp>
+#include <backend/module/module.hpp>
+#include <backend/vm/register.hpp>
 #include <backend/vm/stack.hpp>
 #include <frontend/core.hpp>
 #include <frontend/lexer.hpp>
 #include <frontend/parser.hpp>
 #include <frontend/scoper.hpp>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <optimizer/pass_manager.hpp>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
-int main() {
-  std::string program = R"(
+namespace {
+
+// runs vm, writing the site profile to profile_out when it is given and
+// compiling functions called jit times when that is. Fails unless the
+// program halts
+int run_stack(Stack &vm, bool profile_ops, const std::string &profile_out,
+              std::optional<uint32_t> jit) {
+  try {
+    vm.verify();
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (profile_ops || !profile_out.empty())
+    vm.enable_profile();
+  else if (jit && !vm.enable_jit(*jit))
+    std::cerr << "the JIT does not run on this machine\n";
+  const bool halted = vm.run_program() == MachineState::HALT;
+  if (jit && halted && vm.result())
+    std::cerr << "result=" << vm.result()->value << " ";
+  std::cerr << "executed=" << vm.executed() << "\n";
+  if (!profile_out.empty()) {
+    std::ofstream file(profile_out);
+    if (!file) {
+      std::cerr << "cannot write " << profile_out << std::endl;
+      return 1;
+    }
+    core::write_profile(file, vm.site_profile());
+  }
+  if (profile_ops) {
+    // the runs worth a superinstruction, see optimizer/superinstructions.hpp
+    for (auto &[run, count] : hot_sequences(vm.op_profile(), 20)) {
+      std::cerr << count;
+      for (auto op : run)
+        std::cerr << " " << ISA::spec_list[static_cast<uint8_t>(op)].mnemonic;
+      std::cerr << "\n";
+    }
+  }
+  return halted ? 0 : 1;
+}
+
+// writes code as a C++ translation unit, see backend/aot/aot.hpp
+int emit_cpp(const std::string &path,
+             const std::vector<ISA::Instruction> &code) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "cannot write " << path << std::endl;
+    return 1;
+  }
+  AOT::emit(file, code);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  auto level = OptLevel::O2;
+  bool time_passes = false;
+  bool profile_ops = false;
+  // --engine=register runs the program on the register machine instead
+  bool register_engine = false;
+  // --jit compiles hot functions of the stack VM to native code, which runs
+  // without the trace, --jit=N those called N times rather than
+  // Stack::jit_threshold
+  std::optional<uint32_t> jit;
+  // -fprofile-generate=file writes the site counts of the run to file,
+  // -fprofile-use=file compiles with the counts of such a run
+  std::string profile_out;
+  std::optional<core::Profile> profile;
+  // -o file.splc writes the compiled module instead of running it, a .splc
+  // given as input runs without the front end. -c compiles the source to an
+  // object, whose unbound names are left to the linker, and several .splc
+  // inputs are linked in the order given
+  std::string module_out;
+  std::vector<std::string> modules_in;
+  // --emit-cpp=file.cpp writes the program as C++ instead of running it
+  std::string cpp_out;
+  bool object = false;
+  std::string source;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (auto parsed = parse_opt_level(arg)) {
+      level = *parsed;
+    } else if (arg == "--time-passes") {
+      time_passes = true;
+    } else if (arg == "--profile-ops") {
+      profile_ops = true;
+    } else if (arg == "--jit") {
+      jit = Stack::jit_threshold;
+    } else if (arg.starts_with("--jit=")) {
+      const auto count = arg.substr(arg.find('=') + 1);
+      if (count.empty() || count.size() > 9 ||
+          count.find_first_not_of("0123456789") != std::string::npos ||
+          std::stoul(count) == 0) {
+        std::cerr << "--jit= takes a call count above 0" << std::endl;
+        return 1;
+      }
+      jit = std::stoul(count);
+    } else if (arg == "--engine=stack" || arg == "--engine=register") {
+      register_engine = arg == "--engine=register";
+    } else if (arg.starts_with("-fprofile-generate=")) {
+      profile_out = arg.substr(arg.find('=') + 1);
+    } else if (arg == "-o" && i + 1 < argc) {
+      module_out = argv[++i];
+    } else if (arg.starts_with("--emit-cpp=")) {
+      cpp_out = arg.substr(arg.find('=') + 1);
+    } else if (arg == "-c") {
+      object = true;
+    } else if (arg.starts_with("-fprofile-use=")) {
+      const auto path = arg.substr(arg.find('=') + 1);
+      std::ifstream file(path);
+      if (!file) {
+        std::cerr << "cannot open " << path << std::endl;
+        return 1;
+      }
+      profile = core::read_profile(file);
+    } else if (arg.starts_with("-")) {
+      std::cerr << "unknown option " << arg << std::endl;
+      return 1;
+    } else if (arg.ends_with(".splc")) {
+      modules_in.push_back(arg);
+    } else {
+      // source files are concatenated in the order given
+      std::ifstream file(arg);
+      if (!file) {
+        std::cerr << "cannot open " << arg << std::endl;
+        return 1;
+      }
+      std::stringstream contents;
+      contents << file.rdbuf();
+      source += contents.str();
+    }
+  }
+
+  // the register machine runs source straight from the front end, it has no
+  // modules, no C++ output, no profile sites and no JIT
+  if (register_engine &&
+      (!module_out.empty() || object || !modules_in.empty() ||
+       !cpp_out.empty() || !profile_out.empty() || profile || jit)) {
+    std::cerr << "--engine=register runs source files and takes none of -o, "
+                 "-c, --emit-cpp, -fprofile-generate, -fprofile-use or --jit"
+              << std::endl;
+    return 1;
+  }
+  if (!modules_in.empty() && !source.empty()) {
+    std::cerr << "cannot mix modules and source files" << std::endl;
+    return 1;
+  }
+  if (object && (module_out.empty() || !modules_in.empty())) {
+    std::cerr << "-c compiles source files and needs -o" << std::endl;
+    return 1;
+  }
+  if (!modules_in.empty()) {
+    try {
+      std::vector<SPLC::Module> modules;
+      for (const auto &path : modules_in)
+        modules.push_back(SPLC::Module::load(path));
+      if (!cpp_out.empty()) {
+        const bool linked = modules.size() == 1 &&
+                            modules[0].kind() == SPLC::Kind::PROGRAM;
+        return emit_cpp(cpp_out, linked ? ISA::decode_code(modules[0].code())
+                                        : SPLC::link(modules).code);
+      }
+      if (modules.size() == 1 && modules[0].kind() == SPLC::Kind::PROGRAM &&
+          module_out.empty()) {
+        Stack vm(modules[0], !profile_ops && !jit);
+        return run_stack(vm, profile_ops, profile_out, jit);
+      }
+      auto linked = SPLC::link(modules);
+      if (!module_out.empty()) {
+        std::ofstream file(module_out, std::ios::binary);
+        if (!file) {
+          std::cerr << "cannot write " << module_out << std::endl;
+          return 1;
+        }
+        SPLC::write(file,
+                    SPLC::make_image(linked.code, linked.globals,
+                                     SPLC::Kind::PROGRAM, linked.halt_depth));
+        return 0;
+      }
+      Stack vm(linked.code, !profile_ops && !jit);
+      return run_stack(vm, profile_ops, profile_out, jit);
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  std::string program = !source.empty() ? source : R"(
   (define make-adder
     (lambda (n)
       (lambda (x) (+ x n))))
@@ -29,21 +226,55 @@ int main() {
   std::cout << "--+--" << std::endl;
   ast::print_ast(ast);
   std::cout << std::endl << "--+--" << std::endl;
-  Scoper scoper;
+  Scoper scoper(object);
   scoper.run(ast);
   scoper.resolve(ast);
   ast::print_ast(ast);
   std::cout << std::endl << "--+--" << std::endl;
   core::Lowerer lowerer;
-  const core::Program &program_ir = lowerer.lower(ast);
+  core::Program &program_ir = lowerer.lower(ast);
+  auto passes = PassManager::pipeline(level, profile ? &*profile : nullptr,
+                                      scoper.exported());
+  if (register_engine) {
+    passes.run_core(program_ir);
+    core::print_program(program_ir);
+    if (time_passes)
+      passes.print_reports();
+    std::cout << std::endl << "--+--" << std::endl;
+    RegisterGenerator gen(program_ir);
+    auto code = gen.generate();
+    print_register_code(code);
+    std::cout << std::endl << "--+--" << std::endl;
+    RegisterMachine vm(code, !profile_ops);
+    const auto state = vm.run_program();
+    std::cerr << "state=" << state;
+    if (vm.result())
+      std::cerr << " result=" << vm.result()->value;
+    std::cerr << " executed=" << vm.executed() << "\n";
+    return state == MachineState::HALT ? 0 : 1;
+  }
+  auto bc = passes.run(program_ir);
   core::print_program(program_ir);
-  Generator gen(program_ir);
-  auto bc = gen.generate();
+  if (time_passes)
+    passes.print_reports();
   std::cout << std::endl << "--+--" << std::endl;
   print_bytecode(bc);
   std::cout << std::endl << "--+--" << std::endl;
-  Stack vm(bc, true);
-  vm.run_program();
+  if (!cpp_out.empty())
+    return emit_cpp(cpp_out, bc);
+  if (!module_out.empty()) {
+    std::ofstream file(module_out, std::ios::binary);
+    if (!file) {
+      std::cerr << "cannot write " << module_out << std::endl;
+      return 1;
+    }
+    SPLC::write(file, SPLC::make_image(
+                          bc, SPLC::symbols(passes.global_ids(), scoper),
+                          object ? SPLC::Kind::OBJECT : SPLC::Kind::PROGRAM,
+                          passes.halt_depth()));
+    return 0;
+  }
+  Stack vm(bc, !profile_ops && !jit);
   // vm.run_program_dbg(bc);
-  return 0;
+  return run_stack(vm, profile_ops, profile_out, jit);
 }
@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/aot/aot.hpp>
+#include <backend/vm/stack.hpp>
+
+#include "compile.hpp"
+
+namespace {
+
+std::string emit(const std::vector<ISA::Instruction> &code) {
+  std::stringstream out;
+  AOT::emit(out, code);
+  return out.str();
+}
+
+} // namespace
+
+TEST(AotTests, JumpsBecomeGotos) {
+  const auto code = std::vector<ISA::Instruction>{
+      {ISA::Operation::PUSH, 0},      {ISA::Operation::CJMPZ, 3},
+      {ISA::Operation::PUSH, 1},      {ISA::Operation::JMP, 5},
+      {ISA::Operation::PUSH, 2},      {ISA::Operation::HALT, std::nullopt},
+  };
+  const auto encoded = ISA::encode(code);
+  const auto text = emit(code);
+  const auto label = [&](size_t i) {
+    return "L" + std::to_string(encoded.offsets[i]);
+  };
+  // the taken branch and the jump go straight to their targets
+  EXPECT_NE(text.find("    goto " + label(3) + ";\n"), std::string::npos);
+  EXPECT_NE(text.find("  goto " + label(5) + ";\n"), std::string::npos);
+  for (size_t i = 0; i < code.size(); i++)
+    EXPECT_NE(text.find(label(i) + ": //"), std::string::npos);
+  // the end of the code has a label of its own, and only one
+  const auto end = label(code.size()) + ":\n";
+  EXPECT_NE(text.find(end), std::string::npos);
+  EXPECT_EQ(text.find(end), text.rfind(end));
+  // anywhere else is not an instruction
+  EXPECT_NE(text.find("  default:\n    return MachineState::INVALID_OP;\n"),
+            std::string::npos);
+}
+
+TEST(AotTests, CompiledProgramRunsLikeTheInterpreter) {
+  const auto src =
+      "(define (fib n) (if (< 2 n) n (+ (fib (- n 1)) (fib (- n 2)))))"
+      "(define (build n acc) (if (eq n 0) acc (build (- n 1) (cons n acc))))"
+      "(define (sum xs acc)"
+      "  (if (null? xs) acc (sum (cdr xs) (+ acc (car xs)))))"
+      "(define (counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))"
+      "(define c (counter))"
+      "(c)"
+      "(+ (fib 12) (+ (sum (build 50 nil) 0) (c)))";
+  const auto code = test::compile(src);
+  Stack vm(code);
+  ASSERT_EQ(vm.run_program(), MachineState::HALT);
+
+  const auto dir = std::filesystem::temp_directory_path();
+  const auto source = (dir / "splisp_aot_test.cpp").string();
+  const auto binary = (dir / "splisp_aot_test").string();
+  const auto output = (dir / "splisp_aot_test.out").string();
+  const auto text = emit(code);
+  // the same every time, nothing past the end of the code is read
+  ASSERT_EQ(emit(code), text);
+  {
+    std::ofstream file(source);
+    file << text;
+  }
+  const auto build = std::string(SPLISP_CXX) + " -std=c++20 -I" +
+                     SPLISP_INCLUDE_DIR + " " + source + " " + SPLISP_LIB +
+                     " -pthread -o " + binary;
+  ASSERT_EQ(std::system(build.c_str()), 0) << build;
+  EXPECT_EQ(std::system((binary + " > " + output).c_str()), 0);
+  std::ifstream result(output);
+  int64_t value = 0;
+  result >> value;
+  EXPECT_EQ(value, vm.result()->value);
+  std::filesystem::remove(source);
+  std::filesystem::remove(binary);
+  std::filesystem::remove(output);
+}
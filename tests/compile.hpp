@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <backend/isa/isa.hpp>
+#include <frontend/core.hpp>
+#include <frontend/lexer.hpp>
+#include <frontend/parser.hpp>
+#include <frontend/scoper.hpp>
+#include <optimizer/pass_manager.hpp>
+
+// the front end as main.cpp runs it, for the tests
+namespace test {
+
+// lexes, parses and scopes src with scoper, then lowers it. The program
+// lives in lowerer
+inline core::Program &lower(const std::string &src, core::Lowerer &lowerer,
+                            Scoper &scoper) {
+  Lexer lex(src);
+  Parser parser(std::move(lex));
+  auto ast = parser.parse();
+  scoper.run(ast);
+  scoper.resolve(ast);
+  return lowerer.lower(ast);
+}
+
+inline core::Program &lower(const std::string &src, core::Lowerer &lowerer) {
+  Scoper scoper;
+  return lower(src, lowerer, scoper);
+}
+
+// the stack bytecode of src through the pipeline of level
+inline std::vector<ISA::Instruction>
+compile(const std::string &src, OptLevel level = OptLevel::O2,
+        const core::Profile *profile = nullptr) {
+  core::Lowerer lowerer;
+  core::Program &ir = lower(src, lowerer);
+  return PassManager::pipeline(level, profile).run(ir);
+}
+
+} // namespace test
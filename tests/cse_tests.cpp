@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <optimizer/cse.hpp>
+
+namespace {
+
+constexpr core::SymbolId kAdd = 0;
+constexpr core::SymbolId kCar = 6;
+constexpr core::SymbolId kCdr = 7;
+constexpr core::SymbolId kFunc = 20;
+constexpr core::SymbolId kX = 30;
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr apply_expr(core::SymbolId callee, std::vector<core::Expr> args) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  for (auto &arg : args)
+    apply.args.push_back(std::make_unique<core::Expr>(std::move(arg)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Expr unary(core::SymbolId callee, core::Expr arg) {
+  std::vector<core::Expr> args;
+  args.push_back(std::move(arg));
+  return apply_expr(callee, std::move(args));
+}
+
+core::Expr binary(core::SymbolId callee, core::Expr lhs, core::Expr rhs) {
+  std::vector<core::Expr> args;
+  args.push_back(std::move(lhs));
+  args.push_back(std::move(rhs));
+  return apply_expr(callee, std::move(args));
+}
+
+// (car (cdr x))
+core::Expr cadr() { return unary(kCar, unary(kCdr, var_expr(kX))); }
+
+// (define (f x) body...)
+core::Program define_func(std::vector<core::Expr> body) {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(kX));
+  for (auto &stmt : body)
+    lam.body.push_back(std::make_unique<core::Expr>(std::move(stmt)));
+  core::Program prog;
+  prog.emplace_back(core::Define{
+      .name = kFunc,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})});
+  return prog;
+}
+
+const core::Lambda &func_lambda(const core::Program &prog) {
+  return std::get<core::Lambda>(std::get<core::Define>(prog[0]).rhs->node);
+}
+
+} // namespace
+
+TEST(CSETests, RepeatedApplicationIsBoundOnce) {
+  // (define (f x) (+ (car (cdr x)) (+ (car (cdr x)) (car (cdr x)))))
+  std::vector<core::Expr> body;
+  body.push_back(binary(kAdd, cadr(), binary(kAdd, cadr(), cadr())));
+  auto prog = define_func(std::move(body));
+
+  CSE cse;
+  cse.run(prog);
+
+  // (let ((t (car (cdr x)))) (+ t (+ t t)))
+  const auto &let = std::get<core::Apply>(func_lambda(prog).body[0]->node);
+  const auto &lam = std::get<core::Lambda>(let.callee->node);
+  ASSERT_EQ(lam.formals.size(), 1U);
+  const auto temp = *lam.formals[0];
+  EXPECT_TRUE(std::holds_alternative<core::Apply>(let.args[0]->node));
+  const auto &sum = std::get<core::Apply>(lam.body[0]->node);
+  EXPECT_EQ(std::get<core::Var>(sum.args[0]->node).id, temp);
+  const auto &inner = std::get<core::Apply>(sum.args[1]->node);
+  EXPECT_EQ(std::get<core::Var>(inner.args[0]->node).id, temp);
+  EXPECT_EQ(std::get<core::Var>(inner.args[1]->node).id, temp);
+}
+
+TEST(CSETests, SetOfOperandEndsReuse) {
+  // (define (f x) (f (car (cdr x))) (set! x 0) (+ (car (cdr x)) (car (cdr x))))
+  std::vector<core::Expr> body;
+  body.push_back(unary(kFunc, cadr()));
+  body.push_back(core::Expr{
+      .node = core::Set{.name = kX,
+                        .rhs = std::make_unique<core::Expr>(
+                            core::Expr{.node = core::Const{0}})}});
+  body.push_back(binary(kAdd, cadr(), cadr()));
+  body.push_back(cadr());
+  auto prog = define_func(std::move(body));
+
+  CSE cse;
+  cse.run(prog);
+
+  // only the statements after the set! share a temporary
+  const auto &lam = func_lambda(prog);
+  ASSERT_EQ(lam.body.size(), 3U);
+  const auto &call = std::get<core::Apply>(lam.body[0]->node);
+  EXPECT_TRUE(std::holds_alternative<core::Apply>(call.args[0]->node));
+  EXPECT_TRUE(std::holds_alternative<core::Set>(lam.body[1]->node));
+  const auto &let = std::get<core::Apply>(lam.body[2]->node);
+  const auto &inner = std::get<core::Lambda>(let.callee->node);
+  ASSERT_EQ(inner.body.size(), 2U);
+  EXPECT_TRUE(std::holds_alternative<core::Var>(inner.body[1]->node));
+}
+
+TEST(CSETests, OccurrenceOnlyInBranchIsNotHoisted) {
+  // (define (f x) (if x (car (cdr x)) 0) (+ (car (cdr x)) (car (cdr x))))
+  // the first occurrence may fault when x is not a pair, it stays put
+  std::vector<core::Expr> body;
+  body.push_back(core::Expr{
+      .node = core::Cond{
+          .condition = std::make_unique<core::Expr>(var_expr(kX)),
+          .then = std::make_unique<core::Expr>(cadr()),
+          .otherwise = std::make_unique<core::Expr>(
+              core::Expr{.node = core::Const{0}})}});
+  body.push_back(binary(kAdd, cadr(), binary(kAdd, cadr(), cadr())));
+  auto prog = define_func(std::move(body));
+
+  CSE cse;
+  cse.run(prog);
+
+  const auto &lam = func_lambda(prog);
+  ASSERT_EQ(lam.body.size(), 2U);
+  EXPECT_TRUE(std::holds_alternative<core::Cond>(lam.body[0]->node));
+  // the binding starts at the second statement instead
+  const auto &let = std::get<core::Apply>(lam.body[1]->node);
+  EXPECT_TRUE(std::holds_alternative<core::Lambda>(let.callee->node));
+}
@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <memory>
+#include <variant>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <optimizer/escape.hpp>
+
+namespace {
+
+constexpr core::SymbolId kAdd = 0;
+constexpr core::SymbolId kCons = 5;
+constexpr core::SymbolId kCar = 6;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr call_expr(core::SymbolId callee, core::Expr arg) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(arg)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Expr cons_expr(uint64_t head, uint64_t tail) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(kCons));
+  apply.args.push_back(std::make_unique<core::Expr>(const_expr(head)));
+  apply.args.push_back(std::make_unique<core::Expr>(const_expr(tail)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Expr identity() {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(40));
+  lam.body.push_back(std::make_unique<core::Expr>(var_expr(40)));
+  return core::Expr{.node = std::move(lam)};
+}
+
+// (let ((id value)) body)
+core::Expr let_expr(core::SymbolId id, core::Expr value, core::Expr body) {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(id));
+  lam.body.push_back(std::make_unique<core::Expr>(std::move(body)));
+  core::Apply apply;
+  apply.callee =
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)});
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(value)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+const core::Expr &let_value(const core::Program &prog) {
+  return *std::get<core::Apply>(std::get<core::Expr>(prog[0]).node).args[0];
+}
+
+} // namespace
+
+TEST(EscapeTests, LetBoundClosureOnlyCalledIsFrameLocal) {
+  // (let ((f (lambda (x) x))) (f 1))
+  core::Program prog;
+  prog.emplace_back(let_expr(30, identity(), call_expr(30, const_expr(1))));
+
+  EscapeAnalyzer escape;
+  escape.run(prog);
+
+  EXPECT_TRUE(std::get<core::Lambda>(let_value(prog).node).frame_local);
+}
+
+TEST(EscapeTests, ReturnedClosureEscapes) {
+  // (let ((f (lambda (x) x))) f)
+  core::Program prog;
+  prog.emplace_back(let_expr(30, identity(), var_expr(30)));
+
+  EscapeAnalyzer escape;
+  escape.run(prog);
+
+  EXPECT_FALSE(std::get<core::Lambda>(let_value(prog).node).frame_local);
+}
+
+TEST(EscapeTests, ClosureReferencedFromInnerLambdaEscapes) {
+  // (let ((f (lambda (x) x))) (lambda (y) (f y)))
+  core::Lambda inner;
+  inner.formals.push_back(std::make_unique<core::SymbolId>(31));
+  inner.body.push_back(
+      std::make_unique<core::Expr>(call_expr(30, var_expr(31))));
+
+  core::Program prog;
+  prog.emplace_back(
+      let_expr(30, identity(), core::Expr{.node = std::move(inner)}));
+
+  EscapeAnalyzer escape;
+  escape.run(prog);
+
+  EXPECT_FALSE(std::get<core::Lambda>(let_value(prog).node).frame_local);
+}
+
+TEST(EscapeTests, PairOnlyReadIsFrameLocal) {
+  // (let ((p (cons 1 2))) (car p))
+  core::Program prog;
+  prog.emplace_back(
+      let_expr(30, cons_expr(1, 2), call_expr(kCar, var_expr(30))));
+
+  EscapeAnalyzer escape;
+  escape.run(prog);
+
+  EXPECT_TRUE(std::get<core::Apply>(let_value(prog).node).frame_local);
+}
+
+TEST(EscapeTests, PairPassedToCallEscapes) {
+  // (let ((p (cons 1 2))) (+ p 1))
+  core::Apply add;
+  add.callee = std::make_unique<core::Expr>(var_expr(kAdd));
+  add.args.push_back(std::make_unique<core::Expr>(var_expr(30)));
+  add.args.push_back(std::make_unique<core::Expr>(const_expr(1)));
+
+  core::Program prog;
+  prog.emplace_back(
+      let_expr(30, cons_expr(1, 2), core::Expr{.node = std::move(add)}));
+
+  EscapeAnalyzer escape;
+  escape.run(prog);
+
+  EXPECT_FALSE(std::get<core::Apply>(let_value(prog).node).frame_local);
+}
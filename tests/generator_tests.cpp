@@ -51,6 +51,12 @@ std::optional<size_t> first_index(const std::vector<ISA::Instruction> &bc,
   return std::nullopt;
 }
 
+// the global slot the generator numbered a symbol id with
+uint64_t slot_of(const Generator &gen, core::SymbolId id) {
+  const auto &ids = gen.global_ids();
+  return std::find(ids.begin(), ids.end(), id) - ids.begin();
+}
+
 } // namespace
 
 TEST(GeneratorTests, EmitConstProducesPush) {
@@ -73,9 +79,10 @@ TEST(GeneratorTests, EmitTopDefineConstPushThenMkglobal) {
       std::find_if(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
         return i.op == ISA::Operation::PUSH && i.operand == 55;
       });
+  const auto slot = slot_of(gen, 7);
   auto mkglobal_it =
-      std::find_if(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
-        return i.op == ISA::Operation::MKGLOBAL && i.operand == 7;
+      std::find_if(bc.begin(), bc.end(), [slot](const ISA::Instruction &i) {
+        return i.op == ISA::Operation::MKGLOBAL && i.operand == slot;
       });
 
   ASSERT_NE(push_it, bc.end());
@@ -83,6 +90,22 @@ TEST(GeneratorTests, EmitTopDefineConstPushThenMkglobal) {
   EXPECT_LT(push_it, mkglobal_it);
 }
 
+TEST(GeneratorTests, GlobalsAreNumberedDenselyByFirstUse) {
+  core::Program prog;
+  prog.emplace_back(core::Define{
+      .name = 9000, .rhs = std::make_unique<core::Expr>(const_expr(1))});
+  prog.emplace_back(core::Define{
+      .name = 40, .rhs = std::make_unique<core::Expr>(const_expr(2))});
+  prog.emplace_back(var_expr(9000));
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+
+  EXPECT_EQ(gen.global_ids(), (std::vector<core::SymbolId>{9000, 40}));
+  EXPECT_EQ(*first_index(bc, ISA::Operation::LOADGLOBAL), bc.size() - 2);
+  EXPECT_EQ(bc[bc.size() - 2].operand, 0U);
+}
+
 TEST(GeneratorTests, EmitVarGlobalEmitsLoadglobal) {
   core::Program prog;
   prog.emplace_back(core::Define{
@@ -94,9 +117,11 @@ TEST(GeneratorTests, EmitVarGlobalEmitsLoadglobal) {
   auto &bc = GeneratorTestAccess::bytecode(gen);
   print_bytecode(bc);
 
-  EXPECT_TRUE(std::any_of(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
-    return i.op == ISA::Operation::LOADGLOBAL && i.operand == 10;
-  }));
+  const auto slot = slot_of(gen, 10);
+  EXPECT_TRUE(
+      std::any_of(bc.begin(), bc.end(), [slot](const ISA::Instruction &i) {
+        return i.op == ISA::Operation::LOADGLOBAL && i.operand == slot;
+      }));
 }
 
 TEST(GeneratorTests, EmitApplyAddEmitsArgsInOrderThenAdd) {
@@ -169,6 +194,11 @@ TEST(GeneratorTests, EmitApplyUserFuncEmitsArgsThenLoadglobalThenCall) {
   prog.emplace_back(core::Define{
       .name = kFuncId,
       .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})});
+  // a global which is set! may hold any closure, so it is called through
+  // its handle
+  prog.emplace_back(core::Expr{
+      .node = core::Set{.name = kFuncId,
+                        .rhs = std::make_unique<core::Expr>(const_expr(0))}});
 
   core::Apply call;
   call.callee = std::make_unique<core::Expr>(var_expr(kFuncId));
@@ -183,9 +213,10 @@ TEST(GeneratorTests, EmitApplyUserFuncEmitsArgsThenLoadglobalThenCall) {
 
   EXPECT_TRUE(has_push(bc, 42));
 
+  const auto slot = slot_of(gen, kFuncId);
   auto loadglobal_it =
-      std::find_if(bc.begin(), bc.end(), [kFuncId](const ISA::Instruction &i) {
-        return i.op == ISA::Operation::LOADGLOBAL && i.operand == kFuncId;
+      std::find_if(bc.begin(), bc.end(), [slot](const ISA::Instruction &i) {
+        return i.op == ISA::Operation::LOADGLOBAL && i.operand == slot;
       });
   auto call_it =
       std::find_if(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
@@ -223,6 +254,34 @@ TEST(GeneratorTests, EmitCondHasCjmpWithConditionAndBothBranchValues) {
   EXPECT_LT((size_t)(cond_push - bc.begin()), cjmp_idx);
 }
 
+TEST(GeneratorTests, ProfiledCondMovesColdBranchOutOfLine) {
+  core::Cond cond;
+  cond.condition = std::make_unique<core::Expr>(const_expr(1));
+  cond.then = std::make_unique<core::Expr>(const_expr(10));
+  cond.otherwise = std::make_unique<core::Expr>(const_expr(20));
+  cond.site = 5;
+  cond.then_count = 9;
+  cond.otherwise_count = 1;
+
+  core::Program prog;
+  prog.emplace_back(core::Expr{.node = std::move(cond)});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+
+  // push 1; cjmpz cold; push 10; halt; cold: push 20; jmp back to the halt
+  ASSERT_EQ(bc.size(), 6U);
+  EXPECT_EQ(bc[1].op, ISA::Operation::CJMPZ);
+  EXPECT_EQ(bc[1].operand, 4U);
+  // the jump goes to otherwise, whose site follows the one of then
+  EXPECT_EQ(bc[1].site, 6U);
+  EXPECT_EQ(bc[2].operand, 10U);
+  EXPECT_EQ(bc[3].op, ISA::Operation::HALT);
+  EXPECT_EQ(bc[4].operand, 20U);
+  EXPECT_EQ(bc[5].op, ISA::Operation::JMP);
+  EXPECT_EQ(bc[5].operand, 3U);
+}
+
 TEST(GeneratorTests, EmitLambdaHasMkClosurePointingToEnter) {
   core::Lambda lam;
   lam.formals.push_back(std::make_unique<core::SymbolId>(1));
@@ -242,15 +301,41 @@ TEST(GeneratorTests, EmitLambdaHasMkClosurePointingToEnter) {
   EXPECT_TRUE(has_op(bc, ISA::Operation::RET));
   EXPECT_TRUE(has_push(bc, 42));
 
-  // MKCLOSURE's operand is the byte offset of the lambda body.
+  // MKCLOSURE's operand is the instruction index of the lambda body.
   // The first instruction of the body must be ENTER.
   size_t mkclosure_idx = *first_index(bc, ISA::Operation::MKCLOSURE);
-  uint64_t body_byte_offset = bc[mkclosure_idx].operand.value();
-  size_t body_instr_idx = body_byte_offset / 9;
+  size_t body_instr_idx = bc[mkclosure_idx].operand.value();
   ASSERT_LT(body_instr_idx, bc.size());
   EXPECT_EQ(bc[body_instr_idx].op, ISA::Operation::ENTER);
 }
 
+TEST(GeneratorTests, LambdaBodiesGoToTheFunctionSectionByCount) {
+  // (lambda (x) 1) entered once, then (lambda (y) 2) entered nine times
+  core::Program prog;
+  for (uint64_t i = 0; i < 2; i++) {
+    core::Lambda lam;
+    lam.formals.push_back(std::make_unique<core::SymbolId>(20 + i));
+    lam.body.push_back(std::make_unique<core::Expr>(const_expr(1 + i)));
+    lam.count = i == 0 ? 1 : 9;
+    prog.emplace_back(core::Expr{.node = std::move(lam)});
+  }
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+  print_bytecode(bc);
+
+  // mkclosure; mkclosure; halt; then the bodies, the hotter first
+  ASSERT_EQ(bc.size(), 3U + 2 * 5);
+  EXPECT_FALSE(has_op(bc, ISA::Operation::JMP));
+  EXPECT_EQ(bc[0].op, ISA::Operation::MKCLOSURE);
+  EXPECT_EQ(bc[1].op, ISA::Operation::MKCLOSURE);
+  EXPECT_EQ(bc[2].op, ISA::Operation::HALT);
+  EXPECT_EQ(bc[1].operand, 3U);
+  EXPECT_EQ(bc[4].operand, 2U);
+  EXPECT_EQ(bc[0].operand, 8U);
+  EXPECT_EQ(bc[9].operand, 1U);
+}
+
 TEST(GeneratorTests, EmitLambdaEnterOperandEqualsFormals) {
   // lambda with 2 formals at top level (no captures) → ENTER 2
   core::Lambda lam;
@@ -306,9 +391,10 @@ TEST(GeneratorTests, EmitTopDefineLambdaMkglobalComesAfterBody) {
 
   EXPECT_TRUE(has_op(bc, ISA::Operation::MKCLOSURE));
 
+  const auto slot = slot_of(gen, 15);
   auto mkglobal_it =
-      std::find_if(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
-        return i.op == ISA::Operation::MKGLOBAL && i.operand == 15;
+      std::find_if(bc.begin(), bc.end(), [slot](const ISA::Instruction &i) {
+        return i.op == ISA::Operation::MKGLOBAL && i.operand == slot;
       });
   auto mkclosure_it =
       std::find_if(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
@@ -320,3 +406,264 @@ TEST(GeneratorTests, EmitTopDefineLambdaMkglobalComesAfterBody) {
   // stores it)
   EXPECT_LT(mkclosure_it, mkglobal_it);
 }
+
+TEST(GeneratorTests, EmitLetUsesFrameSlotsWithoutClosure) {
+  // ((lambda (x) x) 42) — the let form binds x to the slot 42 was pushed into
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(30));
+  lam.body.push_back(std::make_unique<core::Expr>(var_expr(30)));
+
+  core::Apply let;
+  let.callee =
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)});
+  let.args.push_back(std::make_unique<core::Expr>(const_expr(42)));
+
+  core::Program prog;
+  prog.emplace_back(core::Expr{.node = std::move(let)});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+  print_bytecode(bc);
+
+  EXPECT_FALSE(has_op(bc, ISA::Operation::MKCLOSURE));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::CALL));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::ENTER));
+  EXPECT_TRUE(std::any_of(bc.begin(), bc.end(), [](const ISA::Instruction &i) {
+    return i.op == ISA::Operation::GETLOCAL && i.operand == 0;
+  }));
+}
+
+TEST(GeneratorTests, CallInTailPositionEmitsTailcall) {
+  // (define f (lambda (x) (if x (f (- x 1)) (+ (f x) 1))))
+  constexpr core::SymbolId kFuncId = 20;
+  constexpr core::SymbolId kFormalId = 30;
+
+  auto call_f = [&](core::Expr arg) {
+    core::Apply call;
+    call.callee = std::make_unique<core::Expr>(var_expr(kFuncId));
+    call.args.push_back(std::make_unique<core::Expr>(std::move(arg)));
+    return core::Expr{.node = std::move(call)};
+  };
+  core::Apply dec;
+  dec.callee = std::make_unique<core::Expr>(var_expr(kSub));
+  dec.args.push_back(std::make_unique<core::Expr>(var_expr(kFormalId)));
+  dec.args.push_back(std::make_unique<core::Expr>(const_expr(1)));
+  core::Apply inc;
+  inc.callee = std::make_unique<core::Expr>(var_expr(kAdd));
+  inc.args.push_back(
+      std::make_unique<core::Expr>(call_f(var_expr(kFormalId))));
+  inc.args.push_back(std::make_unique<core::Expr>(const_expr(1)));
+
+  core::Cond cond;
+  cond.condition = std::make_unique<core::Expr>(var_expr(kFormalId));
+  cond.then = std::make_unique<core::Expr>(
+      call_f(core::Expr{.node = std::move(dec)}));
+  cond.otherwise =
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(inc)});
+
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(kFormalId));
+  lam.body.push_back(
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(cond)}));
+
+  core::Program prog;
+  prog.emplace_back(core::Define{
+      .name = kFuncId,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+  print_bytecode(bc);
+
+  // the recursive call under + still returns into this frame, f is a known
+  // function so both calls are direct
+  EXPECT_EQ(std::count_if(bc.begin(), bc.end(),
+                          [](const ISA::Instruction &i) {
+                            return i.op == ISA::Operation::TAILCALLDIRECT;
+                          }),
+            1);
+  EXPECT_EQ(std::count_if(bc.begin(), bc.end(),
+                          [](const ISA::Instruction &i) {
+                            return i.op == ISA::Operation::CALLDIRECT;
+                          }),
+            1);
+}
+
+TEST(GeneratorTests, TailCallIsNotFollowedByAReturn) {
+  // (define f (lambda (x) (f x))), the call replaces the frame so the
+  // NROT, DROP, RET epilogue could never run
+  constexpr core::SymbolId kFuncId = 20;
+  constexpr core::SymbolId kFormalId = 30;
+  core::Apply call;
+  call.callee = std::make_unique<core::Expr>(var_expr(kFuncId));
+  call.args.push_back(std::make_unique<core::Expr>(var_expr(kFormalId)));
+
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(kFormalId));
+  lam.body.push_back(
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(call)}));
+
+  core::Program prog;
+  prog.emplace_back(core::Define{
+      .name = kFuncId,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+
+  EXPECT_TRUE(has_op(bc, ISA::Operation::TAILCALLDIRECT));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::NROT));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::RET));
+}
+
+TEST(GeneratorTests, TopLevelCallIsNeverTailcall) {
+  constexpr core::SymbolId kFuncId = 20;
+  core::Lambda lam;
+  lam.body.push_back(std::make_unique<core::Expr>(const_expr(1)));
+
+  core::Apply call;
+  call.callee = std::make_unique<core::Expr>(var_expr(kFuncId));
+
+  core::Program prog;
+  prog.emplace_back(core::Define{
+      .name = kFuncId,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})});
+  prog.emplace_back(core::Expr{.node = std::move(call)});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+
+  EXPECT_TRUE(has_op(bc, ISA::Operation::CALLDIRECT));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::TAILCALL));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::TAILCALLDIRECT));
+}
+
+TEST(GeneratorTests, KnownGlobalFunctionIsCalledDirectly) {
+  // (define f (lambda (x) x)) (f 42) — no LOADGLOBAL or CALL at the call
+  // site, CALLDIRECT targets the ENTER of f's body
+  constexpr core::SymbolId kFuncId = 20;
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(30));
+  lam.body.push_back(std::make_unique<core::Expr>(var_expr(30)));
+
+  core::Apply call;
+  call.callee = std::make_unique<core::Expr>(var_expr(kFuncId));
+  call.args.push_back(std::make_unique<core::Expr>(const_expr(42)));
+
+  core::Program prog;
+  prog.emplace_back(core::Define{
+      .name = kFuncId,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})});
+  prog.emplace_back(core::Expr{.node = std::move(call)});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+  print_bytecode(bc);
+
+  EXPECT_FALSE(has_op(bc, ISA::Operation::LOADGLOBAL));
+  EXPECT_FALSE(has_op(bc, ISA::Operation::CALL));
+  ASSERT_TRUE(has_op(bc, ISA::Operation::CALLDIRECT));
+  const auto &direct = bc[*first_index(bc, ISA::Operation::CALLDIRECT)];
+  EXPECT_EQ(bc[direct.operand.value()].op, ISA::Operation::ENTER);
+  // the global still holds a closure for uses as a value
+  const auto slot = slot_of(gen, kFuncId);
+  EXPECT_TRUE(
+      std::any_of(bc.begin(), bc.end(), [slot](const ISA::Instruction &i) {
+        return i.op == ISA::Operation::MKGLOBAL && i.operand == slot;
+      }));
+}
+
+TEST(GeneratorTests, ClosedNestedLambdaIsLiftedToPrologue) {
+  // (lambda (x) (lambda (y) y) (lambda (z) x)) — only the first inner lambda
+  // is closed, it is created once up front and loaded from a hidden global
+  core::Lambda closed;
+  closed.formals.push_back(std::make_unique<core::SymbolId>(31));
+  closed.body.push_back(std::make_unique<core::Expr>(var_expr(31)));
+  core::Lambda open;
+  open.formals.push_back(std::make_unique<core::SymbolId>(32));
+  open.body.push_back(std::make_unique<core::Expr>(var_expr(30)));
+
+  core::Lambda outer;
+  outer.formals.push_back(std::make_unique<core::SymbolId>(30));
+  outer.body.push_back(
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(closed)}));
+  outer.body.push_back(
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(open)}));
+
+  core::Program prog;
+  prog.emplace_back(core::Expr{.node = std::move(outer)});
+  Generator gen(prog);
+  gen.generate();
+  auto &bc = GeneratorTestAccess::bytecode(gen);
+  print_bytecode(bc);
+
+  // prologue: MKCLOSURE of the lifted body stored under a fresh id
+  ASSERT_GE(bc.size(), 2U);
+  EXPECT_EQ(bc[0].op, ISA::Operation::MKCLOSURE);
+  EXPECT_EQ(bc[1].op, ISA::Operation::MKGLOBAL);
+  const auto hidden = bc[1].operand.value();
+  EXPECT_GT(gen.global_ids().at(hidden), 32U);
+  EXPECT_EQ(bc[bc[0].operand.value()].op, ISA::Operation::ENTER);
+  EXPECT_TRUE(std::any_of(bc.begin(), bc.end(), [&](const auto &i) {
+    return i.op == ISA::Operation::LOADGLOBAL && i.operand == hidden;
+  }));
+  // the outer lambda and the open inner lambda are still made in place
+  EXPECT_EQ(std::count_if(bc.begin(), bc.end(),
+                          [](const ISA::Instruction &i) {
+                            return i.op == ISA::Operation::MKCLOSURE;
+                          }),
+            3);
+  // the lifted body lives after HALT
+  EXPECT_LT(*first_index(bc, ISA::Operation::HALT),
+            bc[0].operand.value());
+}
+
+TEST(GeneratorTests, CodeDoesNotDependOnTheThreadCount) {
+  // enough forms for several threads: (define (f_i x) (if x (+ x i) i))
+  // with a profiled if, each followed by (f_i i)
+  constexpr size_t forms = 100;
+  auto program = [] {
+    core::Program prog;
+    for (size_t i = 0; i < forms; i++) {
+      core::Apply add;
+      add.callee = std::make_unique<core::Expr>(var_expr(kAdd));
+      add.args.push_back(std::make_unique<core::Expr>(var_expr(1000 + i)));
+      add.args.push_back(std::make_unique<core::Expr>(const_expr(i)));
+      core::Cond cond;
+      cond.condition = std::make_unique<core::Expr>(var_expr(1000 + i));
+      cond.then =
+          std::make_unique<core::Expr>(core::Expr{.node = std::move(add)});
+      cond.otherwise = std::make_unique<core::Expr>(const_expr(i));
+      cond.then_count = i % 3;
+      cond.otherwise_count = 1;
+      core::Lambda lam;
+      lam.formals.push_back(std::make_unique<core::SymbolId>(1000 + i));
+      lam.body.push_back(
+          std::make_unique<core::Expr>(core::Expr{.node = std::move(cond)}));
+      lam.count = i % 7;
+      prog.emplace_back(core::Define{
+          .name = 100 + i,
+          .rhs = std::make_unique<core::Expr>(
+              core::Expr{.node = std::move(lam)})});
+      core::Apply call;
+      call.callee = std::make_unique<core::Expr>(var_expr(100 + i));
+      call.args.push_back(std::make_unique<core::Expr>(const_expr(i)));
+      prog.emplace_back(core::Expr{.node = std::move(call)});
+    }
+    return prog;
+  }();
+
+  Generator serial(program, 1);
+  const auto expected = serial.generate();
+  for (unsigned threads : {2U, 4U, 8U}) {
+    Generator parallel(program, threads);
+    const auto code = parallel.generate();
+    EXPECT_EQ(parallel.global_ids(), serial.global_ids());
+    ASSERT_EQ(code.size(), expected.size());
+    for (size_t i = 0; i < code.size(); i++) {
+      EXPECT_EQ(code[i].op, expected[i].op) << i;
+      EXPECT_EQ(code[i].operand, expected[i].operand) << i;
+      EXPECT_EQ(code[i].site, expected[i].site) << i;
+    }
+  }
+}
@@ -0,0 +1,123 @@
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <optimizer/inliner.hpp>
+
+namespace {
+
+constexpr core::SymbolId kSub = 1;
+constexpr core::SymbolId kMul = 2;
+constexpr core::SymbolId kSq = 20;
+constexpr core::SymbolId kX = 21;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr apply_expr(core::SymbolId callee, std::vector<core::Expr> args,
+                      uint64_t count = 0) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  for (auto &arg : args)
+    apply.args.push_back(std::make_unique<core::Expr>(std::move(arg)));
+  apply.count = count;
+  return core::Expr{.node = std::move(apply)};
+}
+
+// (define sq (lambda (x) body))
+core::Define define_sq(core::Expr body) {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(kX));
+  lam.body.push_back(std::make_unique<core::Expr>(std::move(body)));
+  return core::Define{
+      .name = kSq,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})};
+}
+
+core::Expr square_x() {
+  std::vector<core::Expr> args;
+  args.push_back(var_expr(kX));
+  args.push_back(var_expr(kX));
+  return apply_expr(kMul, std::move(args));
+}
+
+core::Expr call_sq(uint64_t arg, uint64_t count) {
+  std::vector<core::Expr> args;
+  args.push_back(const_expr(arg));
+  return apply_expr(kSq, std::move(args), count);
+}
+
+// the let a call was inlined into, or null when it is still a call
+const core::Lambda *inlined(const core::Top &top) {
+  const auto &apply = std::get<core::Apply>(std::get<core::Expr>(top).node);
+  return std::get_if<core::Lambda>(&apply.callee->node);
+}
+
+} // namespace
+
+TEST(InlinerTests, HotCallBecomesRenamedLet) {
+  // (define sq (lambda (x) (* x x))) (sq 3)
+  core::Program prog;
+  prog.emplace_back(define_sq(square_x()));
+  prog.emplace_back(call_sq(3, 10));
+  Inliner inliner;
+  inliner.run(prog);
+
+  const auto *let = inlined(prog[1]);
+  ASSERT_NE(let, nullptr);
+  ASSERT_EQ(let->formals.size(), 1U);
+  const auto formal = *let->formals[0];
+  EXPECT_NE(formal, kX);
+  const auto &body = std::get<core::Apply>(let->body[0]->node);
+  EXPECT_EQ(std::get<core::Var>(body.args[0]->node).id, formal);
+  EXPECT_EQ(std::get<core::Var>(body.args[1]->node).id, formal);
+  // the function itself is left alone
+  const auto &def = std::get<core::Define>(prog[0]);
+  EXPECT_EQ(*std::get<core::Lambda>(def.rhs->node).formals[0], kX);
+}
+
+TEST(InlinerTests, ColdCallStaysCall) {
+  core::Program prog;
+  prog.emplace_back(define_sq(square_x()));
+  prog.emplace_back(call_sq(3, 100));
+  prog.emplace_back(call_sq(4, 5));
+  Inliner inliner;
+  inliner.run(prog);
+
+  EXPECT_NE(inlined(prog[1]), nullptr);
+  EXPECT_EQ(inlined(prog[2]), nullptr);
+}
+
+TEST(InlinerTests, RecursiveFunctionStaysCall) {
+  // (define sq (lambda (x) (sq (- x 1)))) (sq 3)
+  std::vector<core::Expr> sub;
+  sub.push_back(var_expr(kX));
+  sub.push_back(const_expr(1));
+  std::vector<core::Expr> args;
+  args.push_back(apply_expr(kSub, std::move(sub)));
+  core::Program prog;
+  prog.emplace_back(define_sq(apply_expr(kSq, std::move(args), 50)));
+  prog.emplace_back(call_sq(3, 1));
+  Inliner inliner;
+  inliner.run(prog);
+
+  EXPECT_EQ(inlined(prog[1]), nullptr);
+}
+
+TEST(InlinerTests, NothingIsHotWithoutProfile) {
+  core::Program prog;
+  prog.emplace_back(define_sq(square_x()));
+  prog.emplace_back(call_sq(3, 0));
+  Inliner inliner;
+  inliner.run(prog);
+
+  EXPECT_EQ(inlined(prog[1]), nullptr);
+}
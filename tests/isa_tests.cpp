@@ -0,0 +1,87 @@
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/isa/isa.hpp>
+
+namespace {
+
+using ISA::Operation;
+
+// decodes every instruction of the encoding in turn
+std::vector<ISA::Decoded> decode_all(const ISA::Encoded &encoded) {
+  std::vector<ISA::Decoded> out;
+  for (size_t offset = 0; offset < encoded.bytes.size();) {
+    out.push_back(ISA::decode(encoded.bytes.data(), offset));
+    offset = out.back().next;
+  }
+  return out;
+}
+
+} // namespace
+
+TEST(EncodeTests, OperandsTakeOnlyTheBytesTheyNeed) {
+  std::vector<ISA::Instruction> code{
+      {Operation::ADD, std::nullopt}, // 1
+      {Operation::PUSH, 5},           // 2
+      {Operation::PUSH, 300},         // 3
+      {Operation::JMP, 0},            // 5
+      {Operation::HALT, std::nullopt},
+  };
+  auto encoded = ISA::encode(code);
+  EXPECT_EQ(encoded.offsets, (std::vector<uint32_t>{0, 1, 3, 6, 11, 12}));
+  EXPECT_EQ(encoded.bytes.size(), 12U);
+}
+
+TEST(EncodeTests, AddressesBecomeByteOffsets) {
+  // 0: cjmp 3  1: push 1  2: halt  3: push 2  4: jmp 1
+  std::vector<ISA::Instruction> code{
+      {Operation::CJMP, 3}, {Operation::PUSH, 1}, {Operation::HALT, {}},
+      {Operation::PUSH, 2}, {Operation::JMP, 1},
+  };
+  auto encoded = ISA::encode(code);
+  auto decoded = decode_all(encoded);
+  ASSERT_EQ(decoded.size(), code.size());
+  EXPECT_EQ(decoded[0].operand, encoded.offsets[3]);
+  EXPECT_EQ(decoded[4].operand, encoded.offsets[1]);
+  EXPECT_EQ(decoded[4].next, encoded.bytes.size());
+}
+
+TEST(EncodeTests, DecodeRoundTripsEveryOperand) {
+  std::vector<ISA::Instruction> code{
+      {Operation::PUSH, 0},
+      {Operation::PUSH, 127},
+      {Operation::PUSH, 128},
+      {Operation::ADDI, uint64_t{0} - 1},
+      {Operation::ADDLL, ISA::pack(3, 70000)},
+      {Operation::DROP, std::nullopt},
+  };
+  auto decoded = decode_all(ISA::encode(code));
+  ASSERT_EQ(decoded.size(), code.size());
+  for (size_t i = 0; i < code.size(); i++) {
+    EXPECT_EQ(decoded[i].op, code[i].op);
+    EXPECT_EQ(decoded[i].operand, code[i].operand.value_or(0));
+  }
+}
+
+TEST(EncodeTests, AddressPastTheEndThrows) {
+  std::vector<ISA::Instruction> code{{Operation::JMP, 2}};
+  EXPECT_THROW(ISA::encode(code), std::out_of_range);
+}
+
+TEST(EncodeTests, DecodeCodeGivesBackTheInstructions) {
+  std::vector<ISA::Instruction> code{
+      {Operation::CJMP, 3},   {Operation::PUSH, 300},
+      {Operation::HALT, {}},  {Operation::ADDLL, ISA::pack(1, 2)},
+      {Operation::JMP, 1},
+  };
+  const auto decoded = ISA::decode_code(ISA::encode(code).bytes);
+  ASSERT_EQ(decoded.size(), code.size());
+  for (size_t i = 0; i < code.size(); i++) {
+    EXPECT_EQ(decoded[i].op, code[i].op);
+    EXPECT_EQ(decoded[i].operand, code[i].operand);
+  }
+}
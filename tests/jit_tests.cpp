@@ -0,0 +1,110 @@
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/vm/jit.hpp>
+#include <backend/vm/stack.hpp>
+#include <optimizer/pass_manager.hpp>
+
+#include "compile.hpp"
+
+namespace {
+
+struct Run {
+  MachineState state;
+  int64_t value;
+  uint64_t executed;
+  size_t compiled;
+};
+
+// runs src on the interpreter, or with every function compiled on its first
+// call when jit is set
+Run run(const std::string &src, bool jit, OptLevel level = OptLevel::O2) {
+  Stack vm(test::compile(src, level));
+  if (jit) {
+    EXPECT_TRUE(vm.enable_jit(1));
+  }
+  const auto state = vm.run_program();
+  const auto result = vm.result();
+  return {state, result ? result->value : 0, vm.executed(),
+          vm.jit_state() ? vm.jit_state()->compiled() : 0};
+}
+
+const std::string programs[] = {
+    "(define (fib n) (if (< 2 n) n (+ (fib (- n 1)) (fib (- n 2)))))"
+    "(fib 15)",
+    "(define (sum-to n acc) (if (eq n 0) acc (sum-to (- n 1) (+ acc n))))"
+    "(sum-to 500 0)",
+    "(define (build n acc) (if (eq n 0) acc (build (- n 1) (cons n acc))))"
+    "(define (sum xs acc) (if (null? xs) acc (sum (cdr xs) (+ acc (car xs)))))"
+    "(sum (build 100 nil) 0)",
+    "(define (compose f g) (lambda (x) (f (g x))))"
+    "(define inc2 (compose (lambda (x) (+ x 1)) (lambda (x) (+ x 1))))"
+    "(define (loop f n acc) (if (eq n 0) acc (loop f (- n 1) (f acc))))"
+    "(loop inc2 50 0)",
+    "(define (counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))"
+    "(define c (counter))"
+    "(c) (c) (+ (c) (c))",
+};
+
+} // namespace
+
+TEST(JitTests, NativeCodeRunsLikeTheInterpreter) {
+  if (!Jit::supported())
+    GTEST_SKIP() << "the JIT emits x86-64 code for Linux";
+  for (auto level : {OptLevel::O0, OptLevel::O2}) {
+    for (const auto &src : programs) {
+      const auto interpreted = run(src, false, level);
+      const auto native = run(src, true, level);
+      EXPECT_EQ(native.state, MachineState::HALT) << src;
+      EXPECT_EQ(native.value, interpreted.value) << src;
+      EXPECT_EQ(native.executed, interpreted.executed) << src;
+      EXPECT_GT(native.compiled, 0U) << src;
+    }
+  }
+}
+
+TEST(JitTests, OnlyHotFunctionsAreCompiled) {
+  if (!Jit::supported())
+    GTEST_SKIP() << "the JIT emits x86-64 code for Linux";
+  Stack vm(test::compile("(define (f x) (+ x 1))"
+                   "(define (g x) (* x 2))"
+                   "(+ (g 1) (+ (f 1) (+ (f 2) (f 3))))"));
+  ASSERT_TRUE(vm.enable_jit(3));
+  EXPECT_EQ(vm.run_program(), MachineState::HALT);
+  EXPECT_EQ(vm.result()->value, 11);
+  EXPECT_EQ(vm.jit_state()->compiled(), 1U);
+}
+
+TEST(JitTests, CompiledFunctionsAreInThePerfMap) {
+  if (!Jit::supported())
+    GTEST_SKIP() << "the JIT emits x86-64 code for Linux";
+  run(programs[0], true);
+  std::ifstream map("/tmp/perf-" + std::to_string(::getpid()) + ".map");
+  std::stringstream contents;
+  contents << map.rdbuf();
+  EXPECT_NE(contents.str().find(" splisp_jit_"), std::string::npos);
+}
+
+TEST(JitTests, RuntimeErrorLeavesNativeCode) {
+  if (!Jit::supported())
+    GTEST_SKIP() << "the JIT emits x86-64 code for Linux";
+  // the second call calls a number
+  const auto src = "(define (f x) (if (eq x 0) 0 (x 1)))"
+                   "(+ (f 0) (f 1))";
+  Stack vm(test::compile(src, OptLevel::O0));
+  ASSERT_TRUE(vm.enable_jit(1));
+  EXPECT_EQ(vm.run_program(), MachineState::INVALID_OP);
+}
+
+TEST(JitTests, ProfilingTurnsTheJitOff) {
+  Stack vm(test::compile(programs[0]));
+  vm.enable_profile();
+  EXPECT_FALSE(vm.enable_jit(1));
+  EXPECT_EQ(vm.jit_state(), nullptr);
+}
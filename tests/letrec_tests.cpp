@@ -0,0 +1,137 @@
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <optimizer/letrec.hpp>
+
+namespace {
+
+constexpr core::SymbolId kSub = 1;
+constexpr core::SymbolId kLoop = 30;
+constexpr core::SymbolId kI = 31;
+constexpr core::SymbolId kN = 40;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr apply_expr(core::SymbolId callee, std::vector<core::Expr> args) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  for (auto &arg : args)
+    apply.args.push_back(std::make_unique<core::Expr>(std::move(arg)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Lambda lambda(std::vector<core::SymbolId> formals,
+                    std::vector<core::Expr> body) {
+  core::Lambda lam;
+  for (auto formal : formals)
+    lam.formals.push_back(std::make_unique<core::SymbolId>(formal));
+  for (auto &stmt : body)
+    lam.body.push_back(std::make_unique<core::Expr>(std::move(stmt)));
+  return lam;
+}
+
+// what the parser makes of (letrec ((loop (lambda (i) body))) tail)
+core::Expr letrec_expr(core::Expr body, core::Expr tail) {
+  std::vector<core::Expr> loop_body;
+  loop_body.push_back(std::move(body));
+  std::vector<core::Expr> let_body;
+  let_body.push_back(core::Expr{
+      .node = core::Set{.name = kLoop,
+                        .rhs = std::make_unique<core::Expr>(core::Expr{
+                            .node = lambda({kI}, std::move(loop_body))})}});
+  let_body.push_back(std::move(tail));
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(
+      core::Expr{.node = lambda({kLoop}, std::move(let_body))});
+  apply.args.push_back(
+      std::make_unique<core::Expr>(core::Expr{.node = core::Undef{}}));
+  return core::Expr{.node = std::move(apply)};
+}
+
+// (loop (- i n))
+core::Expr recur(core::SymbolId by) {
+  std::vector<core::Expr> sub;
+  sub.push_back(var_expr(kI));
+  sub.push_back(var_expr(by));
+  std::vector<core::Expr> args;
+  args.push_back(apply_expr(kSub, std::move(sub)));
+  return apply_expr(kLoop, std::move(args));
+}
+
+core::Expr call_loop(core::Expr arg) {
+  std::vector<core::Expr> args;
+  args.push_back(std::move(arg));
+  return apply_expr(kLoop, std::move(args));
+}
+
+} // namespace
+
+TEST(LetrecTests, ClosedGroupBecomesGlobalFunction) {
+  // (letrec ((loop (lambda (i) (loop (- i i))))) (loop 1))
+  core::Program prog;
+  prog.emplace_back(letrec_expr(recur(kI), call_loop(const_expr(1))));
+
+  LetrecFixer fixer;
+  fixer.run(prog);
+
+  ASSERT_EQ(prog.size(), 2U);
+  const auto &def = std::get<core::Define>(prog[0]);
+  const auto &lam = std::get<core::Lambda>(def.rhs->node);
+  ASSERT_EQ(lam.formals.size(), 1U);
+  // the recursive call and the body call go to the hidden global
+  const auto &inner = std::get<core::Apply>(lam.body[0]->node);
+  EXPECT_EQ(std::get<core::Var>(inner.callee->node).id, def.name);
+  const auto &outer = std::get<core::Apply>(std::get<core::Expr>(prog[1]).node);
+  EXPECT_EQ(std::get<core::Var>(outer.callee->node).id, def.name);
+  EXPECT_EQ(outer.args.size(), 1U);
+}
+
+TEST(LetrecTests, FreeLocalIsPassedAlong) {
+  // (lambda (n) (letrec ((loop (lambda (i) (loop (- i n))))) (loop n)))
+  std::vector<core::Expr> body;
+  body.push_back(letrec_expr(recur(kN), call_loop(var_expr(kN))));
+  core::Program prog;
+  prog.emplace_back(core::Expr{.node = lambda({kN}, std::move(body))});
+
+  LetrecFixer fixer;
+  fixer.run(prog);
+
+  ASSERT_EQ(prog.size(), 2U);
+  const auto &def = std::get<core::Define>(prog[0]);
+  const auto &lam = std::get<core::Lambda>(def.rhs->node);
+  // n comes first, renamed, then i
+  ASSERT_EQ(lam.formals.size(), 2U);
+  const auto renamed = *lam.formals[0];
+  EXPECT_NE(renamed, kN);
+  const auto &inner = std::get<core::Apply>(lam.body[0]->node);
+  ASSERT_EQ(inner.args.size(), 2U);
+  EXPECT_EQ(std::get<core::Var>(inner.args[0]->node).id, renamed);
+
+  const auto &outer_lam = std::get<core::Lambda>(std::get<core::Expr>(prog[1]).node);
+  const auto &call = std::get<core::Apply>(outer_lam.body[0]->node);
+  ASSERT_EQ(call.args.size(), 2U);
+  EXPECT_EQ(std::get<core::Var>(call.args[0]->node).id, kN);
+}
+
+TEST(LetrecTests, EscapingNameKeepsTheSetForm) {
+  // (letrec ((loop (lambda (i) (loop (- i i))))) loop)
+  core::Program prog;
+  prog.emplace_back(letrec_expr(recur(kI), var_expr(kLoop)));
+
+  LetrecFixer fixer;
+  fixer.run(prog);
+
+  ASSERT_EQ(prog.size(), 1U);
+  const auto &apply = std::get<core::Apply>(std::get<core::Expr>(prog[0]).node);
+  EXPECT_TRUE(std::holds_alternative<core::Undef>(apply.args[0]->node));
+}
@@ -1,5 +1,6 @@
 #include <cstdint>
 #include <memory>
+#include <sstream>
 #include <utility>
 #include <vector>
 
@@ -158,3 +159,26 @@ TEST(LowererTests, UndefLowersToCoreUndef) {
 }
 
 } // namespace
+
+TEST(LowererTests, ProfileSitesRoundTrip) {
+  // (if 1 2 3) numbered: the cond takes sites 1 and 2
+  core::Cond cond;
+  cond.condition =
+      std::make_unique<core::Expr>(core::Expr{.node = core::Const{1}});
+  cond.then =
+      std::make_unique<core::Expr>(core::Expr{.node = core::Const{2}});
+  cond.otherwise =
+      std::make_unique<core::Expr>(core::Expr{.node = core::Const{3}});
+  core::Program program;
+  program.emplace_back(core::Expr{.node = std::move(cond)});
+  core::number_sites(program);
+  auto &numbered = std::get<core::Cond>(std::get<core::Expr>(program[0]).node);
+  EXPECT_EQ(numbered.site, 1U);
+
+  // a CJMPZ to otherwise ran 10 times and jumped 4
+  std::stringstream file;
+  core::write_profile(file, core::Profile{{2, core::SiteCount{10, 4}}});
+  core::apply_profile(program, core::read_profile(file));
+  EXPECT_EQ(numbered.then_count, 6U);
+  EXPECT_EQ(numbered.otherwise_count, 4U);
+}
@@ -0,0 +1,199 @@
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <middle/middle_end.hpp>
+#include <middle/passes.hpp>
+#include <middle/ssa.hpp>
+
+namespace {
+
+constexpr core::SymbolId kAdd = 0;
+constexpr core::SymbolId kMul = 2;
+constexpr core::SymbolId kEq = 10;
+constexpr core::SymbolId kFunc = 20;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr apply_expr(core::SymbolId callee, core::Expr lhs, core::Expr rhs) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(lhs)));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(rhs)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Expr call_expr(core::SymbolId callee, core::Expr arg) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(arg)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Expr set_expr(core::SymbolId name, core::Expr rhs) {
+  return core::Expr{
+      .node = core::Set{.name = name,
+                        .rhs = std::make_unique<core::Expr>(std::move(rhs))}};
+}
+
+core::Expr cond_expr(core::Expr condition, core::Expr then,
+                     core::Expr otherwise) {
+  return core::Expr{
+      .node = core::Cond{
+          .condition = std::make_unique<core::Expr>(std::move(condition)),
+          .then = std::make_unique<core::Expr>(std::move(then)),
+          .otherwise = std::make_unique<core::Expr>(std::move(otherwise))}};
+}
+
+core::Lambda lambda(core::SymbolId formal, std::vector<core::Expr> body) {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(formal));
+  for (auto &stmt : body)
+    lam.body.push_back(std::make_unique<core::Expr>(std::move(stmt)));
+  return lam;
+}
+
+// (let ((id value)) body...)
+core::Expr let_expr(core::SymbolId id, core::Expr value,
+                    std::vector<core::Expr> body) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(
+      core::Expr{.node = lambda(id, std::move(body))});
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(value)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+// (define f (lambda (x) body...))
+core::Define define_func(core::SymbolId formal, std::vector<core::Expr> body) {
+  return core::Define{.name = kFunc,
+                      .rhs = std::make_unique<core::Expr>(core::Expr{
+                          .node = lambda(formal, std::move(body))})};
+}
+
+const core::Lambda &func_lambda(const core::Program &prog) {
+  return std::get<core::Lambda>(std::get<core::Define>(prog[0]).rhs->node);
+}
+
+const core::Lambda &let_lambda(const core::Expr &expr) {
+  return std::get<core::Lambda>(
+      std::get<core::Apply>(expr.node).callee->node);
+}
+
+} // namespace
+
+TEST(MiddleEndTests, SccpFoldsConstantArithmetic) {
+  // (* (+ 1 2) 4)
+  core::Program prog;
+  prog.emplace_back(
+      apply_expr(kMul, apply_expr(kAdd, const_expr(1), const_expr(2)),
+                 const_expr(4)));
+
+  ssa::Builder builder;
+  auto functions = builder.build(prog);
+  ASSERT_EQ(functions.size(), 1U);
+  ssa::SCCP sccp;
+  sccp.run(functions[0]);
+  const auto &result = functions[0].lattice[functions[0].result];
+  EXPECT_EQ(result.kind, ssa::Lattice::CONST);
+  EXPECT_EQ(result.value, 12);
+
+  MiddleEnd middle_end;
+  middle_end.run(prog);
+  auto *konst = std::get_if<core::Const>(&std::get<core::Expr>(prog[0]).node);
+  ASSERT_NE(konst, nullptr);
+  EXPECT_EQ(konst->value, 12U);
+}
+
+TEST(MiddleEndTests, BranchOnConstantKeepsTakenSide) {
+  // (if (eq 1 1) 10 (f 2)), the else side is never reachable
+  core::Program prog;
+  prog.emplace_back(cond_expr(apply_expr(kEq, const_expr(1), const_expr(1)),
+                              const_expr(10), call_expr(kFunc, const_expr(2))));
+
+  ssa::Builder builder;
+  auto functions = builder.build(prog);
+  ssa::SCCP sccp;
+  sccp.run(functions[0]);
+  // entry, then, else, join
+  ASSERT_EQ(functions[0].blocks.size(), 4U);
+  EXPECT_TRUE(functions[0].reachable[1]);
+  EXPECT_FALSE(functions[0].reachable[2]);
+
+  MiddleEnd middle_end;
+  middle_end.run(prog);
+  auto *konst = std::get_if<core::Const>(&std::get<core::Expr>(prog[0]).node);
+  ASSERT_NE(konst, nullptr);
+  EXPECT_EQ(konst->value, 10U);
+}
+
+TEST(MiddleEndTests, GvnReusesLocalHoldingTheValue) {
+  // (define (f x) (let ((y (* x x))) (+ y (* x x))))
+  std::vector<core::Expr> let_body;
+  let_body.push_back(
+      apply_expr(kAdd, var_expr(31),
+                 apply_expr(kMul, var_expr(30), var_expr(30))));
+  std::vector<core::Expr> body;
+  body.push_back(let_expr(31, apply_expr(kMul, var_expr(30), var_expr(30)),
+                          std::move(let_body)));
+  core::Program prog;
+  prog.emplace_back(define_func(30, std::move(body)));
+
+  MiddleEnd middle_end;
+  middle_end.run(prog);
+
+  const auto &let = let_lambda(*func_lambda(prog).body[0]);
+  const auto &sum = std::get<core::Apply>(let.body[0]->node);
+  auto *reused = std::get_if<core::Var>(&sum.args[1]->node);
+  ASSERT_NE(reused, nullptr);
+  EXPECT_EQ(reused->id, 31U);
+}
+
+TEST(MiddleEndTests, OverwrittenStoreIsDead) {
+  // (define (f x) (let ((y 1)) (set! y 2) (set! y x) y))
+  std::vector<core::Expr> let_body;
+  let_body.push_back(set_expr(31, const_expr(2)));
+  let_body.push_back(set_expr(31, var_expr(30)));
+  let_body.push_back(var_expr(31));
+  std::vector<core::Expr> body;
+  body.push_back(let_expr(31, const_expr(1), std::move(let_body)));
+  core::Program prog;
+  prog.emplace_back(define_func(30, std::move(body)));
+
+  MiddleEnd middle_end;
+  middle_end.run(prog);
+
+  const auto &let = let_lambda(*func_lambda(prog).body[0]);
+  ASSERT_EQ(let.body.size(), 2U);
+  auto *set = std::get_if<core::Set>(&let.body[0]->node);
+  ASSERT_NE(set, nullptr);
+  EXPECT_TRUE(std::holds_alternative<core::Var>(set->rhs->node));
+}
+
+TEST(MiddleEndTests, StoreReadLaterIsKept) {
+  // (define (f x) (let ((y 1)) (f (set! y x)) y))
+  std::vector<core::Expr> let_body;
+  let_body.push_back(call_expr(kFunc, set_expr(31, var_expr(30))));
+  let_body.push_back(var_expr(31));
+  std::vector<core::Expr> body;
+  body.push_back(let_expr(31, const_expr(1), std::move(let_body)));
+  core::Program prog;
+  prog.emplace_back(define_func(30, std::move(body)));
+
+  MiddleEnd middle_end;
+  middle_end.run(prog);
+
+  // the set! evaluates to a constant 0 but folding it would lose the store
+  const auto &let = let_lambda(*func_lambda(prog).body[0]);
+  ASSERT_EQ(let.body.size(), 2U);
+  const auto &call = std::get<core::Apply>(let.body[0]->node);
+  EXPECT_TRUE(std::holds_alternative<core::Set>(call.args[0]->node));
+}
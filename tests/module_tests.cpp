@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/isa/isa.hpp>
+#include <backend/module/module.hpp>
+#include <backend/vm/stack.hpp>
+#include <frontend/core.hpp>
+#include <frontend/scoper.hpp>
+#include <optimizer/pass_manager.hpp>
+
+#include "compile.hpp"
+
+struct StackTestAccess {
+  static std::vector<std::shared_ptr<Cell>> &data(Stack &stack) {
+    return stack.data_stack;
+  }
+};
+
+namespace {
+
+// a module file in the temporary directory, removed again by the test
+struct TempModule {
+  std::string path;
+  explicit TempModule(const std::string &name)
+      : path((std::filesystem::temp_directory_path() / name).string()) {}
+  ~TempModule() { std::filesystem::remove(this->path); }
+
+  void write(const SPLC::Image &image) const {
+    std::ofstream file(this->path, std::ios::binary);
+    SPLC::write(file, image);
+  }
+  std::vector<char> read() const {
+    std::ifstream file(this->path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), {}};
+  }
+  void overwrite(const std::vector<char> &bytes) const {
+    std::ofstream file(this->path, std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+  }
+};
+
+// compiles src as main.cpp does, to an object when object is set
+SPLC::Image compile(const std::string &src, bool object = false) {
+  Scoper scoper(object);
+  core::Lowerer lowerer;
+  core::Program &ir = test::lower(src, lowerer, scoper);
+  auto passes =
+      PassManager::pipeline(OptLevel::O2, nullptr, scoper.exported());
+  auto bc = passes.run(ir);
+  return SPLC::make_image(bc, SPLC::symbols(passes.global_ids(), scoper),
+                          object ? SPLC::Kind::OBJECT : SPLC::Kind::PROGRAM,
+                          passes.halt_depth());
+}
+
+// writes each source as an object and links them in order
+SPLC::Linked link(const std::vector<std::string> &sources) {
+  std::vector<SPLC::Module> modules;
+  for (size_t i = 0; i < sources.size(); i++) {
+    TempModule file("splisp_link_" + std::to_string(i) + ".splc");
+    file.write(compile(sources[i], true));
+    modules.push_back(SPLC::Module::load(file.path));
+  }
+  return SPLC::link(modules);
+}
+
+// the value the code leaves on top of the stack
+int64_t run(const std::vector<ISA::Instruction> &code) {
+  Stack vm(code);
+  vm.verify();
+  EXPECT_EQ(vm.run_program(), MachineState::HALT);
+  auto &data = StackTestAccess::data(vm);
+  EXPECT_FALSE(data.empty());
+  return data.empty() ? 0 : data.back()->value;
+}
+
+const std::string program = R"(
+  (define (sum-to n acc) (if (eq n 0) acc (sum-to (- n 1) (+ acc n))))
+  (define (sq x) (* x x))
+  (+ (sum-to 100 0) (sq 12))
+)";
+
+} // namespace
+
+TEST(ModuleTests, LoadedModuleRunsLikeTheSource) {
+  TempModule file("splisp_module_runs.splc");
+  const auto image = compile(program);
+  file.write(image);
+
+  const auto module = SPLC::Module::load(file.path);
+  EXPECT_TRUE(std::equal(module.code().begin(), module.code().end(),
+                         image.code.begin(), image.code.end()));
+  ASSERT_EQ(module.globals().size(), image.globals.size());
+  for (size_t i = 0; i < image.globals.size(); i++) {
+    EXPECT_EQ(module.name(module.globals()[i]), image.globals[i].name);
+    EXPECT_TRUE(module.globals()[i].defined);
+  }
+  EXPECT_EQ(module.sites().size(), image.sites.size());
+
+  Stack vm(module);
+  EXPECT_EQ(vm.run_program(), MachineState::HALT);
+  auto &data = StackTestAccess::data(vm);
+  ASSERT_EQ(data.size(), 1U);
+  EXPECT_EQ(data.back()->value, 5050 + 144);
+}
+
+TEST(ModuleTests, SitesAreKeptByOffset) {
+  std::vector<ISA::Instruction> code{
+      {ISA::Operation::PUSH, 1},
+      {ISA::Operation::CJMP, 3, 7},
+      {ISA::Operation::PUSH, 2},
+      {ISA::Operation::HALT, std::nullopt},
+  };
+  const auto image = SPLC::make_image(code, {});
+  ASSERT_EQ(image.sites.size(), 1U);
+  EXPECT_EQ(image.sites[0].offset, 2U);
+  EXPECT_EQ(image.sites[0].site, 7U);
+}
+
+TEST(ModuleTests, CorruptModuleIsRejected) {
+  TempModule file("splisp_module_corrupt.splc");
+  file.write(compile(program));
+  auto bytes = file.read();
+  bytes.back() ^= 0x40;
+  file.overwrite(bytes);
+  EXPECT_THROW(SPLC::Module::load(file.path), std::runtime_error);
+}
+
+TEST(ModuleTests, OtherVersionIsRejected) {
+  TempModule file("splisp_module_version.splc");
+  file.write(compile(program));
+  auto bytes = file.read();
+  // the version follows the four byte magic
+  bytes[4] = static_cast<char>(SPLC::version + 1);
+  file.overwrite(bytes);
+  EXPECT_THROW(SPLC::Module::load(file.path), std::runtime_error);
+}
+
+TEST(ModuleTests, SourceFileIsNotAModule) {
+  TempModule file("splisp_module_source.splc");
+  file.overwrite(std::vector<char>(program.begin(), program.end()));
+  EXPECT_THROW(SPLC::Module::load(file.path), std::runtime_error);
+  EXPECT_THROW(SPLC::Module::load(file.path + ".missing"),
+               std::runtime_error);
+}
+
+TEST(ModuleTests, ObjectDoesNotRunUnlinked) {
+  TempModule file("splisp_module_object.splc");
+  file.write(compile("(define (sq x) (* x x))", true));
+  const auto module = SPLC::Module::load(file.path);
+  EXPECT_EQ(module.kind(), SPLC::Kind::OBJECT);
+  EXPECT_THROW(Stack vm(module), std::invalid_argument);
+}
+
+TEST(LinkTests, LinkedObjectsRunLikeOneSource) {
+  const auto linked = link({
+      R"((define (sum-to n acc) (if (eq n 0) acc (sum-to (- n 1) (+ acc n))))
+         (define (sq x) (* x x)))",
+      "(+ (sum-to 100 0) (sq 12))",
+  });
+  EXPECT_EQ(run(linked.code), 5050 + 144);
+}
+
+TEST(LinkTests, ExportedFunctionsSurviveTheOptimizer) {
+  // nothing in the library calls either function, nor with a known argument
+  const auto linked = link({
+      "(define (twice f x) (f (f x))) (define (inc x) (+ x 1))",
+      "(define (add3 x) (+ x 3)) (twice add3 (twice inc 10))",
+  });
+  EXPECT_EQ(run(linked.code), 18);
+}
+
+TEST(LinkTests, TopLevelsRunInOrder) {
+  const auto linked = link({
+      "(define base 40)",
+      "(define answer (+ base 2))",
+      "answer",
+  });
+  EXPECT_EQ(run(linked.code), 42);
+}
+
+TEST(LinkTests, NextModuleStartsOnAnEmptyStack) {
+  // the 7 the first top level leaves would be captured by the closures of
+  // the second and shift its frames
+  const auto linked = link({
+      "(define base 100) 7",
+      "(define add (lambda (x y) (- x y))) (define h add) (h 10 3)",
+  });
+  EXPECT_EQ(run(linked.code), 7);
+  EXPECT_EQ(linked.halt_depth, 1U);
+}
+
+TEST(LinkTests, UndefinedGlobalIsRejected) {
+  EXPECT_THROW(link({"(missing 1)"}), std::runtime_error);
+}
+
+TEST(LinkTests, GlobalDefinedTwiceIsRejected) {
+  EXPECT_THROW(link({"(define x 1)", "(define x 2)"}), std::runtime_error);
+}
+
+TEST(LinkTests, SetOfAnotherModulesGlobalIsRejected) {
+  EXPECT_THROW(link({"(define x 1)", "(set! x 2)"}), std::runtime_error);
+}
+
+TEST(LinkTests, ProgramAmongSeveralModulesIsRejected) {
+  // the shaker dropped helper from the program, which sees no caller
+  TempModule lib("splisp_link_program.splc");
+  lib.write(compile("(define (helper x) (+ x 1)) 0"));
+  TempModule user("splisp_link_user.splc");
+  user.write(compile("(helper 1)", true));
+  std::vector<SPLC::Module> modules;
+  modules.push_back(SPLC::Module::load(lib.path));
+  modules.push_back(SPLC::Module::load(user.path));
+  try {
+    SPLC::link(modules);
+    FAIL() << "a program was linked with an object";
+  } catch (const std::runtime_error &e) {
+    EXPECT_NE(std::string(e.what()).find("-c"), std::string::npos);
+  }
+  // on its own it is linked as it is
+  modules.pop_back();
+  EXPECT_NO_THROW(SPLC::link(modules));
+}
@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/isa/isa.hpp>
+#include <frontend/core.hpp>
+#include <optimizer/pass_manager.hpp>
+
+namespace {
+
+constexpr core::SymbolId kAdd = 0;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr add_expr(core::Expr lhs, core::Expr rhs) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(core::Expr{.node = core::Var{kAdd}});
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(lhs)));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(rhs)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Program constant_sum() {
+  // (+ (+ 1 2) 3)
+  core::Program prog;
+  prog.emplace_back(add_expr(add_expr(const_expr(1), const_expr(2)),
+                             const_expr(3)));
+  return prog;
+}
+
+std::vector<std::string> names(const PassManager &manager) {
+  std::vector<std::string> out;
+  for (const auto &report : manager.reports())
+    out.push_back(report.name);
+  return out;
+}
+
+} // namespace
+
+TEST(PassManagerTests, ParsesOptLevels) {
+  EXPECT_EQ(parse_opt_level("-O0"), OptLevel::O0);
+  EXPECT_EQ(parse_opt_level("-O1"), OptLevel::O1);
+  EXPECT_EQ(parse_opt_level("-O2"), OptLevel::O2);
+  EXPECT_FALSE(parse_opt_level("-O3").has_value());
+}
+
+TEST(PassManagerTests, O0OnlyGeneratesCode) {
+  auto prog = constant_sum();
+  auto manager = PassManager::pipeline(OptLevel::O0);
+  auto bytecode = manager.run(prog);
+
+  EXPECT_EQ(names(manager), std::vector<std::string>{"codegen"});
+  const auto &codegen = manager.reports().back();
+  EXPECT_EQ(codegen.ir_before, core::program_size(prog));
+  EXPECT_EQ(codegen.bytecode_after, bytecode.size());
+}
+
+TEST(PassManagerTests, O2ReportsEachPassInOrder) {
+  auto prog = constant_sum();
+  auto manager = PassManager::pipeline(OptLevel::O2);
+  auto bytecode = manager.run(prog);
+
+  EXPECT_EQ(names(manager),
+            (std::vector<std::string>{"letrec", "middle-end", "cse", "shaker",
+                                      "escape", "typer", "codegen",
+                                      "peephole", "superinstructions"}));
+  // the middle end folds the sum into a single constant
+  const auto &middle_end = manager.reports().at(1);
+  EXPECT_EQ(middle_end.ir_before, 7U);
+  EXPECT_EQ(middle_end.ir_after, 1U);
+  // push, halt
+  EXPECT_EQ(bytecode.size(), 2U);
+}
+
+TEST(PassManagerTests, BytecodePassesRunAfterCodegen) {
+  auto prog = constant_sum();
+  auto manager = PassManager::pipeline(OptLevel::O1);
+  manager.add_bytecode("drop-halt", [](std::vector<ISA::Instruction> &bc) {
+    bc.pop_back();
+  });
+  auto bytecode = manager.run(prog);
+
+  const auto &report = manager.reports().back();
+  EXPECT_EQ(report.name, "drop-halt");
+  EXPECT_EQ(report.bytecode_after + 1, report.bytecode_before);
+  EXPECT_EQ(bytecode.size(), report.bytecode_after);
+}
+
+TEST(PassManagerTests, ProfileAddsAnnotationAndInlining) {
+  auto prog = constant_sum();
+  const core::Profile profile;
+  auto manager = PassManager::pipeline(OptLevel::O1, &profile);
+  manager.run(prog);
+
+  EXPECT_EQ(names(manager),
+            (std::vector<std::string>{"profile", "letrec", "inline", "cse",
+                                      "shaker", "escape", "codegen",
+                                      "peephole"}));
+}
+
+TEST(PassManagerTests, ReportColumnsLineUpPastTheLongestName) {
+  auto prog = constant_sum();
+  auto manager = PassManager::pipeline(OptLevel::O2);
+  manager.run(prog);
+
+  std::stringstream out;
+  auto *saved = std::cerr.rdbuf(out.rdbuf());
+  manager.print_reports();
+  std::cerr.rdbuf(saved);
+
+  // every row ends its milliseconds where the header ends "ms"
+  std::string line;
+  std::getline(out, line);
+  const auto ms = line.find("ms") + 2;
+  size_t rows = 0;
+  while (std::getline(out, line)) {
+    ASSERT_GT(line.size(), ms) << line;
+    EXPECT_EQ(line[ms], ' ') << line;
+    EXPECT_NE(line[ms - 1], ' ') << line;
+    rows++;
+  }
+  EXPECT_EQ(rows, manager.reports().size());
+}
@@ -0,0 +1,175 @@
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/isa/isa.hpp>
+#include <optimizer/peephole.hpp>
+
+namespace {
+
+using ISA::Operation;
+
+std::vector<Operation> ops(const std::vector<ISA::Instruction> &code) {
+  std::vector<Operation> out;
+  for (const auto &instr : code)
+    out.push_back(instr.op);
+  return out;
+}
+
+} // namespace
+
+TEST(PeepholeTests, ImmediateAddAndSubtract) {
+  std::vector<ISA::Instruction> code{
+      {Operation::GETLOCAL, 0}, {Operation::PUSH, 5},
+      {Operation::ADD, std::nullopt}, {Operation::PUSH, 1},
+      {Operation::USUB, std::nullopt}, {Operation::PUSH, 2},
+      {Operation::SUB, std::nullopt}, {Operation::HALT, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  ASSERT_EQ(ops(code), (std::vector<Operation>{Operation::GETLOCAL,
+                                               Operation::ADDI, Operation::DEC,
+                                               Operation::ADDI,
+                                               Operation::HALT}));
+  EXPECT_EQ(code[1].operand, 5U);
+  EXPECT_EQ(static_cast<int64_t>(*code[3].operand), -2);
+}
+
+TEST(PeepholeTests, FusedBranchKeepsItsTargetAfterRelocation) {
+  // 0: push 1  1: push 2  2: push 3  3: lt  4: cjmp 8  5: push 0  6: jmp 9
+  // 7: (dead) push 7  8: push 1  9: halt
+  std::vector<ISA::Instruction> code{
+      {Operation::PUSH, 1},
+      {Operation::PUSH, 2},
+      {Operation::PUSH, 3},
+      {Operation::LT, std::nullopt},
+      {Operation::CJMP, 8},
+      {Operation::PUSH, 0},
+      {Operation::JMP, 9},
+      {Operation::PUSH, 7},
+      {Operation::PUSH, 1},
+      {Operation::HALT, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  // the JMP to the HALT becomes a copy of it
+  ASSERT_EQ(code.size(), 9U);
+  EXPECT_EQ(code[3].op, Operation::JLT);
+  EXPECT_EQ(code[3].operand, 7U);
+  EXPECT_EQ(code[5].op, Operation::HALT);
+  EXPECT_EQ(code[7].op, Operation::PUSH);
+}
+
+TEST(PeepholeTests, EpilogueBecomesRetn) {
+  std::vector<ISA::Instruction> code{
+      {Operation::ENTER, 2},        {Operation::GETLOCAL, 0},
+      {Operation::NROT, 3},         {Operation::DROP, 2},
+      {Operation::RET, std::nullopt}, {Operation::ENTER, 0},
+      {Operation::PUSH, 4},         {Operation::NROT, 1},
+      {Operation::DROP, 0},         {Operation::RET, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  ASSERT_EQ(ops(code),
+            (std::vector<Operation>{Operation::ENTER, Operation::GETLOCAL,
+                                    Operation::RETN, Operation::ENTER,
+                                    Operation::PUSH, Operation::RET}));
+  EXPECT_EQ(code[2].operand, 2U);
+}
+
+TEST(PeepholeTests, CodeAfterATailCallIsDropped) {
+  // 0: enter 1  1: cjmp 5  2: getlocal 0  3: tailcall 0  4: jmp 6
+  // 5: push 1  6: nrot 2  7: drop 1  8: ret
+  // only the JMP after the tail call is dead, the epilogue is still joined
+  std::vector<ISA::Instruction> code{
+      {Operation::ENTER, 1},          {Operation::CJMP, 5},
+      {Operation::GETLOCAL, 0},       {Operation::TAILCALL, 0},
+      {Operation::JMP, 6},            {Operation::PUSH, 1},
+      {Operation::NROT, 2},           {Operation::DROP, 1},
+      {Operation::RET, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  ASSERT_EQ(ops(code),
+            (std::vector<Operation>{Operation::ENTER, Operation::CJMP,
+                                    Operation::GETLOCAL, Operation::TAILCALL,
+                                    Operation::PUSH, Operation::RETN}));
+  EXPECT_EQ(code[1].operand, 4U);
+}
+
+TEST(PeepholeTests, ReturnAfterTailCallsOnBothBranchesIsDropped) {
+  // 0: enter 1  1: cjmp 5  2: getlocal 0  3: tailcall 0  4: jmp 7
+  // 5: getlocal 0  6: tailcall 0  7: nrot 2  8: drop 1  9: ret
+  std::vector<ISA::Instruction> code{
+      {Operation::ENTER, 1},    {Operation::CJMP, 5},
+      {Operation::GETLOCAL, 0}, {Operation::TAILCALL, 0},
+      {Operation::JMP, 7},      {Operation::GETLOCAL, 0},
+      {Operation::TAILCALL, 0}, {Operation::NROT, 2},
+      {Operation::DROP, 1},     {Operation::RET, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  ASSERT_EQ(ops(code),
+            (std::vector<Operation>{Operation::ENTER, Operation::CJMP,
+                                    Operation::GETLOCAL, Operation::TAILCALL,
+                                    Operation::GETLOCAL, Operation::TAILCALL}));
+  EXPECT_EQ(code[1].operand, 4U);
+}
+
+TEST(PeepholeTests, JumpChainsAreThreaded) {
+  // 0: cjmp 3  1: push 0  2: halt  3: jmp 4  4: jmp 1
+  std::vector<ISA::Instruction> code{
+      {Operation::CJMP, 3},
+      {Operation::PUSH, 0},
+      {Operation::HALT, std::nullopt},
+      {Operation::JMP, 4},
+      {Operation::JMP, 1},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  EXPECT_EQ(code[0].operand, 1U);
+}
+
+TEST(PeepholeTests, SequenceRunningIntoATargetIsNotFused) {
+  // the ADD is a jump target, so the PUSH before it must stay separate
+  std::vector<ISA::Instruction> code{
+      {Operation::CJMP, 3},
+      {Operation::PUSH, 1},
+      {Operation::PUSH, 2},
+      {Operation::ADD, std::nullopt},
+      {Operation::HALT, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  EXPECT_EQ(code.size(), 5U);
+  EXPECT_EQ(code[3].op, Operation::ADD);
+}
+
+TEST(PeepholeTests, NegatedBranchFusesCjmpzAndKeepsItsSite) {
+  std::vector<ISA::Instruction> code{
+      {Operation::GETLOCAL, 0},
+      {Operation::PUSH, 1},
+      {Operation::EQ, std::nullopt},
+      {Operation::CJMPZ, 5, 3},
+      {Operation::PUSH, 0},
+      {Operation::HALT, std::nullopt},
+  };
+  Peephole peephole;
+  peephole.run(code);
+
+  ASSERT_EQ(ops(code), (std::vector<Operation>{Operation::GETLOCAL,
+                                               Operation::PUSH, Operation::JNE,
+                                               Operation::PUSH,
+                                               Operation::HALT}));
+  EXPECT_EQ(code[2].operand, 4U);
+  EXPECT_EQ(code[2].site, 3U);
+}
@@ -7,9 +7,9 @@
 #include <backend/generator/generator.hpp>
 #include <backend/vm/stack.hpp>
 #include <frontend/core.hpp>
-#include <frontend/lexer.hpp>
-#include <frontend/parser.hpp>
-#include <frontend/scoper.hpp>
+#include <optimizer/pass_manager.hpp>
+
+#include "compile.hpp"
 
 struct StackTestAccess {
   static std::vector<std::shared_ptr<Cell>> &data(Stack &stack) {
@@ -24,19 +24,17 @@ struct RunResult {
   int64_t value;
 };
 
-RunResult run(const std::string &src) {
-  Lexer lex(src);
-  Parser parser(std::move(lex));
-  auto ast = parser.parse();
-  Scoper scoper;
-  scoper.run(ast);
-  scoper.resolve(ast);
-  core::Lowerer lowerer;
-  const core::Program &ir = lowerer.lower(ast);
-  Generator gen(ir);
-  auto bc = gen.generate();
-  Stack vm(bc, {});
+RunResult run(const std::string &src, OptLevel level = OptLevel::O2,
+              const core::Profile *profile = nullptr,
+              core::Profile *collected = nullptr) {
+  Stack vm(test::compile(src, level, profile), {});
+  // as main does, which runs nothing the verifier rejects
+  vm.verify();
+  if (collected)
+    vm.enable_profile();
   auto state = vm.run_program();
+  if (collected)
+    *collected = vm.site_profile();
   auto &data = StackTestAccess::data(vm);
   int64_t val = data.empty() ? 0 : data.back()->value;
   return {state, val};
@@ -128,6 +126,62 @@ TEST(PipelineTests, LambdaWithCond) {
   EXPECT_EQ(val, 0);
 }
 
+// ── Let bindings ───────────────────────────────────────────────────────────
+
+TEST(PipelineTests, LetTwoBindings) {
+  auto [state, val] = run("(let ((x 3) (y 4)) (+ x y))");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 7);
+}
+
+TEST(PipelineTests, LetBindingAParameter) {
+  // the body reads the binding just pushed above the parameter, which the
+  // superinstructions fuse with the read of the parameter into GETLOCAL2
+  for (auto level : {OptLevel::O0, OptLevel::O2}) {
+    auto [state, val] =
+        run("(define g (lambda (p) (let ((v p)) v))) (g 5)", level);
+    EXPECT_EQ(state, MachineState::HALT);
+    EXPECT_EQ(val, 5);
+  }
+  auto [state, val] =
+      run("(define g (lambda (p) (let ((v p)) (+ p v)))) (g 5)");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 10);
+}
+
+TEST(PipelineTests, NestedLetSeesOuterBindings) {
+  auto [state, val] = run("(let ((x 1) (y 2)) (let ((z (+ x y))) (* z 10)))");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 30);
+}
+
+TEST(PipelineTests, LetBindingCapturedByClosure) {
+  auto [state, val] = run(R"(
+    (define (f x) (let ((g (lambda (y) (+ x y)))) (g 5)))
+    (f 3)
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 8);
+}
+
+TEST(PipelineTests, SetLetBinding) {
+  auto [state, val] =
+      run("(define (f x) (let ((a (* x 2))) (set! a (+ a 1)) a)) (f 4)");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 9);
+}
+
+TEST(PipelineTests, FrameLocalClosureAndPair) {
+  auto [state, val] = run(R"(
+    (define (f x)
+      (let ((g (lambda (y) (+ x y))) (p (cons x 2)))
+        (+ (g (car p)) (cdr p))))
+    (f 3)
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 8);
+}
+
 // ── Top-level define + call ────────────────────────────────────────────────
 
 TEST(PipelineTests, DefineAndCallSquare) {
@@ -148,6 +202,163 @@ TEST(PipelineTests, DefineAndCallWithCond) {
   EXPECT_EQ(val, 5);
 }
 
+// ── Tail calls ─────────────────────────────────────────────────────────────
+
+TEST(PipelineTests, TailRecursiveLoop) {
+  auto [state, val] = run(R"(
+    (define (loop n acc) (if (eq n 0) acc (loop (- n 1) (+ acc 1))))
+    (loop 100000 0)
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 100000);
+}
+
+TEST(PipelineTests, LiftedHelperLambda) {
+  auto [state, val] = run(R"(
+    (define (f x)
+      (let ((sq (lambda (y) (* y y))) (ad (lambda (y) (+ x y))))
+        (+ (sq x) (ad 1))))
+    (+ (f 3) (f 1))
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 16);
+}
+
+TEST(PipelineTests, DirectCallsBetweenGlobals) {
+  auto [state, val] = run(R"(
+    (define (ev n) (if (eq n 0) 1 (od (- n 1))))
+    (define (od n) (if (eq n 0) 0 (ev (- n 1))))
+    (define (app f x) (f x))
+    (+ (ev 1000) (app od 7))
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 2);
+}
+
+TEST(PipelineTests, TypedNumericKernel) {
+  auto [state, val] = run(R"(
+    (define (sum-to n) (if (eq n 0) 0 (+ n (sum-to (- n 1)))))
+    (define (second p) (car (cdr p)))
+    (+ (sum-to 100) (second (cons 1 (cons 2 nil))))
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 5052);
+}
+
+TEST(PipelineTests, MiddleEndFoldsAndKeepsLiveStores) {
+  auto [state, val] = run(R"(
+    (define (f x)
+      (let ((y (* x x)) (z 0))
+        (set! z 5)
+        (set! z (+ y (* x x)))
+        (if (eq 1 1) (+ z (- 4 3)) 99)))
+    (f 3)
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 19);
+}
+
+TEST(PipelineTests, EveryOptLevelAgrees) {
+  const std::string src = R"(
+    (define (sum-to n) (if (eq n 0) 0 (+ n (sum-to (- n 1)))))
+    (define (f x) (let ((y (* x x))) (set! y (+ y (* x x))) y))
+    (let ((p (cons 1 2))) (+ (car p) (+ (f 3) (sum-to 10))))
+  )";
+  for (auto level : {OptLevel::O0, OptLevel::O1, OptLevel::O2}) {
+    auto [state, val] = run(src, level);
+    EXPECT_EQ(state, MachineState::HALT);
+    EXPECT_EQ(val, 74);
+  }
+}
+
+TEST(PipelineTests, DroppedArithmeticStillFaultsAtEveryOptLevel) {
+  // the value of (+ f y) is dropped, but f is a closure
+  const std::string src = R"(
+    (define f (lambda (x) x))
+    (define g (lambda (y) (+ f y) 5))
+    (g 1)
+  )";
+  for (auto level : {OptLevel::O0, OptLevel::O1, OptLevel::O2}) {
+    auto [state, val] = run(src, level);
+    EXPECT_EQ(state, MachineState::INVALID_ADD);
+  }
+}
+
+TEST(PipelineTests, CommonSubexpressionsAcrossSet) {
+  auto [state, val] = run(R"(
+    (define (f xs)
+      (let ((a (+ (car (cdr xs)) (car (cdr xs)))))
+        (set! xs (cdr xs))
+        (+ a (+ (car (cdr xs)) (* (car (cdr xs)) (car (cdr xs)))))))
+    (f (cons 1 (cons 2 (cons 3 nil))))
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 16);
+}
+
+TEST(PipelineTests, SuperinstructionsAgreeWithO0) {
+  const std::string src = R"(
+    (define (compose f g) (lambda (x) (f (g x))))
+    (define inc2 (compose (lambda (x) (+ x 1)) (lambda (x) (+ x 1))))
+    (define (loop n acc) (if (eq n 0) acc (loop (- n 1) (inc2 (+ acc n)))))
+    (define (sum xs) (if (null? xs) 0 (+ (car xs) (sum (cdr xs)))))
+    (+ (loop 10 0) (sum (cons 4 (cons 5 nil))))
+  )";
+  for (auto level : {OptLevel::O0, OptLevel::O2}) {
+    auto [state, val] = run(src, level);
+    EXPECT_EQ(state, MachineState::HALT);
+    EXPECT_EQ(val, 84);
+  }
+}
+
+TEST(PipelineTests, ProfileUseAgreesWithO0) {
+  const std::string src = R"(
+    (define (sq x) (* x x))
+    (define (clamp x) (if (< 100 x) 100 x))
+    (define (loop i acc)
+      (if (eq i 0) acc (loop (- i 1) (+ acc (clamp (sq i))))))
+    (loop 30 0)
+  )";
+  core::Profile profile;
+  auto [state, val] = run(src, OptLevel::O2, nullptr, &profile);
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 10070);
+  EXPECT_FALSE(profile.empty());
+  for (auto level : {OptLevel::O0, OptLevel::O1, OptLevel::O2}) {
+    auto [state, val] = run(src, level, &profile);
+    EXPECT_EQ(state, MachineState::HALT);
+    EXPECT_EQ(val, 10070);
+  }
+}
+
+TEST(PipelineTests, ManyGlobalsAndDeepNesting) {
+  // closures nested 20 deep, each over a let, reading every local of the
+  // levels around it and the last of 500 globals
+  std::string src;
+  for (int i = 0; i < 500; i++)
+    src += "(define g" + std::to_string(i) + " " + std::to_string(i) + ")";
+  std::string sum = "g499";
+  for (int k = 1; k <= 20; k++) {
+    const auto n = std::to_string(k);
+    sum = "(+ a" + n + " (+ b" + n + " " + sum + "))";
+  }
+  std::string body = sum;
+  for (int k = 20; k >= 1; k--) {
+    const auto n = std::to_string(k);
+    body = "(lambda (a" + n + ") (let ((b" + n + " (+ a" + n + " 1))) " +
+           body + "))";
+  }
+  std::string call = "f";
+  for (int k = 1; k <= 20; k++)
+    call = "(" + call + " " + std::to_string(k) + ")";
+  src += "(define f " + body + ")" + call;
+  for (auto level : {OptLevel::O0, OptLevel::O2}) {
+    auto [state, val] = run(src, level);
+    EXPECT_EQ(state, MachineState::HALT);
+    EXPECT_EQ(val, 20 * 21 + 20 + 499);
+  }
+}
+
 // ── Mutual recursion via letrec ────────────────────────────────────────────
 
 TEST(PipelineTests, LetrecEvenOdd) {
@@ -160,6 +371,28 @@ TEST(PipelineTests, LetrecEvenOdd) {
   EXPECT_EQ(val, 1); // 4 is even
 }
 
+TEST(PipelineTests, LetrecClosingOverFormal) {
+  auto [state, val] = run(R"(
+    (define (sum-by n)
+      (letrec ((loop (lambda (i acc)
+                       (if (eq i 0) acc (loop (- i 1) (+ acc n))))))
+        (loop n 0)))
+    (sum-by 7)
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 49);
+}
+
+TEST(PipelineTests, LetrecEscapingClosure) {
+  auto [state, val] = run(R"(
+    (define (apply-to f x) (f x))
+    (letrec ((fact (lambda (n) (if (eq n 0) 1 (* n (fact (- n 1)))))))
+      (apply-to fact 5))
+  )");
+  EXPECT_EQ(state, MachineState::HALT);
+  EXPECT_EQ(val, 120);
+}
+
 TEST(PipelineTests, LetrecEvenOddOdd) {
   auto [state, val] = run(R"(
     (letrec ((even? (lambda (n) (if n (odd?  (- n 1)) 1)))
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/generator/register_generator.hpp>
+#include <backend/isa/register_isa.hpp>
+#include <backend/vm/register.hpp>
+#include <backend/vm/stack.hpp>
+#include <frontend/core.hpp>
+#include <optimizer/pass_manager.hpp>
+
+#include "compile.hpp"
+
+struct StackTestAccess {
+  static std::vector<std::shared_ptr<Cell>> &data(Stack &stack) {
+    return stack.data_stack;
+  }
+};
+
+struct RegisterMachineTestAccess {
+  static size_t frames(const RegisterMachine &vm) { return vm.frames.size(); }
+};
+
+namespace {
+
+using RegISA::Instruction;
+using RegISA::Operation;
+
+struct RunResult {
+  MachineState state;
+  int64_t value;
+  uint64_t executed;
+};
+
+std::vector<Instruction> compile(const std::string &src,
+                                 OptLevel level = OptLevel::O0) {
+  core::Lowerer lowerer;
+  core::Program &ir = test::lower(src, lowerer);
+  PassManager::pipeline(level).run_core(ir);
+  RegisterGenerator gen(ir);
+  return gen.generate();
+}
+
+RunResult run_register(const std::string &src, OptLevel level) {
+  RegisterMachine vm(compile(src, level));
+  auto state = vm.run_program();
+  return {state, vm.result() ? vm.result()->value : 0, vm.executed()};
+}
+
+RunResult run_stack(const std::string &src, OptLevel level) {
+  core::Lowerer lowerer;
+  core::Program &ir = test::lower(src, lowerer);
+  Stack vm(PassManager::pipeline(level).run(ir));
+  auto state = vm.run_program();
+  auto &data = StackTestAccess::data(vm);
+  return {state, data.empty() ? 0 : data.back()->value, vm.executed()};
+}
+
+size_t count(const std::vector<Instruction> &code, Operation op) {
+  return std::count_if(code.begin(), code.end(),
+                       [&](auto &instr) { return instr.op == op; });
+}
+
+const std::string loop_src = R"(
+  (define (sq x) (* x x))
+  (define (clamp x) (if (< 100 x) 100 x))
+  (define (loop i acc)
+    (if (eq i 0) acc (loop (- i 1) (+ acc (clamp (sq i))))))
+  (loop 30 0)
+)";
+
+} // namespace
+
+// ── Generator ──────────────────────────────────────────────────────────────
+
+TEST(RegisterGeneratorTests, OperandsAreReadInPlace) {
+  auto code = compile("(define (f x y) (* (+ x 1) (- y x))) (f 2 5)");
+  EXPECT_EQ(count(code, Operation::ADDI), 1U);
+  EXPECT_EQ(count(code, Operation::SUB), 1U);
+  EXPECT_EQ(count(code, Operation::MUL), 1U);
+  EXPECT_EQ(count(code, Operation::MOV), 0U);
+}
+
+TEST(RegisterGeneratorTests, ComparisonInConditionBecomesABranch) {
+  auto code = compile("(define (f x y) (if (< x y) 1 2)) (f 1 2)");
+  EXPECT_EQ(count(code, Operation::JGE), 1U);
+  EXPECT_EQ(count(code, Operation::LT), 0U);
+  EXPECT_EQ(count(code, Operation::JF), 0U);
+}
+
+TEST(RegisterGeneratorTests, KnownGlobalsAreCalledByEntry) {
+  auto code = compile(loop_src);
+  EXPECT_EQ(count(code, Operation::CALL), 0U);
+  EXPECT_EQ(count(code, Operation::CALLDIRECT), 3U);
+  EXPECT_EQ(count(code, Operation::TAILCALLDIRECT), 1U);
+}
+
+TEST(RegisterGeneratorTests, CapturedAndSetLocalIsBoxed) {
+  auto code = compile(R"(
+    (define (counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))
+    ((counter))
+  )");
+  EXPECT_EQ(count(code, Operation::BOX), 1U);
+  EXPECT_EQ(count(code, Operation::SETBOX), 1U);
+}
+
+TEST(RegisterGeneratorTests, UncapturedSetLocalStaysInItsRegister) {
+  auto code =
+      compile("(define (f x) (let ((a (* x 2))) (set! a (+ a 1)) a)) (f 4)");
+  EXPECT_EQ(count(code, Operation::BOX), 0U);
+}
+
+// ── Machine ────────────────────────────────────────────────────────────────
+
+TEST(RegisterMachineTests, ComparisonsKeepTheStackOperandOrder) {
+  // (< 1 2) on the stack machine is 2 < 1
+  RegisterMachine vm({
+      {.op = Operation::ENTER, .k = 3},
+      {.op = Operation::LOADK, .a = 1, .k = 1},
+      {.op = Operation::LOADK, .a = 2, .k = 2},
+      {.op = Operation::LT, .a = 0, .b = 1, .c = 2},
+      {.op = Operation::HALT, .a = 0, .b = 1},
+  });
+  EXPECT_EQ(vm.run_program(), MachineState::HALT);
+  ASSERT_TRUE(vm.result());
+  EXPECT_EQ(vm.result()->value, 0);
+}
+
+TEST(RegisterMachineTests, TailCallReusesTheFrame) {
+  // f(n) = n == 0 ? 7 : f(n - 1), called from the top level with 100
+  RegisterMachine vm({
+      {.op = Operation::ENTER, .k = 2},
+      {.op = Operation::LOADK, .a = 1, .k = 100},
+      {.op = Operation::CALLDIRECT, .a = 0, .b = 1, .c = 1, .k = 4},
+      {.op = Operation::HALT, .a = 0, .b = 1},
+      {.op = Operation::ENTER, .k = 2},
+      {.op = Operation::LOADK, .a = 1, .k = 0},
+      {.op = Operation::JNE, .a = 0, .b = 1, .k = 9},
+      {.op = Operation::LOADK, .a = 1, .k = 7},
+      {.op = Operation::RET, .a = 1},
+      {.op = Operation::ADDI, .a = 1, .b = 0, .k = uint64_t{0} - 1},
+      {.op = Operation::TAILCALLDIRECT, .b = 1, .c = 1, .k = 4},
+  });
+  EXPECT_EQ(vm.run_program(), MachineState::HALT);
+  ASSERT_TRUE(vm.result());
+  EXPECT_EQ(vm.result()->value, 7);
+  EXPECT_EQ(RegisterMachineTestAccess::frames(vm), 0U);
+}
+
+TEST(RegisterMachineTests, CarOfANumberFails) {
+  RegisterMachine vm({
+      {.op = Operation::ENTER, .k = 2},
+      {.op = Operation::LOADK, .a = 1, .k = 3},
+      {.op = Operation::CAR, .a = 0, .b = 1},
+      {.op = Operation::HALT, .a = 0, .b = 1},
+  });
+  EXPECT_EQ(vm.run_program(), MachineState::INVALID_INSTR);
+}
+
+TEST(RegisterMachineTests, DivisionByZeroFails) {
+  RegisterMachine vm({
+      {.op = Operation::ENTER, .k = 2},
+      {.op = Operation::LOADK, .a = 1, .k = 3},
+      {.op = Operation::DIV, .a = 0, .b = 1, .c = 0},
+      {.op = Operation::HALT, .a = 0, .b = 1},
+  });
+  EXPECT_EQ(vm.run_program(), MachineState::INVALID_OP);
+}
+
+// ── Against the stack machine ──────────────────────────────────────────────
+
+TEST(RegisterEngineTests, AgreesWithTheStackMachine) {
+  const std::vector<std::string> programs = {
+      "(% 10 3)",
+      "(- (* 3 (+ 4 5)) (/ 10 2))",
+      "(if (<= 3 2) 1 2)",
+      "(let ((x 1) (y 2)) (let ((z (+ x y))) (* z 10)))",
+      R"((define (f x) (let ((g (lambda (y) (+ x y)))) (g 5)))
+         (f 3))",
+      R"((define (f x)
+           (let ((g (lambda (y) (+ x y))) (p (cons x 2)))
+             (+ (g (car p)) (cdr p))))
+         (f 3))",
+      R"((define (sum-to n) (if (eq n 0) 0 (+ n (sum-to (- n 1)))))
+         (define (f x) (let ((y (* x x))) (set! y (+ y (* x x))) y))
+         (let ((p (cons 1 2))) (+ (car p) (+ (f 3) (sum-to 10)))))",
+      R"((define (compose f g) (lambda (x) (f (g x))))
+         (define inc2 (compose (lambda (x) (+ x 1)) (lambda (x) (+ x 1))))
+         (define (loop n acc)
+           (if (eq n 0) acc (loop (- n 1) (inc2 (+ acc n)))))
+         (define (sum xs) (if (null? xs) 0 (+ (car xs) (sum (cdr xs)))))
+         (+ (loop 10 0) (sum (cons 4 (cons 5 nil)))))",
+      R"((define (counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))
+         (define c (counter))
+         (c) (c) (c))",
+      R"((letrec ((even? (lambda (n) (if n (odd?  (- n 1)) 1)))
+                  (odd?  (lambda (n) (if n (even? (- n 1)) 0))))
+           (odd? 7)))",
+      R"((define (sum-by n)
+           (letrec ((loop (lambda (i acc)
+                            (if (eq i 0) acc (loop (- i 1) (+ acc n))))))
+             (loop n 0)))
+         (sum-by 7))",
+      loop_src,
+  };
+  for (auto &src : programs) {
+    for (auto level : {OptLevel::O0, OptLevel::O2}) {
+      auto stack = run_stack(src, level);
+      auto reg = run_register(src, level);
+      EXPECT_EQ(reg.state, MachineState::HALT) << src;
+      EXPECT_EQ(reg.state, stack.state) << src;
+      EXPECT_EQ(reg.value, stack.value) << src;
+    }
+  }
+}
+
+TEST(RegisterEngineTests, RunsFarFewerInstructions) {
+  auto stack = run_stack(loop_src, OptLevel::O0);
+  auto reg = run_register(loop_src, OptLevel::O0);
+  EXPECT_EQ(reg.value, 10070);
+  EXPECT_LE(reg.executed * 2, stack.executed);
+}
@@ -0,0 +1,142 @@
+#include <cstdint>
+#include <memory>
+#include <variant>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <optimizer/shaker.hpp>
+
+namespace {
+
+constexpr core::SymbolId kAdd = 0;
+constexpr core::SymbolId kDiv = 3;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr apply_expr(core::SymbolId callee, core::Expr lhs, core::Expr rhs) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(lhs)));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(rhs)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Define define(core::SymbolId name, core::Expr rhs) {
+  return core::Define{.name = name,
+                      .rhs = std::make_unique<core::Expr>(std::move(rhs))};
+}
+
+bool defines(const core::Program &prog, core::SymbolId name) {
+  for (const auto &top : prog) {
+    if (auto *def = std::get_if<core::Define>(&top); def && def->name == name)
+      return true;
+  }
+  return false;
+}
+
+} // namespace
+
+TEST(ShakerTests, UnreferencedDefineIsRemoved) {
+  core::Program prog;
+  prog.emplace_back(define(20, const_expr(1)));
+  prog.emplace_back(define(21, const_expr(2)));
+  prog.emplace_back(var_expr(21));
+
+  Shaker shaker;
+  shaker.run(prog);
+
+  EXPECT_FALSE(defines(prog, 20));
+  EXPECT_TRUE(defines(prog, 21));
+  EXPECT_EQ(prog.size(), 2U);
+}
+
+TEST(ShakerTests, DefinesReachableThroughOtherDefinesAreKept) {
+  // (define a 1) (define b (lambda () a)) (define c (lambda () b)) (c)
+  core::Lambda b_lam;
+  b_lam.body.push_back(std::make_unique<core::Expr>(var_expr(20)));
+  core::Lambda c_lam;
+  c_lam.body.push_back(std::make_unique<core::Expr>(var_expr(21)));
+  core::Apply call;
+  call.callee = std::make_unique<core::Expr>(var_expr(22));
+
+  core::Program prog;
+  prog.emplace_back(define(20, const_expr(1)));
+  prog.emplace_back(define(21, core::Expr{.node = std::move(b_lam)}));
+  prog.emplace_back(define(22, core::Expr{.node = std::move(c_lam)}));
+  prog.emplace_back(core::Expr{.node = std::move(call)});
+
+  Shaker shaker;
+  shaker.run(prog);
+
+  EXPECT_TRUE(defines(prog, 20));
+  EXPECT_TRUE(defines(prog, 21));
+  EXPECT_TRUE(defines(prog, 22));
+}
+
+TEST(ShakerTests, EffectfulDefineIsKept) {
+  // (define a (/ 1 0)) may fault at runtime so it is never removed
+  core::Program prog;
+  prog.emplace_back(
+      define(20, apply_expr(kDiv, const_expr(1), const_expr(0))));
+  prog.emplace_back(const_expr(0));
+
+  Shaker shaker;
+  shaker.run(prog);
+
+  EXPECT_TRUE(defines(prog, 20));
+}
+
+TEST(ShakerTests, PureDroppedStatementsAreRemovedFromBodies) {
+  // (lambda (x) (+ x 1) (set! x 2) x) -> (lambda (x) (set! x 2) x), with x
+  // proven an integer by the typer
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(30));
+  auto add = apply_expr(kAdd, var_expr(30), const_expr(1));
+  std::get<core::Apply>(add.node).unchecked = true;
+  lam.body.push_back(std::make_unique<core::Expr>(std::move(add)));
+  lam.body.push_back(std::make_unique<core::Expr>(core::Expr{
+      .node = core::Set{.name = 30,
+                        .rhs = std::make_unique<core::Expr>(const_expr(2))}}));
+  lam.body.push_back(std::make_unique<core::Expr>(var_expr(30)));
+
+  core::Program prog;
+  prog.emplace_back(core::Expr{.node = std::move(lam)});
+
+  Shaker shaker;
+  shaker.run(prog);
+
+  const auto &body =
+      std::get<core::Lambda>(std::get<core::Expr>(prog[0]).node).body;
+  ASSERT_EQ(body.size(), 2U);
+  EXPECT_NE(std::get_if<core::Set>(&body[0]->node), nullptr);
+  EXPECT_NE(std::get_if<core::Var>(&body[1]->node), nullptr);
+}
+
+TEST(ShakerTests, ArithmeticWhichMayFaultIsKept) {
+  // (lambda (x) (+ x 1) (+ 2 3) x) -> (lambda (x) (+ x 1) x), x may be a
+  // closure which + faults on
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(30));
+  lam.body.push_back(std::make_unique<core::Expr>(
+      apply_expr(kAdd, var_expr(30), const_expr(1))));
+  lam.body.push_back(std::make_unique<core::Expr>(
+      apply_expr(kAdd, const_expr(2), const_expr(3))));
+  lam.body.push_back(std::make_unique<core::Expr>(var_expr(30)));
+
+  core::Program prog;
+  prog.emplace_back(core::Expr{.node = std::move(lam)});
+
+  Shaker shaker;
+  shaker.run(prog);
+
+  const auto &body =
+      std::get<core::Lambda>(std::get<core::Expr>(prog[0]).node).body;
+  ASSERT_EQ(body.size(), 2U);
+  EXPECT_NE(std::get_if<core::Apply>(&body[0]->node), nullptr);
+  EXPECT_NE(std::get_if<core::Var>(&body[1]->node), nullptr);
+}
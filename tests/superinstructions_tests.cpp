@@ -0,0 +1,94 @@
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/isa/isa.hpp>
+#include <optimizer/superinstructions.hpp>
+
+namespace {
+
+using ISA::Operation;
+
+std::vector<Operation> ops(const std::vector<ISA::Instruction> &code) {
+  std::vector<Operation> out;
+  for (const auto &instr : code)
+    out.push_back(instr.op);
+  return out;
+}
+
+} // namespace
+
+TEST(SuperinstructionsTests, LocalRunsAreFused) {
+  std::vector<ISA::Instruction> code{
+      {Operation::GETLOCAL, 0},       {Operation::GETLOCAL, 1},
+      {Operation::UADD, std::nullopt}, {Operation::GETLOCAL, 2},
+      {Operation::ADDI, uint64_t{0} - 1}, {Operation::GETLOCAL, 3},
+      {Operation::CDR, std::nullopt},  {Operation::GETLOCAL, 4},
+      {Operation::GETLOCAL, 5},       {Operation::HALT, std::nullopt},
+  };
+  Superinstructions superinstructions;
+  superinstructions.run(code);
+
+  ASSERT_EQ(ops(code), (std::vector<Operation>{
+                           Operation::ADDLL, Operation::ADDLI,
+                           Operation::LOCALCDR, Operation::GETLOCAL2,
+                           Operation::HALT}));
+  EXPECT_EQ(code[0].operand, ISA::pack(0, 1));
+  EXPECT_EQ(static_cast<int32_t>(ISA::high(*code[1].operand)), -1);
+  EXPECT_EQ(code[2].operand, 3U);
+  EXPECT_EQ(code[3].operand, ISA::pack(4, 5));
+}
+
+TEST(SuperinstructionsTests, GlobalCallDropsTheHandleLoad) {
+  // 0: loadglobal 7  1: get_local 0  2: addi 1  3: call 1  4: jmp 0
+  std::vector<ISA::Instruction> code{
+      {Operation::LOADGLOBAL, 7},
+      {Operation::GETLOCAL, 0},
+      {Operation::ADDI, 1},
+      {Operation::CALL, 1},
+      {Operation::JMP, 0},
+  };
+  Superinstructions superinstructions;
+  superinstructions.run(code);
+
+  ASSERT_EQ(ops(code),
+            (std::vector<Operation>{Operation::ADDLI, Operation::CALLGLOBAL,
+                                    Operation::JMP}));
+  EXPECT_EQ(code[1].operand, ISA::pack(7, 1));
+  EXPECT_EQ(code[2].operand, 0U);
+}
+
+TEST(SuperinstructionsTests, GlobalCallAcrossAnotherCallIsKept) {
+  // (f (g x)): g may store into f, so f is still loaded first
+  std::vector<ISA::Instruction> code{
+      {Operation::LOADGLOBAL, 7}, {Operation::LOADGLOBAL, 8},
+      {Operation::GETLOCAL, 0},   {Operation::CALL, 1},
+      {Operation::CALL, 1},       {Operation::HALT, std::nullopt},
+  };
+  Superinstructions superinstructions;
+  superinstructions.run(code);
+
+  ASSERT_EQ(ops(code),
+            (std::vector<Operation>{Operation::LOADGLOBAL, Operation::GETLOCAL,
+                                    Operation::CALLGLOBAL, Operation::CALL,
+                                    Operation::HALT}));
+  EXPECT_EQ(code[0].operand, 7U);
+  EXPECT_EQ(code[2].operand, ISA::pack(8, 1));
+}
+
+TEST(SuperinstructionsTests, LetInArgumentsBlocksGlobalCall) {
+  // (f (let ((y 1)) y)): the let slot sits above the handle
+  std::vector<ISA::Instruction> code{
+      {Operation::LOADGLOBAL, 7}, {Operation::PUSH, 1},
+      {Operation::GETLOCAL, 1},   {Operation::NROT, 2},
+      {Operation::DROP, 1},       {Operation::CALL, 1},
+      {Operation::HALT, std::nullopt},
+  };
+  Superinstructions superinstructions;
+  superinstructions.run(code);
+
+  EXPECT_EQ(code.front().op, Operation::LOADGLOBAL);
+  EXPECT_EQ(code[5].op, Operation::CALL);
+}
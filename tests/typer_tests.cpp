@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <memory>
+#include <variant>
+
+#include <gtest/gtest.h>
+
+#include <frontend/core.hpp>
+#include <optimizer/typer.hpp>
+
+namespace {
+
+constexpr core::SymbolId kAdd = 0;
+constexpr core::SymbolId kCons = 5;
+constexpr core::SymbolId kCar = 6;
+constexpr core::SymbolId kFunc = 20;
+
+core::Expr const_expr(uint64_t v) { return core::Expr{.node = core::Const{v}}; }
+
+core::Expr var_expr(core::SymbolId id) {
+  return core::Expr{.node = core::Var{id}};
+}
+
+core::Expr call_expr(core::SymbolId callee, core::Expr a) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(a)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+core::Expr call_expr(core::SymbolId callee, core::Expr a, core::Expr b) {
+  core::Apply apply;
+  apply.callee = std::make_unique<core::Expr>(var_expr(callee));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(a)));
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(b)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+// (let ((id value)) body...)
+core::Expr let_expr(core::SymbolId id, core::Expr value,
+                    std::vector<core::Expr> body) {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(id));
+  for (auto &stmt : body)
+    lam.body.push_back(std::make_unique<core::Expr>(std::move(stmt)));
+  core::Apply apply;
+  apply.callee =
+      std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)});
+  apply.args.push_back(std::make_unique<core::Expr>(std::move(value)));
+  return core::Expr{.node = std::move(apply)};
+}
+
+// (define (f x) (+ x 1))
+core::Define increment() {
+  core::Lambda lam;
+  lam.formals.push_back(std::make_unique<core::SymbolId>(40));
+  lam.body.push_back(std::make_unique<core::Expr>(
+      call_expr(kAdd, var_expr(40), const_expr(1))));
+  return core::Define{
+      .name = kFunc,
+      .rhs = std::make_unique<core::Expr>(core::Expr{.node = std::move(lam)})};
+}
+
+const core::Apply &increment_body(const core::Program &prog) {
+  const auto &lam =
+      std::get<core::Lambda>(std::get<core::Define>(prog[0]).rhs->node);
+  return std::get<core::Apply>(lam.body[0]->node);
+}
+
+const core::Apply &let_body(const core::Program &prog, size_t i) {
+  const auto &apply = std::get<core::Apply>(std::get<core::Expr>(prog[0]).node);
+  const auto &lam = std::get<core::Lambda>(apply.callee->node);
+  return std::get<core::Apply>(lam.body.at(i)->node);
+}
+
+} // namespace
+
+TEST(TyperTests, ConstantOperandsAreUnchecked) {
+  core::Program prog;
+  prog.emplace_back(call_expr(kAdd, const_expr(1), const_expr(2)));
+
+  Typer typer;
+  typer.run(prog);
+
+  EXPECT_TRUE(std::get<core::Apply>(std::get<core::Expr>(prog[0]).node)
+                  .unchecked);
+}
+
+TEST(TyperTests, KnownFunctionFormalsJoinCallSites) {
+  // (define (f x) (+ x 1)) (f 2)
+  core::Program prog;
+  prog.emplace_back(increment());
+  prog.emplace_back(call_expr(kFunc, const_expr(2)));
+
+  Typer typer;
+  typer.run(prog);
+
+  EXPECT_TRUE(increment_body(prog).unchecked);
+}
+
+TEST(TyperTests, EscapingFunctionFormalsStayChecked) {
+  // (define (f x) (+ x 1)) (f 2) f
+  core::Program prog;
+  prog.emplace_back(increment());
+  prog.emplace_back(call_expr(kFunc, const_expr(2)));
+  prog.emplace_back(var_expr(kFunc));
+
+  Typer typer;
+  typer.run(prog);
+
+  EXPECT_FALSE(increment_body(prog).unchecked);
+}
+
+TEST(TyperTests, CallSiteWithPairKeepsFormalChecked) {
+  // (define (f x) (+ x 1)) (f 2) (f (cons 1 2))
+  core::Program prog;
+  prog.emplace_back(increment());
+  prog.emplace_back(call_expr(kFunc, const_expr(2)));
+  prog.emplace_back(
+      call_expr(kFunc, call_expr(kCons, const_expr(1), const_expr(2))));
+
+  Typer typer;
+  typer.run(prog);
+
+  EXPECT_FALSE(increment_body(prog).unchecked);
+}
+
+TEST(TyperTests, CarOfLetBoundPairIsUnchecked) {
+  // (let ((p (cons 1 2))) (car p))
+  std::vector<core::Expr> body;
+  body.push_back(call_expr(kCar, var_expr(30)));
+  core::Program prog;
+  prog.emplace_back(let_expr(
+      30, call_expr(kCons, const_expr(1), const_expr(2)), std::move(body)));
+
+  Typer typer;
+  typer.run(prog);
+
+  EXPECT_TRUE(let_body(prog, 0).unchecked);
+}
+
+TEST(TyperTests, SetChangesTheTypeFromThatPointOn) {
+  // (let ((x 1)) (+ x 1) (set! x (cons 1 2)) (+ x 1))
+  std::vector<core::Expr> body;
+  body.push_back(call_expr(kAdd, var_expr(30), const_expr(1)));
+  body.push_back(core::Expr{
+      .node = core::Set{.name = 30,
+                        .rhs = std::make_unique<core::Expr>(call_expr(
+                            kCons, const_expr(1), const_expr(2)))}});
+  body.push_back(call_expr(kAdd, var_expr(30), const_expr(1)));
+  core::Program prog;
+  prog.emplace_back(let_expr(30, const_expr(1), std::move(body)));
+
+  Typer typer;
+  typer.run(prog);
+
+  EXPECT_TRUE(let_body(prog, 0).unchecked);
+  EXPECT_FALSE(let_body(prog, 2).unchecked);
+}
@@ -0,0 +1,167 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <backend/isa/isa.hpp>
+#include <backend/vm/stack.hpp>
+#include <backend/vm/verifier.hpp>
+#include <optimizer/pass_manager.hpp>
+
+#include "compile.hpp"
+
+namespace {
+
+using ISA::Operation;
+
+Verified verify(const std::vector<ISA::Instruction> &code) {
+  return verify_bytecode(ISA::encode(code).bytes);
+}
+
+// calls the function at index 3 with 5, it holds one local
+std::vector<ISA::Instruction> call_with(std::vector<ISA::Instruction> body) {
+  std::vector<ISA::Instruction> code{{Operation::PUSH, 5},
+                                     {Operation::CALLDIRECT, 3},
+                                     {Operation::HALT, std::nullopt},
+                                     {Operation::ENTER, 1}};
+  code.insert(code.end(), body.begin(), body.end());
+  return code;
+}
+
+} // namespace
+
+TEST(VerifierTests, GeneratedProgramsVerify) {
+  const auto src =
+      "(define (fib n) (if (< 2 n) n (+ (fib (- n 1)) (fib (- n 2)))))"
+      "(define (compose f g) (lambda (x) (f (g x))))"
+      "(define inc2 (compose (lambda (x) (+ x 1)) (lambda (x) (+ x 1))))"
+      "(define (counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))"
+      "(define c (counter))"
+      "(c)"
+      "(+ (fib 10) (+ (inc2 1) (c)))";
+  for (auto level : {OptLevel::O0, OptLevel::O2}) {
+    const auto proof = verify(test::compile(src, level));
+    EXPECT_TRUE(proof.max_depth.contains(0));
+    EXPECT_GT(proof.max_depth.size(), 4U);
+    EXPECT_GT(proof.globals, 0U);
+  }
+}
+
+TEST(VerifierTests, MaxDepthIsTheDeepestPointOfEachFunction) {
+  const auto code = call_with({{Operation::GETLOCAL, 0},
+                               {Operation::GETLOCAL, 0},
+                               {Operation::ADD, std::nullopt},
+                               {Operation::RETN, 1}});
+  const auto entry = ISA::encode(code).offsets[3];
+  const auto proof = verify(code);
+  EXPECT_EQ(proof.max_depth.at(0), 1U);
+  // the argument and the two copies of it
+  EXPECT_EQ(proof.max_depth.at(entry), 3U);
+}
+
+TEST(VerifierTests, PoppingAnEmptyFrameIsRejected) {
+  EXPECT_THROW(verify({{Operation::ADD, std::nullopt},
+                       {Operation::HALT, std::nullopt}}),
+               std::runtime_error);
+}
+
+TEST(VerifierTests, DepthsDifferingAtAJoinAreRejected) {
+  EXPECT_THROW(verify({{Operation::PUSH, 0},
+                       {Operation::CJMPZ, 3},
+                       {Operation::PUSH, 1},
+                       {Operation::HALT, std::nullopt}}),
+               std::runtime_error);
+}
+
+TEST(VerifierTests, LocalOutsideTheFrameIsRejected) {
+  EXPECT_NO_THROW(verify(call_with({{Operation::RET, std::nullopt}})));
+  EXPECT_THROW(
+      verify(call_with({{Operation::GETLOCAL, 1}, {Operation::RETN, 1}})),
+      std::runtime_error);
+}
+
+TEST(VerifierTests, ReturnLeavingMoreThanTheResultIsRejected) {
+  EXPECT_THROW(verify(call_with({{Operation::GETLOCAL, 0},
+                                 {Operation::GETLOCAL, 0},
+                                 {Operation::RETN, 1}})),
+               std::runtime_error);
+}
+
+TEST(VerifierTests, RotationPastTheFrameIsRejected) {
+  EXPECT_NO_THROW(verify({{Operation::PUSH, 1},
+                          {Operation::PUSH, 2},
+                          {Operation::NROT, 2},
+                          {Operation::HALT, std::nullopt}}));
+  EXPECT_THROW(verify({{Operation::PUSH, 1},
+                       {Operation::NROT, 2},
+                       {Operation::HALT, std::nullopt}}),
+               std::runtime_error);
+  // NROT 0 would put the top cell one past the end of the stack
+  EXPECT_THROW(verify({{Operation::PUSH, 1},
+                       {Operation::NROT, 0},
+                       {Operation::HALT, std::nullopt}}),
+               std::runtime_error);
+}
+
+TEST(VerifierTests, RunningOffTheEndIsRejected) {
+  EXPECT_THROW(verify({{Operation::PUSH, 1}}), std::runtime_error);
+}
+
+TEST(VerifierTests, CallToSomethingOtherThanEnterIsRejected) {
+  EXPECT_THROW(verify({{Operation::CALLDIRECT, 2},
+                       {Operation::HALT, std::nullopt},
+                       {Operation::PUSH, 1},
+                       {Operation::RET, std::nullopt}}),
+               std::runtime_error);
+}
+
+TEST(VerifierTests, MalformedCodeIsRejected) {
+  // a jump into the middle of the two byte operand of the PUSH
+  auto bytes = ISA::encode({{Operation::PUSH, 200},
+                            {Operation::JMP, 0},
+                            {Operation::HALT, std::nullopt}})
+                   .bytes;
+  ASSERT_EQ(bytes[3], static_cast<uint8_t>(Operation::JMP));
+  bytes[4] = 1;
+  EXPECT_THROW(verify_bytecode(bytes), std::runtime_error);
+
+  const std::vector<uint8_t> unknown{0xFF};
+  EXPECT_THROW(verify_bytecode(unknown), std::runtime_error);
+  const std::vector<uint8_t> truncated{static_cast<uint8_t>(Operation::PUSH),
+                                       0x80};
+  EXPECT_THROW(verify_bytecode(truncated), std::runtime_error);
+}
+
+TEST(VerifierTests, VerifiedProgramRunsLikeTheChecked) {
+  const auto code = test::compile(
+      "(define (build n acc) (if (eq n 0) acc (build (- n 1) (cons n acc))))"
+      "(define (len xs) (if (null? xs) 0 (+ 1 (len (cdr xs)))))"
+      "(len (build 300 nil))");
+  Stack checked(code);
+  Stack verified(code);
+  verified.verify();
+  EXPECT_TRUE(verified.is_verified());
+  EXPECT_EQ(checked.run_program(), MachineState::HALT);
+  EXPECT_EQ(verified.run_program(), MachineState::HALT);
+  EXPECT_EQ(verified.result()->value, 300);
+  EXPECT_EQ(verified.result()->value, checked.result()->value);
+  EXPECT_EQ(verified.executed(), checked.executed());
+}
+
+TEST(VerifierTests, VerifiedMachineChecksTheArityOfClosures) {
+  Stack vm(test::compile("(define (mk k) (lambda (x) (+ x k)))"
+                   "(define f (mk 1))"
+                   "(f 1 2)",
+                   OptLevel::O0));
+  vm.verify();
+  EXPECT_EQ(vm.run_program(), MachineState::INVALID_OP);
+}
+
+TEST(VerifierTests, StackRejectsCodeWhichDoesNotVerify) {
+  Stack vm(std::vector<ISA::Instruction>{{Operation::ADD, std::nullopt},
+                                         {Operation::HALT, std::nullopt}});
+  EXPECT_THROW(vm.verify(), std::runtime_error);
+  EXPECT_FALSE(vm.is_verified());
+}
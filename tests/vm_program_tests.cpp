@@ -17,12 +17,11 @@ struct StackTestAccess {
     return stack.data_stack;
   }
   static size_t &pc(Stack &stack) { return stack.pc; }
+  static void next(Stack &stack) { stack.pc = stack.next_pc; }
 };
 
-constexpr size_t kInstrSize = 9;
-
 TEST(StackProgramTests, ConditionalJump) {
-  constexpr size_t kTrue = 6 * kInstrSize;
+  constexpr size_t kTrue = 6;
 
   const std::vector<ISA::Instruction> program{
       {ISA::Operation::PUSH, 3},           // 3
@@ -48,7 +47,7 @@ TEST(StackProgramTests, ConditionalJump) {
       break;
     }
     if (StackTestAccess::pc(stack) == prev_pc) {
-      StackTestAccess::pc(stack) += kInstrSize;
+      StackTestAccess::next(stack);
     }
   }
   EXPECT_EQ(state, MachineState::HALT);